@@ -0,0 +1,539 @@
+#include <mlp/chess/board.hpp>
+#include <mlp/chess/opening_tree.hpp>
+#include <mlp/chess/pgn_parser.hpp>
+#include <mlp/chess/pgn_replay.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace mlp;
+
+namespace
+{
+
+// Keeps the optimizer from discarding a result we never look at
+template<typename T>
+void
+do_not_optimize(T const& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Writes text as a JSON string, quotes included. Benchmark names hold corpus paths, which may need escaping
+void
+print_json_string(std::ostream& os, std::string_view const text)
+{
+    os << '"';
+    for (char const c: text)
+    {
+        switch (c)
+        {
+            case '"': os << "\\\""; break;
+            case '\\': os << "\\\\"; break;
+            case '\n': os << "\\n"; break;
+            case '\r': os << "\\r"; break;
+            case '\t': os << "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char code[7];
+                    std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned>(c));
+                    os << code;
+                }
+                else
+                {
+                    os << c;
+                }
+        }
+    }
+    os << '"';
+}
+
+struct options
+{
+    bool json = false;
+    unsigned repetitions = 10;
+    std::chrono::nanoseconds min_time = std::chrono::milliseconds(50); // Per repetition
+    std::string filter;
+    std::vector<std::filesystem::path> corpora;
+};
+
+// What one call of a benchmarked operation processes, for the throughput figures
+struct work
+{
+    double plies = 0;
+    double bytes = 0;
+};
+
+struct result
+{
+    std::string name;
+    std::size_t iterations = 0; // Per repetition
+    std::vector<double> ns_per_op;
+    work per_op;
+
+    double median() const
+    {
+        auto sorted = ns_per_op;
+        std::sort(sorted.begin(), sorted.end());
+        auto const mid = sorted.size() / 2;
+        return (sorted.size() % 2) ? sorted[mid] : ((sorted[mid - 1] + sorted[mid]) / 2);
+    }
+    double mean() const
+    {
+        double sum = 0;
+        for (auto const ns: ns_per_op)
+        {
+            sum += ns;
+        }
+        return sum / ns_per_op.size();
+    }
+    double stddev() const
+    {
+        double const m = mean();
+        double sum = 0;
+        for (auto const ns: ns_per_op)
+        {
+            sum += (ns - m) * (ns - m);
+        }
+        return (ns_per_op.size() > 1) ? std::sqrt(sum / (ns_per_op.size() - 1)) : 0.0;
+    }
+};
+
+class runner
+{
+public:
+    explicit runner(options const& opts): opts_(opts) {}
+
+    // Times `op`. The iteration count is calibrated once so that a repetition lasts at least
+    // min_time, then the same count is timed `repetitions` times.
+    template<typename Op>
+    void run(std::string const& name, work const per_op, Op&& op)
+    {
+        if (!opts_.filter.empty() && (name.find(opts_.filter) == std::string::npos))
+        {
+            return;
+        }
+        using clock = std::chrono::steady_clock;
+        auto const time_batch = [&](std::size_t const iterations)
+        {
+            auto const start = clock::now();
+            for (std::size_t i = 0; i < iterations; ++i)
+            {
+                op();
+            }
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start);
+        };
+
+        std::size_t iterations = 1;
+        while (true)
+        {
+            auto const elapsed = time_batch(iterations);
+            if (elapsed >= opts_.min_time)
+            {
+                break;
+            }
+            // Aim straight for the target, but grow by at most 10x per step
+            double const scale = elapsed.count() ? (1.4 * opts_.min_time.count() / elapsed.count()) : 10.0;
+            iterations = static_cast<std::size_t>(iterations * std::clamp(scale, 1.5, 10.0)) + 1;
+        }
+
+        result res{name, iterations, {}, per_op};
+        for (unsigned rep = 0; rep < opts_.repetitions; ++rep)
+        {
+            res.ns_per_op.push_back(static_cast<double>(time_batch(iterations).count()) / iterations);
+        }
+        if (!opts_.json)
+        {
+            print_text(res);
+        }
+        results_.push_back(std::move(res));
+    }
+
+    void finish() const
+    {
+        if (opts_.json)
+        {
+            print_json();
+        }
+    }
+
+private:
+    static void print_text(result const& res)
+    {
+        double const median = res.median();
+        std::cout << std::left << std::setw(44) << res.name << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(14) << median << " ns/op"
+                  << std::setprecision(2) << "  cv " << std::setw(5) << (100 * res.stddev() / res.mean()) << "%";
+        if (res.per_op.plies > 0)
+        {
+            std::cout << std::setprecision(3) << "  " << std::setw(9) << (res.per_op.plies * 1e3 / median)
+                      << " Mplies/s";
+        }
+        if (res.per_op.bytes > 0)
+        {
+            std::cout << std::setprecision(1) << "  " << std::setw(8) << (res.per_op.bytes * 1e3 / median)
+                      << " MB/s";
+        }
+        std::cout << "\n";
+    }
+
+    void print_json() const
+    {
+        std::cout << "{\n  \"repetitions\": " << opts_.repetitions << ",\n  \"benchmarks\": [";
+        bool first = true;
+        for (auto const& res: results_)
+        {
+            double const median = res.median();
+            std::cout << (first ? "\n" : ",\n") << std::setprecision(6)
+                      << "    {\"name\": ";
+            print_json_string(std::cout, res.name);
+            std::cout << ", \"iterations\": " << res.iterations
+                      << ", \"median_ns\": " << median
+                      << ", \"mean_ns\": " << res.mean()
+                      << ", \"stddev_ns\": " << res.stddev()
+                      << ", \"min_ns\": " << *std::min_element(res.ns_per_op.begin(), res.ns_per_op.end())
+                      << ", \"plies_per_second\": " << ((res.per_op.plies > 0) ? (res.per_op.plies * 1e9 / median) : 0)
+                      << ", \"mb_per_second\": " << ((res.per_op.bytes > 0) ? (res.per_op.bytes * 1e3 / median) : 0)
+                      << "}";
+            first = false;
+        }
+        std::cout << "\n  ]\n}\n";
+    }
+
+    options const& opts_;
+    std::vector<result> results_;
+};
+
+// Plays movetext on a board, e.g. to reach the position a benchmark starts from
+chess::board
+board_after(std::string_view const move_text)
+{
+    std::vector<chess::pgn::player_move> moves;
+    char const* ptr = move_text.data();
+    char const* const end = ptr + move_text.size();
+    unsigned move_id = 0;
+    chess::pgn::player_move white_move;
+    chess::pgn::player_move black_move;
+    while (chess::pgn::parser::parse_move(ptr, end, move_id, white_move, black_move))
+    {
+        moves.push_back(white_move);
+        moves.push_back(black_move);
+    }
+    chess::board board;
+    chess::pgn::replay(board, moves);
+    return board;
+}
+
+std::string
+read_file(std::filesystem::path const& file_path)
+{
+    std::ifstream ifs(file_path, std::ios::binary);
+    std::ostringstream oss;
+    oss << ifs.rdbuf();
+    return std::move(oss).str();
+}
+
+void
+bench_parse_move(runner& r)
+{
+    struct san_case
+    {
+        char const* name;
+        std::string_view text;
+    };
+    static constexpr san_case cases[] =
+    {
+        {"pawn_moves", "1. e4 e5"},
+        {"piece_moves", "2. Nf3 Nc6"},
+        {"captures_with_check", "24. Bxf7+ Rxf7"},
+        {"disambiguation", "20. Nbd2 R1e7"},
+        {"castling", "5. O-O O-O-O"},
+        {"promotion", "5. hxg8=Q+ Nxg8"},
+    };
+    for (auto const& san: cases)
+    {
+        r.run(std::string("parse_move/") + san.name, work{2, static_cast<double>(san.text.size())}, [&]
+        {
+            char const* ptr = san.text.data();
+            unsigned move_id = 0;
+            chess::pgn::player_move white_move;
+            chess::pgn::player_move black_move;
+            do_not_optimize(chess::pgn::parser::parse_move(ptr, ptr + san.text.size(), move_id, white_move, black_move));
+            do_not_optimize(black_move);
+        });
+    }
+}
+
+void
+bench_remove_annotations(runner& r)
+{
+    std::string const plain = "1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 4. Ba4 Nf6 5. O-O Be7 6. Re1 b5 7. Bb3 d6 8. c3 O-O";
+    std::string const annotated = "1. e4 {best by test} e5 2. Nf3 (2. f4 exf4 {the King's Gambit} 3. Nf3) Nc6 "
+                                  "3. Bb5 {The Ruy Lopez (Spanish)} a6 4. Ba4 (4. Bxc6 dxc6 (4... bxc6) 5. O-O) "
+                                  "Nf6 5. O-O Be7 {[%clk 0:05:00]} 6. Re1 b5 7. Bb3 d6 8. c3 O-O";
+    std::string buffer;
+    for (auto const& [name, text]: {std::pair{"plain", &plain}, std::pair{"annotated", &annotated}})
+    {
+        r.run(std::string("remove_annotations/") + name, work{0, static_cast<double>(text->size())}, [&]
+        {
+            buffer = *text;
+            chess::pgn::remove_annotations(buffer);
+            do_not_optimize(buffer.size());
+        });
+    }
+}
+
+void
+bench_identify_moving_piece(runner& r)
+{
+    // Positions where each piece type has a legal move to resolve
+    auto const opening = board_after("1. e4 e5 2. Nf3 Nc6 3. Bc4 Bc5 4. d3 d6");
+    using chess::piece_type;
+    struct identify_case
+    {
+        char const* name;
+        piece_type type;
+        chess::square dest;
+        bool is_capture;
+    };
+    identify_case const cases[] =
+    {
+        {"Pawn", piece_type::Pawn, {'h', '3'}, false},
+        {"Knight", piece_type::Knight, {'c', '3'}, false},
+        {"Bishop", piece_type::Bishop, {'g', '5'}, false},
+        {"Rook", piece_type::Rook, {'g', '1'}, false},
+        {"Queen", piece_type::Queen, {'e', '2'}, false},
+        {"King", piece_type::King, {'e', '2'}, false},
+    };
+    for (auto const& c: cases)
+    {
+        auto board = opening;
+        r.run(std::string("identify_moving_piece/") + c.name, work{1, 0}, [&]
+        {
+            chess::square src;
+            do_not_optimize(board.identify_moving_piece(chess::piece_colour::White, c.type, src, c.dest, c.is_capture));
+            do_not_optimize(src);
+        });
+    }
+}
+
+void
+bench_board_updates(runner& r)
+{
+    auto board = board_after("1. e4 e5 2. Nf3 Nc6 3. Bc4 Bc5 4. d3 d6 5. Be3 Be6 6. Nc3 Nf6 7. Qd2 Qd7");
+    auto moving = board;
+    r.run("board::move", work{2, 0}, [&]
+    {
+        moving.move(chess::square('f', '3'), chess::square('g', '5'), false);
+        moving.move(chess::square('g', '5'), chess::square('f', '3'), false);
+        // Bound the hash history, which grows by one entry per move
+        if (moving.hash_history().size() > 4096) [[unlikely]]
+        {
+            moving = board;
+        }
+    });
+    r.run("board::copy", work{}, [&]
+    {
+        auto copy = board;
+        do_not_optimize(copy);
+    });
+    r.run("board::perform_kingside_castling+copy", work{1, 0}, [&]
+    {
+        auto copy = board;
+        copy.perform_kingside_castling(chess::piece_colour::White);
+        do_not_optimize(copy);
+    });
+    r.run("board::perform_queenside_castling+copy", work{1, 0}, [&]
+    {
+        auto copy = board;
+        copy.perform_queenside_castling(chess::piece_colour::White);
+        do_not_optimize(copy);
+    });
+}
+
+void
+bench_corpus(runner& r, std::filesystem::path const& file_path)
+{
+    // Count the work once up front, so the timed loops only parse and replay
+    double plies = 0;
+    {
+        chess::pgn::parser parser;
+        parser.open(file_path, chess::pgn::input_mode::mapped);
+        std::vector<chess::pgn::player_move> moves;
+        while (parser.next_game(moves))
+        {
+            plies += static_cast<double>(moves.size());
+        }
+    }
+    work const per_op{plies, static_cast<double>(file_size(file_path))};
+    auto const name = file_path.filename().string();
+
+    std::vector<chess::pgn::player_move> moves;
+    for (auto const mode: {chess::pgn::input_mode::stream, chess::pgn::input_mode::mapped})
+    {
+        auto const mode_name = (mode == chess::pgn::input_mode::stream) ? "stream" : "mapped";
+        r.run("parse/" + name + "/" + mode_name, per_op, [&]
+        {
+            chess::pgn::parser parser;
+            parser.open(file_path, mode);
+            while (parser.next_game(moves))
+            {
+                do_not_optimize(moves.data());
+            }
+        });
+        r.run("parse+replay/" + name + "/" + mode_name, per_op, [&]
+        {
+            chess::pgn::parser parser;
+            parser.open(file_path, mode);
+            while (parser.next_game(moves))
+            {
+                chess::board board;
+                chess::pgn::replay(board, moves);
+                do_not_optimize(board);
+            }
+        });
+    }
+
+    // The same text from memory, which excludes the file system from the figures
+    auto const text = read_file(file_path);
+    r.run("parse+replay/" + name + "/memory", per_op, [&]
+    {
+        chess::pgn::parser parser;
+        parser.open(text.data(), text.data() + text.size());
+        while (parser.next_game(moves))
+        {
+            chess::board board;
+            chess::pgn::replay(board, moves);
+            do_not_optimize(board);
+        }
+    });
+
+    // Opening tree of the corpus, then lookups of the positions of its first game
+    std::vector<chess::packed_move> packed_moves;
+    chess::opening_tree_builder tree;
+    chess::board first_game;
+    r.run("opening_tree::build/" + name, per_op, [&]
+    {
+        tree = chess::opening_tree_builder();
+        chess::pgn::parser parser;
+        parser.open(text.data(), text.data() + text.size());
+        for (bool first = true; parser.next_game(moves); first = false)
+        {
+            chess::board board;
+            chess::pgn::replay(board, moves);
+            chess::pgn::pack(moves, packed_moves);
+            tree.add_game(board.hash_history(), packed_moves,
+                          chess::to_game_result(parser.tags().get(chess::pgn::tag_key::Result)));
+            if (first)
+            {
+                first_game = board;
+            }
+        }
+    });
+    auto const tree_path = std::filesystem::temp_directory_path() / "chess_bench_opening_tree.bin";
+    tree.write(tree_path);
+    {
+        chess::opening_tree const index(tree_path);
+        auto const positions = first_game.hash_history();
+        std::size_t next = 0;
+        r.run("opening_tree::find/" + name, work{}, [&]
+        {
+            do_not_optimize(index.find(positions[next]));
+            next = (next + 1 == positions.size()) ? 0 : next + 1;
+        });
+    }
+    std::filesystem::remove(tree_path);
+}
+
+void
+print_usage(std::ostream& os)
+{
+    os << "Usage: chess_bench [--json] [--repetitions N] [--min-time-ms N] [--filter TEXT] [corpus.pgn...]\n"
+       << "  --json            Print the results as JSON\n"
+       << "  --repetitions N   Timed repetitions per benchmark (default 10)\n"
+       << "  --min-time-ms N   Minimum duration of one repetition (default 50)\n"
+       << "  --filter TEXT     Only run benchmarks whose name contains TEXT\n"
+       << "End to end benchmarks run on test.pgn and every corpus file given\n";
+}
+
+} // anonymous namespace
+
+int main(int const argc, char** const argv)
+{
+    std::ios::sync_with_stdio(false);
+    options opts;
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        std::string_view const option = argv[arg];
+        auto const number = [&](unsigned& value)
+        {
+            if (++arg == argc)
+            {
+                return false;
+            }
+            std::string_view const str = argv[arg];
+            auto const result = std::from_chars(str.data(), str.data() + str.size(), value);
+            return (result.ec == std::errc{}) && (result.ptr == str.data() + str.size()) && (value > 0);
+        };
+        unsigned value = 0;
+        if (option == "--json")
+        {
+            opts.json = true;
+        }
+        else if (option == "--repetitions")
+        {
+            if (!number(opts.repetitions))
+            {
+                print_usage(std::cerr);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (option == "--min-time-ms")
+        {
+            if (!number(value))
+            {
+                print_usage(std::cerr);
+                return EXIT_FAILURE;
+            }
+            opts.min_time = std::chrono::milliseconds(value);
+        }
+        else if ((option == "--filter") && (arg + 1 < argc))
+        {
+            opts.filter = argv[++arg];
+        }
+        else if (option.starts_with("-"))
+        {
+            print_usage(std::cerr);
+            return EXIT_FAILURE;
+        }
+        else
+        {
+            opts.corpora.emplace_back(argv[arg]);
+        }
+    }
+    opts.corpora.insert(opts.corpora.begin(), MLP_CHESS_TEST_PGN);
+
+    runner r(opts);
+    bench_parse_move(r);
+    bench_remove_annotations(r);
+    bench_identify_moving_piece(r);
+    bench_board_updates(r);
+    for (auto const& corpus: opts.corpora)
+    {
+        bench_corpus(r, corpus);
+    }
+    r.finish();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,132 @@
+#include <mlp/chess/board.hpp>
+#include <mlp/chess/movegen.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+using namespace mlp;
+
+namespace
+{
+
+struct test_position
+{
+    std::string_view name;
+    std::string_view fen;
+    std::vector<std::uint64_t> nodes; // Expected leaf count at depth 1, 2, ...
+};
+
+// The usual perft suite, see https://www.chessprogramming.org/Perft_Results
+std::vector<test_position> const positions = {
+    {"initial", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+     {20, 400, 8902, 197281, 4865609}},
+    {"kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+     {48, 2039, 97862, 4085603}},
+    {"position 3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+     {14, 191, 2812, 43238, 674624, 11030083}},
+    {"position 4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+     {6, 264, 9467, 422333}},
+    {"position 5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+     {44, 1486, 62379, 2103487}},
+    {"position 6", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+     {46, 2079, 89890, 3894594}},
+};
+
+// Runs perft to `depth` and prints the node count and speed. Returns whether the count is as expected
+bool
+run(std::string_view const name, chess::board const& position, unsigned const depth, std::uint64_t const expected)
+{
+    auto const start = std::chrono::steady_clock::now();
+    std::uint64_t const nodes = chess::perft(position, depth);
+    std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+    bool const ok = (expected == 0) || (nodes == expected);
+    std::cout << std::left << std::setw(12) << name << std::right
+              << " depth " << depth
+              << std::setw(12) << nodes << " nodes"
+              << std::fixed << std::setprecision(1)
+              << std::setw(10) << (nodes / elapsed.count() / 1e6) << " Mnodes/s";
+    if (!ok)
+    {
+        std::cout << "  FAILED, expected " << expected;
+    }
+    std::cout << '\n';
+    return ok;
+}
+
+void
+print_usage(std::ostream& os)
+{
+    os << "Usage: chess_perft [--depth N] [FEN]\n"
+       << "  --depth N   Limit the depth of the standard positions to N, or set the depth for FEN\n"
+       << "With a FEN, counts the nodes of that position. Otherwise checks the counts of the standard\n"
+       << "positions and fails on any mismatch\n";
+}
+
+} // anonymous namespace
+
+int main(int const argc, char** const argv)
+{
+    unsigned depth = 0;
+    std::string_view fen;
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        std::string_view const option = argv[arg];
+        if ((option == "--depth") && (arg + 1 < argc))
+        {
+            std::string_view const str = argv[++arg];
+            auto const result = std::from_chars(str.data(), str.data() + str.size(), depth);
+            if ((result.ec != std::errc{}) || (result.ptr != str.data() + str.size()) || (depth == 0))
+            {
+                print_usage(std::cerr);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (option.starts_with("-") || !fen.empty())
+        {
+            print_usage(std::cerr);
+            return EXIT_FAILURE;
+        }
+        else
+        {
+            fen = option;
+        }
+    }
+
+    try
+    {
+        if (!fen.empty())
+        {
+            chess::board const position(fen);
+            run("fen", position, depth ? depth : 5, 0);
+            return EXIT_SUCCESS;
+        }
+        bool ok = true;
+        std::uint64_t total_nodes = 0;
+        auto const start = std::chrono::steady_clock::now();
+        for (auto const& test: positions)
+        {
+            chess::board const position(test.fen);
+            unsigned const max_depth = depth ? std::min<unsigned>(depth, test.nodes.size()) : test.nodes.size();
+            ok = run(test.name, position, max_depth, test.nodes[max_depth - 1]) && ok;
+            total_nodes += test.nodes[max_depth - 1];
+        }
+        std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "total" << std::setw(30) << total_nodes << " nodes"
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(10) << (total_nodes / elapsed.count() / 1e6) << " Mnodes/s\n";
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+}
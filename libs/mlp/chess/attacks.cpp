@@ -0,0 +1,178 @@
+#include <mlp/chess/attacks.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace mlp::chess
+{
+
+namespace
+{
+
+using direction = std::array<int, 2>;
+constexpr std::array<direction, 4> bishop_directions{{{1, 1}, {1, -1}, {-1, -1}, {-1, 1}}};
+constexpr std::array<direction, 4> rook_directions{{{0, 1}, {1, 0}, {0, -1}, {-1, 0}}};
+
+// Walks each ray until it leaves the board or hits an occupied square. Only used to fill the tables
+bitboard
+slow_slider_attacks(int const index, bitboard const occupied, std::array<direction, 4> const& directions)
+{
+    bitboard attacks = 0;
+    for (auto const [file_step, rank_step]: directions)
+    {
+        int file = (index & 7) + file_step;
+        int rank = (index >> 3) + rank_step;
+        while ((file >= 0) && (file < 8) && (rank >= 0) && (rank < 8))
+        {
+            bitboard const bit = square_bit((rank * 8) + file);
+            attacks |= bit;
+            if (occupied & bit)
+            {
+                break;
+            }
+            file += file_step;
+            rank += rank_step;
+        }
+    }
+    return attacks;
+}
+
+// The squares whose occupancy can change a slider's attacks: its rays, minus the last square of each
+bitboard
+relevant_occupancy(int const index, std::array<direction, 4> const& directions)
+{
+    bitboard mask = 0;
+    for (auto const [file_step, rank_step]: directions)
+    {
+        int file = (index & 7) + file_step;
+        int rank = (index >> 3) + rank_step;
+        while ((file + file_step >= 0) && (file + file_step < 8) && (rank + rank_step >= 0) && (rank + rank_step < 8))
+        {
+            mask |= square_bit((rank * 8) + file);
+            file += file_step;
+            rank += rank_step;
+        }
+    }
+    return mask;
+}
+
+// Multipliers mapping every blocker subset of each square's relevant occupancy to a collision free slot.
+// They were found once by a fixed-seed search over sparse random numbers
+constexpr std::array<bitboard, 64> bishop_magics{
+    0x10102002004a1420, 0x8020040400584008, 0x10510800811201c8, 0x5204042080000088,
+    0x2204106880000002, 0x1401042004000000, 0x0400880410042004, 0x0028208200a02020,
+    0x1500241990010e00, 0x8001200182020a40, 0x40004101030b0000, 0x8002041042000100,
+    0x4010011041020038, 0x0000010421044000, 0x1500210808020a00, 0x8000088400880520,
+    0x0405004010040100, 0x1005823210040108, 0x2708008102040011, 0x4048200404009100,
+    0x0018104101400024, 0x0003000601190101, 0x8004803108491000, 0x8014241200820800,
+    0x0006e080100c3040, 0x0501044a11041800, 0x9020300008004045, 0x0894080000220040,
+    0x1001010083104000, 0x5004030040900080, 0x000400422c012400, 0x0002128698404812,
+    0x1010108404900440, 0x0928021182084100, 0x2006080409020024, 0x1010202020180080,
+    0xa010008200202200, 0x2098015100019004, 0x0002041440810811, 0x802a02020000b098,
+    0x0009015090004060, 0x4000821082081001, 0x0100210040420800, 0x0800004010488a00,
+    0x2000081104004040, 0x4c8e029015000082, 0x0420340322224842, 0x1298260043400210,
+    0x0000822802400008, 0x00008a0101600000, 0x3040003412080021, 0x3040290220884800,
+    0x4a1500401041004a, 0x8010200282020781, 0x0020203142209091, 0x0070300600902110,
+    0x0040808800b62048, 0x0000810400c44420, 0x00080400440c0441, 0x8340080020840411,
+    0x0000000104208200, 0x0000800810d00080, 0x0400530411080200, 0x4040702400932244
+};
+
+constexpr std::array<bitboard, 64> rook_magics{
+    0x1080004008801020, 0x0840092002c03000, 0x1900200010400900, 0x0880100008000480,
+    0x4200100420080200, 0x8100020100080400, 0x0200040110886200, 0x0200008040220411,
+    0x0404800084400220, 0x0000401000402000, 0x0086001081220440, 0x0408800800100280,
+    0x000a001201040820, 0x8848800200840080, 0x4001000100040200, 0x0442000102105084,
+    0x9080010020804100, 0x0040404000201009, 0x0000808010002009, 0x2200090021d00100,
+    0x0008008008040080, 0x0004004002010040, 0x0011040008015042, 0x00000a0001768104,
+    0x0000800080204009, 0x2010004140002001, 0x9800200280100080, 0x1000100080080080,
+    0x0442000a00049020, 0x2100040080020080, 0x0800120400900148, 0x0010040a00128541,
+    0x2800804000800030, 0x1010002000400041, 0x4000200011004100, 0x0610008410800800,
+    0x0400802402800800, 0xc100020080800400, 0x0002000802000401, 0x0182085882000401,
+    0x0220204000808000, 0x2860100040024022, 0x0001002004110040, 0x99101042000a0020,
+    0x0004080004008080, 0x0010040002008080, 0x2012004881020004, 0x8300842444820011,
+    0x0088403882010200, 0x0820400080210100, 0x0110910040a00300, 0x0801100280080480,
+    0x0242009008200600, 0x1002000489500200, 0x0040800200010080, 0x0091800041000080,
+    0x0000209300488001, 0x04c1002414824001, 0x020020000b001041, 0x7000100004200901,
+    0x8002002004100802, 0x30010002084c0007, 0x0888221800813004, 0x4000002840840112
+};
+
+struct magic_entry
+{
+    bitboard mask = 0;
+    bitboard magic = 0;
+    std::uint32_t offset = 0;
+    std::uint32_t shift = 0;
+};
+
+class magic_table
+{
+public:
+    magic_table(std::array<direction, 4> const& directions, std::array<bitboard, 64> const& magics);
+
+    bitboard
+    attacks(int const index, bitboard const occupied) const noexcept
+    {
+        auto const& entry = entries_[index];
+        return attacks_[entry.offset + (((occupied & entry.mask) * entry.magic) >> entry.shift)];
+    }
+
+private:
+    std::array<magic_entry, 64> entries_;
+    std::vector<bitboard> attacks_;
+};
+
+magic_table::magic_table(std::array<direction, 4> const& directions, std::array<bitboard, 64> const& magics)
+{
+    for (int index = 0; index < 64; ++index)
+    {
+        auto& entry = entries_[index];
+        entry.mask = relevant_occupancy(index, directions);
+        entry.magic = magics[index];
+        entry.shift = 64 - std::popcount(entry.mask);
+        entry.offset = static_cast<std::uint32_t>(attacks_.size());
+        attacks_.resize(attacks_.size() + (std::size_t{1} << std::popcount(entry.mask)));
+        // Enumerate every subset of the mask
+        bitboard subset = 0;
+        do
+        {
+            attacks_[entry.offset + ((subset * entry.magic) >> entry.shift)]
+                = slow_slider_attacks(index, subset, directions);
+            subset = (subset - entry.mask) & entry.mask;
+        } while (subset);
+    }
+}
+
+magic_table const bishop_table(bishop_directions, bishop_magics);
+magic_table const rook_table(rook_directions, rook_magics);
+
+} // namespace
+
+bitboard
+bishop_attacks(int const index, bitboard const occupied) noexcept
+{
+    return bishop_table.attacks(index, occupied);
+}
+
+bitboard
+rook_attacks(int const index, bitboard const occupied) noexcept
+{
+    return rook_table.attacks(index, occupied);
+}
+
+bitboard
+squares_between(int const src, int const dest) noexcept
+{
+    bitboard const src_bit = square_bit(src);
+    bitboard const dest_bit = square_bit(dest);
+    if (rook_attacks(src, 0) & dest_bit)
+    {
+        return rook_attacks(src, dest_bit) & rook_attacks(dest, src_bit);
+    }
+    if (bishop_attacks(src, 0) & dest_bit)
+    {
+        return bishop_attacks(src, dest_bit) & bishop_attacks(dest, src_bit);
+    }
+    return 0;
+}
+
+} // namespace mlp::chess
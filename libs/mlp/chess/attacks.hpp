@@ -0,0 +1,63 @@
+#pragma once
+
+#include <mlp/chess/bitboard.hpp>
+
+#include <array>
+
+namespace mlp::chess
+{
+
+namespace detail
+{
+// Squares reached from every square by the given (file, rank) steps, skipping those that leave the board
+template <std::size_t N>
+constexpr std::array<bitboard, 64>
+step_attacks(std::array<std::array<int, 2>, N> const& steps) noexcept
+{
+    std::array<bitboard, 64> table{};
+    for (int index = 0; index < 64; ++index)
+    {
+        for (auto const [file_step, rank_step]: steps)
+        {
+            int const file = (index & 7) + file_step;
+            int const rank = (index >> 3) + rank_step;
+            if ((file >= 0) && (file < 8) && (rank >= 0) && (rank < 8))
+            {
+                table[index] |= square_bit((rank * 8) + file);
+            }
+        }
+    }
+    return table;
+}
+}
+
+inline constexpr auto knight_attacks = detail::step_attacks(std::array<std::array<int, 2>, 8>{{
+    {1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}
+}});
+
+inline constexpr auto king_attacks = detail::step_attacks(std::array<std::array<int, 2>, 8>{{
+    {0, 1}, {1, 1}, {1, 0}, {1, -1}, {0, -1}, {-1, -1}, {-1, 0}, {-1, 1}
+}});
+
+// Squares attacked by a pawn on each square, indexed by colour_index()
+inline constexpr std::array<std::array<bitboard, 64>, 2> pawn_attacks = {
+    detail::step_attacks(std::array<std::array<int, 2>, 2>{{{-1, 1}, {1, 1}}}),
+    detail::step_attacks(std::array<std::array<int, 2>, 2>{{{-1, -1}, {1, -1}}}),
+};
+
+// Slider attacks from a square given the occupied squares, looked up in magic bitboard tables. Blocking
+// squares are included, whichever side occupies them. The tables are built once at startup, so these
+// must not be called during static initialisation of another translation unit
+bitboard bishop_attacks(int index, bitboard occupied) noexcept;
+bitboard rook_attacks(int index, bitboard occupied) noexcept;
+
+inline bitboard
+queen_attacks(int const index, bitboard const occupied) noexcept
+{
+    return bishop_attacks(index, occupied) | rook_attacks(index, occupied);
+}
+
+// The squares strictly between two squares on a shared rank, file or diagonal. 0 if they aren't aligned
+bitboard squares_between(int src, int dest) noexcept;
+
+} // namespace mlp::chess
@@ -0,0 +1,167 @@
+#include <mlp/chess/binary_games.hpp>
+#include <mlp/chess/stats.hpp>
+#include <mlp/chess/utility.hpp>
+
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+namespace mlp::chess
+{
+
+namespace
+{
+
+constexpr std::size_t header_size = binary_format::magic.size() + 4 + 4 + 8;
+constexpr std::size_t game_count_offset = binary_format::magic.size() + 4 + 4;
+
+template<typename T>
+void
+write_le(std::ostream& os, T const value)
+{
+    T const le = to_little_endian(value);
+    os.write(reinterpret_cast<char const*>(&le), sizeof(le));
+}
+
+template<typename T>
+T
+read_le(char const*& ptr, char const* const end)
+{
+    if (static_cast<std::size_t>(end - ptr) < sizeof(T))
+    {
+        throw std::runtime_error("Truncated binary game file");
+    }
+    T value;
+    std::memcpy(&value, ptr, sizeof(value));
+    ptr += sizeof(value);
+    return to_little_endian(value);
+}
+
+} // anonymous namespace
+
+bool
+binary_format::is_binary_file(std::filesystem::path const& file_path)
+{
+    // A pipe can only be read once, its first bytes are left to the parser
+    std::error_code error;
+    if (!std::filesystem::is_regular_file(file_path, error))
+    {
+        return false;
+    }
+    std::ifstream ifs(file_path, std::ios::binary);
+    char head[magic.size()] = {};
+    ifs.read(head, sizeof(head));
+    return ifs && (std::string_view(head, sizeof(head)) == magic);
+}
+
+binary_writer::binary_writer(std::filesystem::path const& file_path)
+{
+    output_.exceptions(std::ios::badbit | std::ios::failbit);
+    output_.open(file_path, std::ios::binary | std::ios::trunc);
+    output_.write(binary_format::magic.data(), binary_format::magic.size());
+    write_le(output_, binary_format::version);
+    write_le(output_, std::uint32_t{0});
+    write_le(output_, std::uint64_t{0}); // Game count, patched by close()
+}
+
+binary_writer::~binary_writer()
+{
+    try
+    {
+        close();
+    }
+    catch (...)
+    {
+    }
+}
+
+void
+binary_writer::write_game(std::string_view const tags, std::span<chess::packed_move const> const moves)
+{
+    write_le(output_, static_cast<std::uint32_t>(tags.size()));
+    write_le(output_, static_cast<std::uint32_t>(moves.size()));
+    output_.write(tags.data(), static_cast<std::streamsize>(tags.size()));
+    if (tags.size() % 2)
+    {
+        output_.put('\0');
+    }
+    if constexpr (std::endian::native == std::endian::little)
+    {
+        output_.write(reinterpret_cast<char const*>(moves.data()),
+                      static_cast<std::streamsize>(moves.size_bytes()));
+    }
+    else
+    {
+        for (auto const move: moves)
+        {
+            write_le(output_, move.bits());
+        }
+    }
+    ++game_count_;
+}
+
+void
+binary_writer::close()
+{
+    if (!output_.is_open())
+    {
+        return;
+    }
+    output_.seekp(game_count_offset);
+    write_le(output_, game_count_);
+    output_.close();
+}
+
+binary_reader::binary_reader(std::filesystem::path const& file_path):
+    file_(file_path),
+    cursor_(file_.begin())
+{
+    if ((file_.size() < header_size)
+        || (std::string_view(file_.data(), binary_format::magic.size()) != binary_format::magic))
+    {
+        throw std::runtime_error("Not a binary game file: " + file_path.string());
+    }
+    cursor_ += binary_format::magic.size();
+    if (read_le<std::uint32_t>(cursor_, file_.end()) != binary_format::version)
+    {
+        throw std::runtime_error("Unsupported binary game file version: " + file_path.string());
+    }
+    read_le<std::uint32_t>(cursor_, file_.end());
+    game_count_ = read_le<std::uint64_t>(cursor_, file_.end());
+}
+
+bool
+binary_reader::next_game(std::string_view& tags, std::vector<chess::packed_move>& moves)
+{
+    char const* const end = file_.end();
+    if (cursor_ == end)
+    {
+        return false;
+    }
+    auto const tag_bytes = read_le<std::uint32_t>(cursor_, end);
+    auto const move_count = read_le<std::uint32_t>(cursor_, end);
+    std::size_t const padded_tag_bytes = tag_bytes + (tag_bytes % 2);
+    std::size_t const move_bytes = std::size_t{move_count} * sizeof(chess::packed_move);
+    if (static_cast<std::size_t>(end - cursor_) < padded_tag_bytes + move_bytes)
+    {
+        throw std::runtime_error("Truncated binary game file");
+    }
+    tags = std::string_view(cursor_, tag_bytes);
+    cursor_ += padded_tag_bytes;
+    moves.resize(move_count);
+    std::memcpy(moves.data(), cursor_, move_bytes);
+    if constexpr (std::endian::native == std::endian::big)
+    {
+        for (auto& move: moves)
+        {
+            move = chess::packed_move(std::byteswap(move.bits()));
+        }
+    }
+    cursor_ += move_bytes;
+    MLP_CHESS_COUNT(bytes_read, 8 + padded_tag_bytes + move_bytes);
+    MLP_CHESS_COUNT(games, 1);
+    MLP_CHESS_COUNT(plies, move_count);
+    return true;
+}
+
+} // namespace mlp::chess
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <mlp/chess/mapped_file.hpp>
+#include <mlp/chess/packed_move.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace mlp::chess
+{
+
+// Binary game database. Games are stored with their moves already resolved, so loading them back
+// needs no SAN parsing or source square search. All integers are little endian.
+//
+//   header:    "MLPCHESS" | u32 version | u32 reserved | u64 game count
+//   per game:  u32 tag bytes | u32 move count | tags (padded to an even length) | u16 moves[]
+//
+// The tag block holds the game's tag pair lines exactly as they appeared in the PGN file.
+namespace binary_format
+{
+constexpr std::string_view magic = "MLPCHESS";
+constexpr std::uint32_t version = 1;
+
+// True if the file is a regular file starting with the binary game database magic. Anything else (e.g.
+// a pipe) is left unread
+bool is_binary_file(std::filesystem::path const& file_path);
+}
+
+class binary_writer
+{
+public:
+    explicit binary_writer(std::filesystem::path const& file_path);
+    ~binary_writer();
+
+    void write_game(std::string_view tags, std::span<chess::packed_move const> moves);
+    // Writes the final game count and flushes. Called by the destructor if not called explicitly
+    void close();
+
+    std::uint64_t game_count() const noexcept { return game_count_; }
+
+private:
+    std::ofstream output_;
+    std::uint64_t game_count_ = 0;
+};
+
+class binary_reader
+{
+public:
+    explicit binary_reader(std::filesystem::path const& file_path);
+
+    std::uint64_t game_count() const noexcept { return game_count_; }
+
+    // Reads the next game. `tags` points into the mapped file and stays valid while the reader lives
+    bool next_game(std::string_view& tags, std::vector<chess::packed_move>& moves);
+
+private:
+    chess::mapped_file file_;
+    char const* cursor_ = nullptr;
+    std::uint64_t game_count_ = 0;
+};
+
+} // namespace mlp::chess
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <mlp/chess/piece.hpp>
+#include <mlp/chess/square.hpp>
+
+#include <array>
+#include <bit>
+#include <cstdint>
+
+namespace mlp::chess
+{
+
+// One bit per square, a1 = bit 0, b1 = bit 1, ... h8 = bit 63
+using bitboard = std::uint64_t;
+
+constexpr int
+square_index(char const file, char const rank) noexcept
+{
+    return ((rank - '1') * 8) + (file - 'a');
+}
+
+inline int
+square_index(chess::square const& sq) noexcept
+{
+    return square_index(sq.file, sq.rank);
+}
+
+inline chess::square
+index_square(int const index) noexcept
+{
+    return chess::square(static_cast<char>('a' + (index & 7)), static_cast<char>('1' + (index >> 3)));
+}
+
+constexpr bitboard
+square_bit(int const index) noexcept
+{
+    return bitboard{1} << index;
+}
+
+constexpr bitboard
+file_mask(char const file) noexcept
+{
+    return bitboard{0x0101010101010101} << (file - 'a');
+}
+
+constexpr bitboard
+rank_mask(char const rank) noexcept
+{
+    return bitboard{0xff} << (8 * (rank - '1'));
+}
+
+// Removes the lowest set bit and returns its index. The bitboard must not be empty
+inline int
+pop_lsb(bitboard& bits) noexcept
+{
+    int const index = std::countr_zero(bits);
+    bits &= bits - 1;
+    return index;
+}
+
+constexpr int
+colour_index(piece_colour const colour) noexcept
+{
+    return (colour == piece_colour::White) ? 0 : 1;
+}
+
+namespace detail
+{
+constexpr auto type_indices = []
+{
+    std::array<signed char, 128> indices{};
+    indices.fill(-1);
+    indices['P'] = 0;
+    indices['N'] = 1;
+    indices['B'] = 2;
+    indices['R'] = 3;
+    indices['Q'] = 4;
+    indices['K'] = 5;
+    return indices;
+}();
+}
+
+// Dense index of a piece type, in the order Pawn, Knight, Bishop, Rook, Queen, King. -1 for None
+constexpr int
+type_index(piece_type const type) noexcept
+{
+    return detail::type_indices[static_cast<unsigned char>(type) & 0x7f];
+}
+
+} // namespace mlp::chess
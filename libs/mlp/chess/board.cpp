@@ -1,7 +1,14 @@
 #include <mlp/chess/board.hpp>
+#include <mlp/chess/attacks.hpp>
+#include <mlp/chess/stats.hpp>
 
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
 #include <ostream>
 #include <iostream>
+#include <stdexcept>
+#include <string>
 
 namespace mlp::chess
 {
@@ -19,105 +26,349 @@ static constinit board::rank_array const starting_board_state
           /*  a    b    c    d    e    f    g    h  */
 }};
 
-board::board() noexcept: ranks_(starting_board_state)
+static constinit std::ostream* diagnostics = &std::cout;
+
+board::board() noexcept: ranks_{}
 {
+    for (int index = 0; index < 64; ++index)
+    {
+        auto const piece = starting_board_state[index / 8][index % 8];
+        if (!piece.is_null())
+        {
+            put(piece, index);
+        }
+    }
+    hash_ ^= zobrist.castling[castling_rights_];
+    history_.reserve(256);
+    history_.push_back(hash_);
 }
 
-bool
-board::identify_moving_piece(piece_colour colour, piece_type type,
-                             chess::square& src, chess::square const& dest,
-                             bool is_capture)
+void
+board::reset() noexcept
+{
+    static board const initial;
+    pieces_ = initial.pieces_;
+    occupancy_ = initial.occupancy_;
+    ranks_ = initial.ranks_;
+    hash_ = initial.hash_;
+    side_to_move_ = initial.side_to_move_;
+    castling_rights_ = initial.castling_rights_;
+    en_passant_file_ = initial.en_passant_file_;
+    halfmove_clock_ = initial.halfmove_clock_;
+    fullmove_number_ = initial.fullmove_number_;
+    history_.clear();
+    history_.push_back(hash_);
+}
+
+board::board(std::string_view const fen): ranks_{}
 {
-    bool found = false;
-    char found_rank = 0;
-    char found_file = 0;
-    // Iterate over the board to find a piece of the specified colour and type
-    for (char rank = '1'; rank <= '8'; ++rank)
+    auto const invalid = [&](char const* const reason)
     {
-        if ((src.rank != 0) && (rank != src.rank))
+        return std::runtime_error("Invalid FEN \"" + std::string(fen) + "\": " + reason);
+    };
+    std::array<std::string_view, 4> fields;
+    std::size_t pos = 0;
+    for (auto& field: fields)
+    {
+        pos = fen.find_first_not_of(' ', pos);
+        if (pos == std::string_view::npos)
         {
-            continue;
+            throw invalid("expected placement, side to move, castling and en passant fields");
+        }
+        std::size_t const end = std::min(fen.find(' ', pos), fen.size());
+        field = fen.substr(pos, end - pos);
+        pos = end;
+    }
+    // The halfmove clock and fullmove number are optional, as in EPD
+    for (auto* const counter: {&halfmove_clock_, &fullmove_number_})
+    {
+        pos = fen.find_first_not_of(' ', pos);
+        if (pos == std::string_view::npos)
+        {
+            break;
+        }
+        auto const result = std::from_chars(fen.data() + pos, fen.data() + fen.size(), *counter);
+        if ((result.ec != std::errc{}) || ((result.ptr != fen.data() + fen.size()) && (*result.ptr != ' ')))
+        {
+            throw invalid("bad move counter");
         }
-        for (char file = 'a'; file <= 'h'; ++file)
+        pos = static_cast<std::size_t>(result.ptr - fen.data());
+    }
+
+    int rank = 7;
+    int file = 0;
+    for (char const c: fields[0])
+    {
+        if (c == '/')
         {
-            if ((src.file != 0) && (file != src.file))
+            if ((file != 8) || (rank == 0))
             {
-                continue;
+                throw invalid("bad rank in placement");
             }
-            const auto& piece = ranks_[rank - '1'][file - 'a'];
-            if ((piece.colour() != colour) || (piece.type() != type))
+            --rank;
+            file = 0;
+        }
+        else if ((c >= '1') && (c <= '8'))
+        {
+            file += c - '0';
+        }
+        else
+        {
+            bool const white = (c >= 'A') && (c <= 'Z');
+            auto const type = static_cast<piece_type>(white ? c : (c - 'a' + 'A'));
+            if ((type_index(type) < 0) || (file > 7))
             {
-                continue;
+                throw invalid("bad piece in placement");
             }
-            // Check if the piece can move to the destination
-            if (is_valid_move(type, square{file, rank}, dest, is_capture))
+            put(piece{white ? piece_colour::White : piece_colour::Black, type}, (rank * 8) + file);
+            ++file;
+        }
+        if (file > 8)
+        {
+            throw invalid("bad rank in placement");
+        }
+    }
+    if ((rank != 0) || (file != 8))
+    {
+        throw invalid("placement doesn't cover 8 ranks");
+    }
+
+    if ((fields[1] != "w") && (fields[1] != "b"))
+    {
+        throw invalid("side to move must be w or b");
+    }
+    side_to_move_ = (fields[1] == "w") ? piece_colour::White : piece_colour::Black;
+
+    castling_rights_ = 0;
+    if (fields[2] != "-")
+    {
+        for (char const c: fields[2])
+        {
+            switch (c)
             {
-                if (found)
-                {
-                    std::cout << "Error: Found two possible chess pieces that can make move: "
-                              << static_cast<char>(colour) << static_cast<char>(type) << " at ";
-                    std::cout.put(found_file);
-                    std::cout.put(found_rank);
-                    std::cout << " and ";
-                    std::cout.put(file);
-                    std::cout.put(rank);
-                    std::cout << " can both move to " << dest << ". My implementation is probably b0rked" << std::endl;
-                }
-                found_rank = rank;
-                found_file = file;
-                found = true;
+                case 'K': castling_rights_ |= white_kingside; break;
+                case 'Q': castling_rights_ |= white_queenside; break;
+                case 'k': castling_rights_ |= black_kingside; break;
+                case 'q': castling_rights_ |= black_queenside; break;
+                default: throw invalid("bad castling rights");
             }
         }
     }
-    if (found)
+
+    if (fields[3] != "-")
+    {
+        if ((fields[3].size() != 2) || (fields[3][0] < 'a') || (fields[3][0] > 'h')
+            || (fields[3][1] != ((side_to_move_ == piece_colour::White) ? '6' : '3')))
+        {
+            throw invalid("bad en passant square");
+        }
+        // Recorded, as after a move, only when a capture en passant is possible
+        int const passed = square_index(fields[3][0], fields[3][1]);
+        piece_colour const pusher = (side_to_move_ == piece_colour::White) ? piece_colour::Black : piece_colour::White;
+        if (pawn_attacks[colour_index(pusher)][passed] & squares_of(side_to_move_, piece_type::Pawn))
+        {
+            en_passant_file_ = static_cast<std::uint8_t>((passed & 7) + 1);
+            hash_ ^= zobrist.en_passant_file[passed & 7];
+        }
+    }
+
+    hash_ ^= zobrist.castling[castling_rights_];
+    if (side_to_move_ == piece_colour::Black)
+    {
+        hash_ ^= zobrist.black_to_move;
+    }
+    history_.reserve(256);
+    history_.push_back(hash_);
+}
+
+// Castling rights that survive a move from or to each square, i.e. all but those of a king or rook home square
+static constexpr auto castling_rights_kept = []
+{
+    std::array<std::uint8_t, 64> kept{};
+    kept.fill(board::white_kingside | board::white_queenside | board::black_kingside | board::black_queenside);
+    kept[square_index('a', '1')] &= ~board::white_queenside;
+    kept[square_index('e', '1')] &= ~(board::white_kingside | board::white_queenside);
+    kept[square_index('h', '1')] &= ~board::white_kingside;
+    kept[square_index('a', '8')] &= ~board::black_queenside;
+    kept[square_index('e', '8')] &= ~(board::black_kingside | board::black_queenside);
+    kept[square_index('h', '8')] &= ~board::black_kingside;
+    return kept;
+}();
+
+void
+board::put(chess::piece const piece, int const index) noexcept
+{
+    bitboard const bit = square_bit(index);
+    pieces_[colour_index(piece.colour())][type_index(piece.type())] |= bit;
+    occupancy_[colour_index(piece.colour())] |= bit;
+    hash_ ^= zobrist.pieces[colour_index(piece.colour())][type_index(piece.type())][index];
+    ranks_[index / 8][index % 8] = piece;
+}
+
+void
+board::remove(int const index) noexcept
+{
+    auto& slot = ranks_[index / 8][index % 8];
+    if (slot.is_null())
     {
-        src.rank = found_rank;
-        src.file = found_file;
+        return;
+    }
+    bitboard const bit = square_bit(index);
+    pieces_[colour_index(slot.colour())][type_index(slot.type())] &= ~bit;
+    occupancy_[colour_index(slot.colour())] &= ~bit;
+    hash_ ^= zobrist.pieces[colour_index(slot.colour())][type_index(slot.type())][index];
+    slot = chess::piece{};
+}
+
+void
+board::relocate(int const src, int const dest) noexcept
+{
+    remove(dest);
+    auto& from = ranks_[src / 8][src % 8];
+    if (from.is_null())
+    {
+        return;
+    }
+    // A single xor moves the piece's bit in both its own bitboard and its side's occupancy
+    bitboard const bits = square_bit(src) | square_bit(dest);
+    auto const colour = colour_index(from.colour());
+    auto const type = type_index(from.type());
+    pieces_[colour][type] ^= bits;
+    occupancy_[colour] ^= bits;
+    hash_ ^= zobrist.pieces[colour][type][src] ^ zobrist.pieces[colour][type][dest];
+    ranks_[dest / 8][dest % 8] = from;
+    from = chess::piece{};
+}
+
+bitboard
+board::candidate_sources(piece_colour const colour, piece_type const type, int const dest,
+                         bool const is_capture) const noexcept
+{
+    bitboard const occupied = occupancy();
+    switch (type)
+    {
+        case piece_type::Bishop: return bishop_attacks(dest, occupied);
+        case piece_type::King: return king_attacks[dest];
+        case piece_type::Knight: return knight_attacks[dest];
+        case piece_type::Queen: return queen_attacks(dest, occupied);
+        case piece_type::Rook: return rook_attacks(dest, occupied);
+        case piece_type::Pawn:
+        {
+            bool const white = (colour == piece_colour::White);
+            if (is_capture)
+            {
+                // A pawn captures onto dest from where an enemy pawn on dest would attack
+                return pawn_attacks[white ? 1 : 0][dest];
+            }
+            bitboard const dest_bit = square_bit(dest);
+            bitboard const single = white ? (dest_bit >> 8) : (dest_bit << 8);
+            int const double_push_rank = white ? 3 : 4;
+            if ((single & occupied) || ((dest >> 3) != double_push_rank))
+            {
+                return single;
+            }
+            return single | (white ? (single >> 8) : (single << 8));
+        }
+        case piece_type::None:
+        default:
+            return 0;
     }
-    return found;
 }
 
 bool
-board::empty_at(chess::square const& square) const noexcept
+board::is_pinned(piece_colour const colour, int const src, int const dest) const noexcept
 {
-    auto& piece = ranks_[square.rank - '1'][square.file - 'a'];
-    return piece.is_null();
+    bitboard const king = squares_of(colour, piece_type::King);
+    if (!king)
+    {
+        return false;
+    }
+    int const king_index = std::countr_zero(king);
+    // Only enemy sliders on a line through the king and src can pin, and not if they are being captured
+    piece_colour const enemy = (colour == piece_colour::White) ? piece_colour::Black : piece_colour::White;
+    bitboard const occupied = (occupancy() & ~square_bit(src)) | square_bit(dest);
+    bitboard const queens = squares_of(enemy, piece_type::Queen);
+    bitboard const diagonal = (squares_of(enemy, piece_type::Bishop) | queens) & ~square_bit(dest);
+    bitboard const straight = (squares_of(enemy, piece_type::Rook) | queens) & ~square_bit(dest);
+    return (bishop_attacks(king_index, occupied) & diagonal) || (rook_attacks(king_index, occupied) & straight);
+}
+
+void
+board::set_diagnostics(std::ostream& os) noexcept
+{
+    diagnostics = &os;
 }
 
 bool
-board::straight_path_is_clear_between(chess::square const& src,
-                                      chess::square const& dest) const
+board::identify_moving_piece(piece_colour colour, piece_type type,
+                             chess::square& src, chess::square const& dest,
+                             bool is_capture)
 {
-    if (src == dest) [[unlikely]]
+    MLP_CHESS_TIME(identify_piece);
+    if (type_index(type) < 0)
     {
-        return true;
+        return false;
     }
-    int const rank_diff = dest.rank - src.rank;
-    int const file_diff = dest.file - src.file;
-    bool const is_straight_move = ((rank_diff == 0) || (file_diff == 0));
-    if (!is_straight_move) [[unlikely]]
+    // The pieces of the specified colour and type which reach dest, found by looking up what
+    // attacks dest from dest itself
+    int const dest_index = square_index(dest);
+    bitboard candidates = squares_of(colour, type) & candidate_sources(colour, type, dest_index, is_capture);
+    if (src.rank != 0)
     {
-        throw std::runtime_error ("Straight path clearance check called on non-straight move");
+        candidates &= rank_mask(src.rank);
+    }
+    if (src.file != 0)
+    {
+        candidates &= file_mask(src.file);
+    }
+    if (!candidates)
+    {
+        return false;
     }
-    int const rank_dir = (rank_diff > 0) - (rank_diff < 0);
-    int const file_dir = (file_diff > 0) - (file_diff < 0);
-    auto step = src;
-    while (true)
+    int found_index = pop_lsb(candidates);
+    // SAN only disambiguates between legal moves, so a second candidate means the others are pinned
+    while (candidates)
     {
-        step.rank += rank_dir;
-        step.file += file_dir;
-        if (step == dest)
+        int const index = pop_lsb(candidates);
+        if (is_pinned(colour, index, dest_index))
         {
-            break;
+            continue;
         }
-        if (!empty_at(step))
+        if (!is_pinned(colour, found_index, dest_index))
         {
-            return false;
+            MLP_CHESS_COUNT(ambiguities, 1);
+            *diagnostics << "Error: Found two possible chess pieces that can make move: "
+                         << static_cast<char>(colour) << static_cast<char>(type) << " at "
+                         << index_square(found_index) << " and " << index_square(index)
+                         << " can both move to " << dest << ". My implementation is probably b0rked" << std::endl;
         }
+        found_index = index;
     }
+    src = index_square(found_index);
     return true;
 }
 
+bool
+board::empty_at(chess::square const& square) const noexcept
+{
+    return !(occupancy() & square_bit(square_index(square)));
+}
+
+bool
+board::straight_path_is_clear_between(chess::square const& src,
+                                      chess::square const& dest) const
+{
+    if (src == dest) [[unlikely]]
+    {
+        return true;
+    }
+    if ((src.rank != dest.rank) && (src.file != dest.file)) [[unlikely]]
+    {
+        throw std::runtime_error ("Straight path clearance check called on non-straight move");
+    }
+    return !(squares_between(square_index(src), square_index(dest)) & occupancy());
+}
+
 bool
 board::diagonal_path_is_clear_between(chess::square const& src,
                                       chess::square const& dest) const
@@ -126,201 +377,205 @@ board::diagonal_path_is_clear_between(chess::square const& src,
     {
         return true;
     }
-    int const rank_diff = dest.rank - src.rank;
-    int const file_diff = dest.file - src.file;
-    bool const is_diagonal_move = (abs(rank_diff) == abs(file_diff));
-    if (!is_diagonal_move) [[unlikely]]
+    if (abs(dest.rank - src.rank) != abs(dest.file - src.file)) [[unlikely]]
     {
         throw std::runtime_error ("Diagonal path clearance check called on non-diagonal move");
     }
-    int const rank_dir = (rank_diff > 0) - (rank_diff < 0);
-    int const file_dir = (file_diff > 0) - (file_diff < 0);
-    auto step = src;
-    while (true)
+    return !(squares_between(square_index(src), square_index(dest)) & occupancy());
+}
+
+void board::perform_queenside_castling(piece_colour const side)
+{
+    MLP_CHESS_TIME(board_move);
+    if (side == piece_colour::None)
     {
-        step.rank += rank_dir;
-        step.file += file_dir;
-        if (step == dest)
-        {
-            break;
-        }
-        if (!empty_at(step))
-        {
-            return false;
-        }
+        return;
     }
-    return true;
+    char const rank = (side == piece_colour::White) ? '1' : '8';
+    relocate(square_index('e', rank), square_index('c', rank)); // King
+    relocate(square_index('a', rank), square_index('d', rank)); // Rook
+    unsigned const rights = (side == piece_colour::White) ? (black_kingside | black_queenside)
+                                                          : (white_kingside | white_queenside);
+    end_move(side, castling_rights_ & rights, 0, false);
 }
 
-bool
-board::is_valid_move(piece_type const type, square const& from, square const& to,
-                     bool const is_capture)
+void board::perform_kingside_castling(piece_colour const side)
 {
-    int const rank_diff = abs(to.rank - from.rank);
-    int const file_diff = abs(to.file - from.file);
-    bool const is_diagonal_move = (rank_diff == file_diff);
-    bool const is_straight_move = ((rank_diff == 0) || (file_diff == 0));
-    switch (type)
+    MLP_CHESS_TIME(board_move);
+    if (side == piece_colour::None)
     {
-        case piece_type::Bishop:
-        {
-            // Bishops move diagonally
-            return is_diagonal_move && diagonal_path_is_clear_between(from, to);
-        }
-        case piece_type::King:
-        {
-            // There's only ever one King so there's never any ambiguity, we can safely assume the move
-            // is always valid.
-            return true;
-        }
-        case piece_type::Knight:
-        {
-            // A valid Knight move is either two squares in one direction and one square in the other
-            // TODO: Not checking if the square jumped is empty right now. Chance of ambiguity seems low
-            if (((rank_diff == 2) && (file_diff == 1)) || ((rank_diff == 1) && (file_diff == 2)))
-            {
-                return true;
-            }
-        }
-        case piece_type::Pawn:
-        {
-            return is_valid_pawn_move(from, to, is_capture);
-        }
-        case piece_type::Queen:
-        {
-            // Queens move either straight along a rank or file, or diagonally
-            return ((is_straight_move && straight_path_is_clear_between(from, to))
-                    || (is_diagonal_move && diagonal_path_is_clear_between(from, to)));
-        }
-        case piece_type::Rook:
-        {
-            // Rooks move either vertically or horizontally
-            return (is_straight_move && straight_path_is_clear_between(from, to));
-        }
-        case piece_type::None:
-        default:
-        {
-            break;
-        }
+        return;
     }
-    return false;
+    char const rank = (side == piece_colour::White) ? '1' : '8';
+    relocate(square_index('e', rank), square_index('g', rank)); // King
+    relocate(square_index('h', rank), square_index('f', rank)); // Rook
+    unsigned const rights = (side == piece_colour::White) ? (black_kingside | black_queenside)
+                                                          : (white_kingside | white_queenside);
+    end_move(side, castling_rights_ & rights, 0, false);
 }
 
-bool
-board::is_valid_pawn_move(square const& from, square const& to, bool const is_capture)
+void
+board::move(chess::square const& src, chess::square const& dest, bool const is_capture,
+            piece_type const promotion)
 {
-    // Calculate the direction of movement based on the pawns colour.
-    // This works because Pawns can only move forwards.
-    int const direction = ranks_[from.rank - '1'][from.file - 'a'].colour() == piece_colour::White ? 1 : -1;
-    if (is_capture)
+    MLP_CHESS_TIME(board_move);
+    int const from = square_index(src);
+    int const to = square_index(dest);
+    if (!empty_at(dest) && !is_capture)
     {
-        // Capture move must be diagonal and advance one rank in the correct direction
-        if (abs(from.file - to.file) == 1 && (to.rank - from.rank) == direction)
-        {
-            return true; // Assuming diagonal move is valid if it's a capture.
-        }
+        throw std::runtime_error("Move to occupied square, but no capture was declared");
+    }
+    auto const from_piece = ranks_[src.rank - '1'][src.file - 'a'];
+    bool const irreversible = (from_piece.type() == piece_type::Pawn) || !empty_at(dest);
+    if ((from_piece.type() == piece_type::Pawn) && (src.file != dest.file) && empty_at(dest))
+    {
+        // En passant, the captured pawn is beside the source square
+        remove((from & ~7) | (to & 7));
+    }
+    if ((promotion == piece_type::None) || from_piece.is_null())
+    {
+        relocate(from, to);
     }
     else
     {
-        // Non-capture move, must move in file
-        if (from.file == to.file)
+        remove(from);
+        remove(to);
+        put(chess::piece{from_piece.colour(), promotion}, to);
+    }
+    // Like most hashing schemes, a double pawn push only records its file when a capture en passant is possible
+    int en_passant_file = 0;
+    if ((from_piece.type() == piece_type::Pawn) && (std::abs(to - from) == 16))
+    {
+        int const passed = (from + to) / 2;
+        piece_colour const enemy = (from_piece.colour() == piece_colour::White) ? piece_colour::Black
+                                                                                : piece_colour::White;
+        if (pawn_attacks[colour_index(from_piece.colour())][passed] & squares_of(enemy, piece_type::Pawn))
         {
-            if (to.rank - from.rank == direction)
-            {
-                // Single square forward
-                return true;
-            }
-            else if ((((from.rank == '2') && (direction == 1)) || ((from.rank == '7') && (direction == -1)))
-                    && ((to.rank - from.rank) == (2 * direction)))
-            {
-                // Double square forward on first move
-                return true;
-            }
+            en_passant_file = (from & 7) + 1;
         }
     }
-    return false;
+    end_move(from_piece.colour(), castling_rights_ & castling_rights_kept[from] & castling_rights_kept[to],
+             en_passant_file, irreversible);
 }
 
-void board::perform_queenside_castling(piece_colour const side)
+void
+board::end_move(piece_colour const mover, unsigned const castling_rights, int const en_passant_file,
+                bool const irreversible) noexcept
+{
+    halfmove_clock_ = irreversible ? 0 : static_cast<std::uint16_t>(halfmove_clock_ + 1);
+    if (mover == piece_colour::Black)
+    {
+        ++fullmove_number_;
+    }
+    if (en_passant_file_)
+    {
+        hash_ ^= zobrist.en_passant_file[en_passant_file_ - 1];
+    }
+    if (en_passant_file)
+    {
+        hash_ ^= zobrist.en_passant_file[en_passant_file - 1];
+    }
+    en_passant_file_ = static_cast<std::uint8_t>(en_passant_file);
+    hash_ ^= zobrist.castling[castling_rights_] ^ zobrist.castling[castling_rights];
+    castling_rights_ = static_cast<std::uint8_t>(castling_rights);
+    auto const next = (mover == piece_colour::White) ? piece_colour::Black : piece_colour::White;
+    if (next != side_to_move_)
+    {
+        hash_ ^= zobrist.black_to_move;
+        side_to_move_ = next;
+    }
+    history_.push_back(hash_);
+}
+
+void
+board::move(chess::packed_move const packed)
 {
-    switch (side)
+    if (packed.is_castling())
     {
-        case piece_colour::Black:
+        auto const side = (packed.src().rank == '1') ? piece_colour::White : piece_colour::Black;
+        if (packed.is_kingside_castling())
         {
-            auto& e8 = ranks_[7]['e' - 'a']; // King
-            auto& a8 = ranks_[7]['a' - 'a']; // Rook
-            auto& c8 = ranks_[7]['c' - 'a'];
-            auto& d8 = ranks_[7]['d' - 'a'];
-            c8 = e8;
-            e8 = piece{};
-            d8 = a8;
-            a8 = piece{};
-            break;
+            perform_kingside_castling(side);
         }
-        case piece_colour::White:
+        else
         {
-            auto& e1 = ranks_[0]['e' - 'a']; // King
-            auto& a1 = ranks_[0]['a' - 'a']; // Rook
-            auto& c1 = ranks_[0]['c' - 'a'];
-            auto& d1 = ranks_[0]['d' - 'a'];
-            c1 = e1;
-            e1 = piece{};
-            d1 = a1;
-            a1 = piece{};
-            break;
+            perform_queenside_castling(side);
         }
-        case piece_colour::None:
-             return;
+        return;
     }
+    auto const dest = packed.dest();
+    move(packed.src(), dest, !empty_at(dest), packed.promotion());
 }
 
-void board::perform_kingside_castling(piece_colour const side)
+board::undo_record
+board::make(chess::packed_move const packed)
 {
-    switch (side)
+    undo_record undo;
+    undo.move = packed;
+    undo.castling_rights = castling_rights_;
+    undo.en_passant_file = en_passant_file_;
+    undo.halfmove_clock = halfmove_clock_;
+    undo.hash = hash_;
+    if (!packed.is_castling())
     {
-        case piece_colour::Black:
+        int const from = packed.src_index();
+        int const to = packed.dest_index();
+        undo.captured = ranks_[to / 8][to % 8];
+        if (undo.captured.is_null() && (ranks_[from / 8][from % 8].type() == piece_type::Pawn)
+            && ((from & 7) != (to & 7)))
         {
-            auto& e8 = ranks_[7]['e' - 'a']; // King
-            auto& h8 = ranks_[7]['h' - 'a']; // Rook
-            auto& g8 = ranks_[7]['g' - 'a'];
-            auto& f8 = ranks_[7]['f' - 'a'];
-            g8 = e8;
-            e8 = piece{};
-            f8 = h8;
-            h8 = piece{};
-            break;
+            undo.captured = ranks_[from / 8][to % 8]; // En passant
         }
-        case piece_colour::White:
-        {
-            auto& e1 = ranks_[0]['e' - 'a']; // King
-            auto& h1 = ranks_[0]['h' - 'a']; // Rook
-            auto& g1 = ranks_[0]['g' - 'a'];
-            auto& f1 = ranks_[0]['f' - 'a'];
-            g1 = e1;
-            e1 = piece{};
-            f1 = h1;
-            h1 = piece{};
-            break;
-        }
-        case piece_colour::None:
-            return;
     }
+    move(packed);
+    return undo;
 }
 
 void
-board::move(chess::square const& src, chess::square const& dest, bool const is_capture)
+board::unmake(undo_record const& undo) noexcept
 {
-    auto& from_piece = ranks_[src.rank - '1'][src.file - 'a'];
-    auto& to_piece = ranks_[dest.rank - '1'][dest.file - 'a'];
-    if (to_piece.is_null())
+    auto const packed = undo.move;
+    auto const mover = (side_to_move_ == piece_colour::White) ? piece_colour::Black : piece_colour::White;
+    int const from = packed.src_index();
+    int const to = packed.dest_index();
+    if (packed.is_castling())
     {
+        int const rank_start = from & ~7;
+        bool const kingside = packed.is_kingside_castling();
+        relocate(to, from); // King
+        relocate(rank_start + (kingside ? 5 : 3), rank_start + (kingside ? 7 : 0)); // Rook
     }
-    else if (!is_capture)
+    else
     {
-        throw std::runtime_error("Move to occupied square, but no capture was declared");
+        if (packed.move_kind() == chess::packed_move::kind::promotion)
+        {
+            remove(to);
+            put(chess::piece{mover, piece_type::Pawn}, from);
+        }
+        else
+        {
+            relocate(to, from);
+        }
+        if (!undo.captured.is_null())
+        {
+            // A pawn moving diagonally to an empty square captured the pawn beside it, en passant
+            bool const en_passant = (ranks_[from / 8][from % 8].type() == piece_type::Pawn)
+                                  && (undo.captured.type() == piece_type::Pawn) && undo.en_passant_file
+                                  && ((to & 7) == undo.en_passant_file - 1)
+                                  && ((to / 8) == ((mover == piece_colour::White) ? 5 : 2));
+            put(undo.captured, en_passant ? ((from & ~7) | (to & 7)) : to);
+        }
+    }
+    side_to_move_ = mover;
+    castling_rights_ = undo.castling_rights;
+    en_passant_file_ = undo.en_passant_file;
+    halfmove_clock_ = undo.halfmove_clock;
+    if (mover == piece_colour::Black)
+    {
+        --fullmove_number_;
     }
-    to_piece = from_piece;
-    from_piece = chess::piece{};
+    hash_ = undo.hash;
+    history_.pop_back();
 }
 
 std::ostream&
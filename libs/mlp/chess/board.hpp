@@ -1,10 +1,17 @@
 #pragma once
 
+#include <mlp/chess/bitboard.hpp>
+#include <mlp/chess/packed_move.hpp>
 #include <mlp/chess/piece.hpp>
 #include <mlp/chess/square.hpp>
+#include <mlp/chess/zobrist.hpp>
 
 #include <array>
+#include <cstdint>
 #include <iosfwd>
+#include <span>
+#include <string_view>
+#include <vector>
 
 namespace mlp::chess
 {
@@ -15,9 +22,59 @@ public:
     using rank_type = std::array<piece, 8>;
     using rank_array = std::array<rank_type, 8>;
 
+    enum castling_right: std::uint8_t
+    {
+        white_kingside = 1,
+        white_queenside = 2,
+        black_kingside = 4,
+        black_queenside = 8,
+    };
+
+    // What unmake() needs to take a move back: everything the move destroys or can't be derived from it
+    struct undo_record
+    {
+        chess::packed_move move;
+        chess::piece captured;
+        std::uint8_t castling_rights = 0;
+        std::uint8_t en_passant_file = 0;
+        std::uint16_t halfmove_clock = 0;
+        zobrist_hash hash = 0;
+    };
+
     board() noexcept;
+    // Sets up the position of a FEN record. Throws std::runtime_error if it is malformed
+    explicit board(std::string_view fen);
+    // Sets up the initial position again. Unlike assigning a new board, keeps the hash history's storage
+    void reset() noexcept;
     rank_array const& ranks() const noexcept { return ranks_; }
 
+    // The squares holding the given kind of piece
+    bitboard squares_of(piece_colour colour, piece_type type) const noexcept
+    {
+        return pieces_[colour_index(colour)][type_index(type)];
+    }
+    bitboard occupancy() const noexcept { return occupancy_[0] | occupancy_[1]; }
+    bitboard occupancy(piece_colour colour) const noexcept { return occupancy_[colour_index(colour)]; }
+    piece piece_at(chess::square const& square) const noexcept { return ranks_[square.rank - '1'][square.file - 'a']; }
+
+    piece_colour side_to_move() const noexcept { return side_to_move_; }
+    // A combination of castling_right bits
+    unsigned castling_rights() const noexcept { return castling_rights_; }
+    // The file ('a'..'h') of a pawn that just advanced two squares and can be captured en passant, or 0
+    char en_passant_file() const noexcept { return en_passant_file_ ? static_cast<char>('a' + en_passant_file_ - 1) : 0; }
+    // Plies since the last capture or pawn move, and the number of the current full move, as in FEN
+    unsigned halfmove_clock() const noexcept { return halfmove_clock_; }
+    unsigned fullmove_number() const noexcept { return fullmove_number_; }
+
+    // Zobrist hash of the current position, updated incrementally on every move
+    zobrist_hash hash() const noexcept { return hash_; }
+    // Hashes of every position reached on this board, starting with the initial one and ending with hash()
+    std::span<zobrist_hash const> hash_history() const noexcept { return history_; }
+
+    // Where identify_moving_piece() reports a move more than one piece could make: std::cout unless set.
+    // Not thread safe, set it before any board is used
+    static void set_diagnostics(std::ostream& os) noexcept;
+
     bool
     identify_moving_piece(piece_colour colour, piece_type type,
                           chess::square& src, chess::square const& dest,
@@ -27,7 +84,15 @@ public:
 
     void perform_kingside_castling(piece_colour side);
 
-    void move(chess::square const& src, chess::square const& dest, bool is_capture);
+    void move(chess::square const& src, chess::square const& dest, bool is_capture,
+              piece_type promotion = piece_type::None);
+
+    // Plays a move that has already been resolved, e.g. one loaded from a binary game file
+    void move(chess::packed_move packed);
+    // Plays a resolved move like move(), and returns what unmake() needs to restore the position
+    undo_record make(chess::packed_move packed);
+    // Takes back the last move played, given the record make() returned for it
+    void unmake(undo_record const& undo) noexcept;
 
     bool empty_at(chess::square const& square) const noexcept;
 
@@ -38,11 +103,32 @@ public:
                                         chess::square const& dest) const;
 
 private:
-    bool is_valid_move(const piece_type type, chess::square const& src, chess::square const& dest, bool is_capture);
-    bool is_valid_pawn_move(chess::square const& src, chess::square const& dest, bool is_capture);
+    // Every square a piece of the given kind could move to dest from, ignoring which pieces stand there
+    bitboard candidate_sources(piece_colour colour, piece_type type, int dest, bool is_capture) const noexcept;
+    // Whether moving the piece on src to dest would expose its own king to an enemy slider
+    bool is_pinned(piece_colour colour, int src, int dest) const noexcept;
+
+    // All board changes go through these, to keep the bitboards and the mailbox in step
+    void put(chess::piece piece, int index) noexcept;
+    void remove(int index) noexcept;
+    void relocate(int src, int dest) noexcept;
+    // Called after every move, updates the en passant, castling and side to move state and their hash keys,
+    // and the move counters. `irreversible` is set for captures and pawn moves
+    void end_move(piece_colour mover, unsigned castling_rights, int en_passant_file, bool irreversible) noexcept;
 
 private:
+    // Every piece is recorded twice: in a bitboard per colour and type, for fast set queries, and
+    // in a mailbox, for fast "what is on this square" queries.
+    std::array<std::array<bitboard, 6>, 2> pieces_{};
+    std::array<bitboard, 2> occupancy_{};
     rank_array ranks_; // Ranks are ordered from whites perspective
+    zobrist_hash hash_ = 0;
+    piece_colour side_to_move_ = piece_colour::White;
+    std::uint8_t castling_rights_ = white_kingside | white_queenside | black_kingside | black_queenside;
+    std::uint8_t en_passant_file_ = 0; // 1-based, 0 when there is no en passant capture
+    std::uint16_t halfmove_clock_ = 0;
+    std::uint16_t fullmove_number_ = 1;
+    std::vector<zobrist_hash> history_;
 };
 
 std::ostream& operator<<(std::ostream& os, board const& board);
@@ -0,0 +1,182 @@
+#include <mlp/chess/checkpoint.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace mlp::chess
+{
+
+namespace
+{
+
+constexpr char const* header = "mlp-chess-checkpoint 2";
+
+// Bytes hashed at each end of the PGN file
+constexpr std::uint64_t sample_size = 4096;
+
+template<typename T>
+bool
+parse_value(std::string_view const text, T& value) noexcept
+{
+    auto const result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return (result.ec == std::errc{}) && (result.ptr == text.data() + text.size());
+}
+
+std::int64_t
+modification_time(std::filesystem::path const& file_path)
+{
+    return static_cast<std::int64_t>(std::filesystem::last_write_time(file_path).time_since_epoch().count());
+}
+
+// FNV-1a of the first and last sample_size bytes of the first `size` bytes of the file
+std::uint64_t
+sample_hash(std::filesystem::path const& file_path, std::uint64_t const size)
+{
+    std::ifstream input(file_path, std::ios::binary);
+    std::vector<char> buffer(static_cast<std::size_t>(std::min(size, sample_size)));
+    std::uint64_t hash = 14695981039346656037ull;
+    for (std::uint64_t const offset: {std::uint64_t{0}, size - buffer.size()})
+    {
+        input.seekg(static_cast<std::streamoff>(offset));
+        if (!input.read(buffer.data(), static_cast<std::streamsize>(buffer.size())))
+        {
+            throw std::runtime_error("Could not read " + file_path.string());
+        }
+        for (char const c: buffer)
+        {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+} // anonymous namespace
+
+std::optional<ingest_checkpoint>
+ingest_checkpoint::load(std::filesystem::path const& file_path)
+{
+    std::ifstream input(file_path);
+    if (!input)
+    {
+        return std::nullopt;
+    }
+    std::string line;
+    if (!std::getline(input, line) || (line != header))
+    {
+        throw std::runtime_error("Not a checkpoint file: " + file_path.string());
+    }
+    ingest_checkpoint checkpoint;
+    while (std::getline(input, line))
+    {
+        auto const space = line.find(' ');
+        std::string_view const key = std::string_view(line).substr(0, space);
+        std::string_view const value = (space == std::string::npos) ? std::string_view()
+                                                                    : std::string_view(line).substr(space + 1);
+        bool valid = true;
+        if (key == "offset")
+        {
+            valid = parse_value(value, checkpoint.offset);
+        }
+        else if (key == "games")
+        {
+            valid = parse_value(value, checkpoint.games);
+        }
+        else if (key == "errors")
+        {
+            valid = parse_value(value, checkpoint.errors);
+        }
+        else if (key == "output_size")
+        {
+            valid = parse_value(value, checkpoint.output_size);
+        }
+        else if (key == "pgn_path")
+        {
+            checkpoint.pgn_path = value;
+        }
+        else if (key == "pgn_size")
+        {
+            valid = parse_value(value, checkpoint.pgn_size);
+        }
+        else if (key == "pgn_mtime")
+        {
+            valid = parse_value(value, checkpoint.pgn_mtime);
+        }
+        else if (key == "pgn_sample")
+        {
+            valid = parse_value(value, checkpoint.pgn_sample);
+        }
+        if (!valid)
+        {
+            throw std::runtime_error("Malformed checkpoint file: " + file_path.string());
+        }
+    }
+    if (checkpoint.pgn_path.empty())
+    {
+        throw std::runtime_error("Malformed checkpoint file: " + file_path.string());
+    }
+    return checkpoint;
+}
+
+void
+ingest_checkpoint::save(std::filesystem::path const& file_path) const
+{
+    auto temp_path = file_path;
+    temp_path += ".tmp";
+    {
+        std::ofstream output;
+        output.exceptions(std::ios::badbit | std::ios::failbit);
+        output.open(temp_path, std::ios::trunc);
+        output << header << "\n"
+               << "offset " << offset << "\n"
+               << "games " << games << "\n"
+               << "errors " << errors << "\n"
+               << "output_size " << output_size << "\n"
+               << "pgn_path " << pgn_path << "\n"
+               << "pgn_size " << pgn_size << "\n"
+               << "pgn_mtime " << pgn_mtime << "\n"
+               << "pgn_sample " << pgn_sample << "\n";
+    }
+    std::filesystem::rename(temp_path, file_path);
+}
+
+void
+ingest_checkpoint::stamp(std::filesystem::path const& pgn_file_path)
+{
+    pgn_path = std::filesystem::canonical(pgn_file_path).string();
+    pgn_size = std::filesystem::file_size(pgn_file_path);
+    pgn_mtime = modification_time(pgn_file_path);
+    pgn_sample = sample_hash(pgn_file_path, pgn_size);
+}
+
+void
+ingest_checkpoint::check(std::filesystem::path const& pgn_file_path, bool const allow_growth) const
+{
+    if (std::filesystem::canonical(pgn_file_path).string() != pgn_path)
+    {
+        throw std::runtime_error("The checkpoint was taken on " + pgn_path + ", not on " + pgn_file_path.string());
+    }
+    auto const size = std::filesystem::file_size(pgn_file_path);
+    if ((size == pgn_size) && (modification_time(pgn_file_path) == pgn_mtime))
+    {
+        return;
+    }
+    if (size < pgn_size)
+    {
+        throw std::runtime_error(pgn_file_path.string() + " has shrunk since the checkpoint was taken");
+    }
+    if ((size > pgn_size) && !allow_growth)
+    {
+        throw std::runtime_error(pgn_file_path.string() + " has grown since the checkpoint was taken"
+                                 " (only --follow resumes a file that was appended to)");
+    }
+    if (sample_hash(pgn_file_path, pgn_size) != pgn_sample)
+    {
+        throw std::runtime_error(pgn_file_path.string() + " has changed since the checkpoint was taken");
+    }
+}
+
+} // namespace mlp::chess
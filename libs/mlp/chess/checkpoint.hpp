@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+namespace mlp::chess
+{
+
+// How far a run over a PGN file got, so an interrupted run can pick up where it stopped.
+// Saved as a few "key value" text lines.
+struct ingest_checkpoint
+{
+    std::uint64_t offset = 0;      // Byte offset of the first game not yet processed
+    std::uint64_t games = 0;       // Games processed before offset
+    std::uint64_t errors = 0;      // Games that failed before offset
+    std::uint64_t output_size = 0; // Size of the output file when the checkpoint was taken
+
+    // The PGN file when the checkpoint was taken
+    std::string pgn_path;          // Canonical
+    std::uint64_t pgn_size = 0;
+    std::int64_t pgn_mtime = 0;
+    std::uint64_t pgn_sample = 0;  // Hash of the first and last bytes of the file
+
+    // Returns nothing if the file doesn't exist. Throws std::runtime_error if it is malformed
+    static std::optional<ingest_checkpoint> load(std::filesystem::path const& file_path);
+    // Replaces the file atomically, so a crash leaves either the old or the new checkpoint
+    void save(std::filesystem::path const& file_path) const;
+
+    // Records the PGN file as it is now
+    void stamp(std::filesystem::path const& pgn_file_path);
+    // Throws std::runtime_error unless the checkpoint was taken on this PGN file and the file still starts
+    // with the bytes it had then. It may have grown since only if `allow_growth`, e.g. when following it
+    void check(std::filesystem::path const& pgn_file_path, bool allow_growth) const;
+};
+
+} // namespace mlp::chess
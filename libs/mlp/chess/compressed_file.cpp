@@ -0,0 +1,432 @@
+#include <mlp/chess/compressed_file.hpp>
+
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#ifdef MLP_CHESS_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef MLP_CHESS_WITH_BZIP2
+#include <bzlib.h>
+#endif
+#ifdef MLP_CHESS_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace mlp::chess
+{
+
+compression
+detect_compression(std::filesystem::path const& file_path)
+{
+    // A pipe can only be read once, its first bytes are left to the reader. Compressed pipes are read as text
+    std::error_code error;
+    if (!std::filesystem::is_regular_file(file_path, error))
+    {
+        return compression::none;
+    }
+    std::ifstream file(file_path, std::ios::binary);
+    char magic[4] = {};
+    file.read(magic, sizeof(magic));
+    std::string_view const header(magic, static_cast<std::size_t>(file.gcount()));
+    if (header.starts_with("\x1f\x8b"))
+    {
+        return compression::gzip;
+    }
+    if (header.starts_with("BZh"))
+    {
+        return compression::bzip2;
+    }
+    if (header.starts_with("\x28\xb5\x2f\xfd"))
+    {
+        return compression::zstd;
+    }
+    return compression::none;
+}
+
+// Reads a compressed file through a fixed size input buffer and decompresses it on request
+class decompressing_streambuf::decoder
+{
+public:
+    explicit decoder(std::filesystem::path const& file_path):
+        file_path_(file_path),
+        file_(file_path, std::ios::binary),
+        input_(std::size_t{256} << 10)
+    {
+        if (!file_)
+        {
+            throw std::runtime_error("Could not open file: " + file_path.string());
+        }
+    }
+    virtual ~decoder() = default;
+
+    // Fills out with up to capacity decompressed bytes. Returns less only at the end of the data
+    virtual std::size_t read(char* out, std::size_t capacity) = 0;
+
+protected:
+    // Reads the next block of compressed input into input_. Returns 0 at the end of the file
+    std::size_t
+    fill()
+    {
+        file_.read(input_.data(), static_cast<std::streamsize>(input_.size()));
+        if (file_.bad())
+        {
+            throw std::runtime_error("Could not read file: " + file_path_.string());
+        }
+        return static_cast<std::size_t>(file_.gcount());
+    }
+
+    [[noreturn]] void
+    fail(std::string_view const reason) const
+    {
+        throw std::runtime_error("Could not decompress " + file_path_.string() + ": " + std::string(reason));
+    }
+
+    std::filesystem::path file_path_;
+    std::ifstream file_;
+    std::vector<char> input_;
+    bool input_done_ = false;
+};
+
+namespace
+{
+
+#ifdef MLP_CHESS_WITH_ZLIB
+class gzip_decoder final: public decompressing_streambuf::decoder
+{
+public:
+    explicit gzip_decoder(std::filesystem::path const& file_path):
+        decoder(file_path)
+    {
+        // 15 + 32: the largest window, with automatic detection of the gzip or zlib header
+        if (inflateInit2(&stream_, 15 + 32) != Z_OK)
+        {
+            fail("zlib initialisation failed");
+        }
+    }
+
+    ~gzip_decoder() override
+    {
+        inflateEnd(&stream_);
+    }
+
+    std::size_t
+    read(char* const out, std::size_t const capacity) override
+    {
+        stream_.next_out = reinterpret_cast<Bytef*>(out);
+        stream_.avail_out = static_cast<uInt>(capacity);
+        while (stream_.avail_out > 0)
+        {
+            if ((stream_.avail_in == 0) && !input_done_)
+            {
+                std::size_t const size = fill();
+                input_done_ = (size == 0);
+                stream_.next_in = reinterpret_cast<Bytef*>(input_.data());
+                stream_.avail_in = static_cast<uInt>(size);
+            }
+            if (!in_member_)
+            {
+                // Files written by parallel compressors and appended archives hold several members
+                if (stream_.avail_in == 0)
+                {
+                    break;
+                }
+                inflateReset(&stream_);
+                in_member_ = true;
+            }
+            auto const avail_out = stream_.avail_out;
+            int const result = inflate(&stream_, Z_NO_FLUSH);
+            if (result == Z_STREAM_END)
+            {
+                in_member_ = false;
+                continue;
+            }
+            if ((result != Z_OK) && (result != Z_BUF_ERROR))
+            {
+                fail(stream_.msg ? stream_.msg : "corrupt gzip data");
+            }
+            if (input_done_ && (stream_.avail_in == 0) && (stream_.avail_out == avail_out))
+            {
+                fail("unexpected end of file");
+            }
+        }
+        return capacity - stream_.avail_out;
+    }
+
+private:
+    z_stream stream_{};
+    bool in_member_ = true;
+};
+#endif
+
+#ifdef MLP_CHESS_WITH_BZIP2
+class bzip2_decoder final: public decompressing_streambuf::decoder
+{
+public:
+    explicit bzip2_decoder(std::filesystem::path const& file_path):
+        decoder(file_path)
+    {
+        if (BZ2_bzDecompressInit(&stream_, 0, 0) != BZ_OK)
+        {
+            fail("bzip2 initialisation failed");
+        }
+    }
+
+    ~bzip2_decoder() override
+    {
+        BZ2_bzDecompressEnd(&stream_);
+    }
+
+    std::size_t
+    read(char* const out, std::size_t const capacity) override
+    {
+        stream_.next_out = out;
+        stream_.avail_out = static_cast<unsigned>(capacity);
+        while (stream_.avail_out > 0)
+        {
+            if ((stream_.avail_in == 0) && !input_done_)
+            {
+                std::size_t const size = fill();
+                input_done_ = (size == 0);
+                stream_.next_in = input_.data();
+                stream_.avail_in = static_cast<unsigned>(size);
+            }
+            if (!in_stream_)
+            {
+                // Concatenated streams, as written by pbzip2, are decoded one after the other
+                if (stream_.avail_in == 0)
+                {
+                    break;
+                }
+                auto* const next_in = stream_.next_in;
+                auto const avail_in = stream_.avail_in;
+                auto* const next_out = stream_.next_out;
+                auto const avail_out = stream_.avail_out;
+                BZ2_bzDecompressEnd(&stream_);
+                stream_ = bz_stream{};
+                if (BZ2_bzDecompressInit(&stream_, 0, 0) != BZ_OK)
+                {
+                    fail("bzip2 initialisation failed");
+                }
+                stream_.next_in = next_in;
+                stream_.avail_in = avail_in;
+                stream_.next_out = next_out;
+                stream_.avail_out = avail_out;
+                in_stream_ = true;
+            }
+            auto const avail_out = stream_.avail_out;
+            int const result = BZ2_bzDecompress(&stream_);
+            if (result == BZ_STREAM_END)
+            {
+                in_stream_ = false;
+                continue;
+            }
+            if (result != BZ_OK)
+            {
+                fail("corrupt bzip2 data");
+            }
+            if (input_done_ && (stream_.avail_in == 0) && (stream_.avail_out == avail_out))
+            {
+                fail("unexpected end of file");
+            }
+        }
+        return capacity - stream_.avail_out;
+    }
+
+private:
+    bz_stream stream_{};
+    bool in_stream_ = true;
+};
+#endif
+
+#ifdef MLP_CHESS_WITH_ZSTD
+class zstd_decoder final: public decompressing_streambuf::decoder
+{
+public:
+    explicit zstd_decoder(std::filesystem::path const& file_path):
+        decoder(file_path),
+        stream_(ZSTD_createDStream())
+    {
+        if (!stream_)
+        {
+            fail("zstd initialisation failed");
+        }
+        ZSTD_initDStream(stream_);
+    }
+
+    ~zstd_decoder() override
+    {
+        ZSTD_freeDStream(stream_);
+    }
+
+    std::size_t
+    read(char* const out, std::size_t const capacity) override
+    {
+        ZSTD_outBuffer output{out, capacity, 0};
+        while (output.pos < output.size)
+        {
+            if ((input_buffer_.pos == input_buffer_.size) && !input_done_)
+            {
+                std::size_t const size = fill();
+                input_done_ = (size == 0);
+                input_buffer_ = ZSTD_inBuffer{input_.data(), size, 0};
+            }
+            // Consecutive frames are decoded one after the other by the same stream
+            if ((input_buffer_.pos == input_buffer_.size) && input_done_ && !in_frame_)
+            {
+                break;
+            }
+            auto const pos = output.pos;
+            std::size_t const result = ZSTD_decompressStream(stream_, &output, &input_buffer_);
+            if (ZSTD_isError(result))
+            {
+                fail(ZSTD_getErrorName(result));
+            }
+            in_frame_ = (result != 0);
+            if (input_done_ && (input_buffer_.pos == input_buffer_.size) && in_frame_ && (output.pos == pos))
+            {
+                fail("unexpected end of file");
+            }
+        }
+        return output.pos;
+    }
+
+private:
+    ZSTD_DStream* stream_;
+    ZSTD_inBuffer input_buffer_{nullptr, 0, 0};
+    bool in_frame_ = false;
+};
+#endif
+
+std::unique_ptr<decompressing_streambuf::decoder>
+make_decoder(std::filesystem::path const& file_path, compression const format)
+{
+    char const* name = "";
+    switch (format)
+    {
+        case compression::gzip:
+#ifdef MLP_CHESS_WITH_ZLIB
+            return std::make_unique<gzip_decoder>(file_path);
+#endif
+            name = "gzip";
+            break;
+        case compression::bzip2:
+#ifdef MLP_CHESS_WITH_BZIP2
+            return std::make_unique<bzip2_decoder>(file_path);
+#endif
+            name = "bzip2";
+            break;
+        case compression::zstd:
+#ifdef MLP_CHESS_WITH_ZSTD
+            return std::make_unique<zstd_decoder>(file_path);
+#endif
+            name = "zstd";
+            break;
+        case compression::none:
+            throw std::runtime_error("File is not compressed: " + file_path.string());
+    }
+    throw std::runtime_error(file_path.string() + " is " + name + " compressed, but " + name
+                             + " support was not built in");
+}
+
+} // namespace
+
+decompressing_streambuf::decompressing_streambuf(std::filesystem::path const& file_path,
+                                                 compression const format, std::size_t const buffer_size):
+    decoder_(make_decoder(file_path, format))
+{
+    for (auto& buffer: buffers_)
+    {
+        buffer.data.resize(buffer_size);
+    }
+    thread_ = std::thread(&decompressing_streambuf::decompress, this);
+}
+
+decompressing_streambuf::~decompressing_streambuf()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    buffer_released_.notify_one();
+    thread_.join();
+}
+
+void
+decompressing_streambuf::decompress()
+{
+    std::size_t filling = 0;
+    try
+    {
+        while (true)
+        {
+            auto& buffer = buffers_[filling];
+            {
+                std::unique_lock lock(mutex_);
+                buffer_released_.wait(lock, [&] { return stop_ || !buffer.ready; });
+                if (stop_)
+                {
+                    return;
+                }
+            }
+            // The reader doesn't touch a buffer until it is ready, so it is filled without the lock
+            buffer.size = decoder_->read(buffer.data.data(), buffer.data.size());
+            if (buffer.size == 0)
+            {
+                break;
+            }
+            {
+                std::lock_guard lock(mutex_);
+                buffer.ready = true;
+            }
+            buffer_filled_.notify_one();
+            filling ^= 1;
+        }
+    }
+    catch (...)
+    {
+        std::lock_guard lock(mutex_);
+        error_ = std::current_exception();
+    }
+    {
+        std::lock_guard lock(mutex_);
+        finished_ = true;
+    }
+    buffer_filled_.notify_one();
+}
+
+decompressing_streambuf::int_type
+decompressing_streambuf::underflow()
+{
+    if (gptr() < egptr())
+    {
+        return traits_type::to_int_type(*gptr());
+    }
+    std::unique_lock lock(mutex_);
+    if (holding_)
+    {
+        // Hand the consumed buffer back to be refilled
+        buffers_[reading_].ready = false;
+        reading_ ^= 1;
+        holding_ = false;
+        buffer_released_.notify_one();
+    }
+    buffer_filled_.wait(lock, [&] { return buffers_[reading_].ready || finished_; });
+    auto& buffer = buffers_[reading_];
+    if (!buffer.ready)
+    {
+        if (error_)
+        {
+            std::rethrow_exception(error_);
+        }
+        return traits_type::eof();
+    }
+    holding_ = true;
+    setg(buffer.data.data(), buffer.data.data(), buffer.data.data() + buffer.size);
+    return traits_type::to_int_type(*gptr());
+}
+
+} // namespace mlp::chess
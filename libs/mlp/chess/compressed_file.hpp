@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+namespace mlp::chess
+{
+
+enum class compression
+{
+    none,
+    gzip,
+    bzip2,
+    zstd,
+};
+
+// Identifies the compression format of a regular file from its magic bytes. Anything else (e.g. a pipe)
+// is left unread and taken as uncompressed
+compression detect_compression(std::filesystem::path const& file_path);
+
+// Stream buffer over the decompressed contents of a gzip, bzip2 or zstd file. Decompression runs on
+// a thread of its own, one buffer ahead of the reader: while the reader consumes one buffer the
+// thread fills the other, so reading never waits for more than one buffer's worth of decompression.
+class decompressing_streambuf: public std::streambuf
+{
+public:
+    class decoder;
+
+    decompressing_streambuf(std::filesystem::path const& file_path, compression format,
+                            std::size_t buffer_size = std::size_t{1} << 20);
+    decompressing_streambuf(decompressing_streambuf const&) = delete;
+    decompressing_streambuf& operator=(decompressing_streambuf const&) = delete;
+    ~decompressing_streambuf() override;
+
+protected:
+    int_type underflow() override;
+
+private:
+    void decompress();
+
+    struct buffer
+    {
+        std::vector<char> data;
+        std::size_t size = 0;
+        bool ready = false; // Filled and waiting for, or being read by, the reader
+    };
+
+    std::unique_ptr<decoder> decoder_;
+    std::array<buffer, 2> buffers_;
+    std::size_t reading_ = 0; // Index of the buffer the reader consumes next
+    bool holding_ = false;    // The reader is still consuming buffers_[reading_]
+    bool finished_ = false;   // No more buffers will be filled
+    bool stop_ = false;
+    std::exception_ptr error_;
+    std::mutex mutex_;
+    std::condition_variable buffer_filled_;
+    std::condition_variable buffer_released_;
+    std::thread thread_;
+};
+
+} // namespace mlp::chess
@@ -0,0 +1,181 @@
+#include <mlp/chess/game_dedup.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <string>
+#include <utility>
+
+namespace mlp::chess
+{
+
+namespace
+{
+
+constexpr std::uint64_t
+mix(std::uint64_t x) noexcept
+{
+    // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111eb;
+    x ^= x >> 31;
+    return x;
+}
+
+void
+append_normalized(std::string_view const value, std::string& out)
+{
+    for (char const c: value)
+    {
+        if (std::isalnum(static_cast<unsigned char>(c)))
+        {
+            out += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+    }
+}
+
+} // anonymous namespace
+
+game_fingerprint
+fingerprint(std::span<packed_move const> const moves, std::string_view const key_tags)
+{
+    // Two independent lanes over the moves, four to a 64-bit word
+    std::uint64_t high = 0x6a09e667f3bcc908;
+    std::uint64_t low = 0xbb67ae8584caa73b;
+    auto const add_word = [&](std::uint64_t const word) noexcept
+    {
+        high = mix(high ^ word) + 0x9e3779b97f4a7c15;
+        low = mix(low + word * 0xff51afd7ed558ccd) ^ (high >> 17);
+    };
+    std::size_t i = 0;
+    for (; i + 4 <= moves.size(); i += 4)
+    {
+        add_word(std::uint64_t{moves[i].bits()} | (std::uint64_t{moves[i + 1].bits()} << 16)
+                 | (std::uint64_t{moves[i + 2].bits()} << 32) | (std::uint64_t{moves[i + 3].bits()} << 48));
+    }
+    std::uint64_t tail = 0;
+    for (int shift = 0; i < moves.size(); ++i, shift += 16)
+    {
+        tail |= std::uint64_t{moves[i].bits()} << shift;
+    }
+    add_word(tail);
+    // The length tells apart games that differ only by trailing null moves
+    add_word(moves.size());
+    if (!key_tags.empty())
+    {
+        add_word(std::hash<std::string_view>{}(key_tags));
+        add_word(key_tags.size() ^ 0x5bd1e9955bd1e995);
+    }
+    return {mix(high ^ low), mix(low + 0x2545f4914f6cdd1d)};
+}
+
+void
+append_key_tags(pgn::tag_pairs const& tags, std::string& out)
+{
+    for (auto const key: {pgn::tag_key::White, pgn::tag_key::Black, pgn::tag_key::Date, pgn::tag_key::Round})
+    {
+        append_normalized(tags.get(key), out);
+        out += '\x1f';
+    }
+}
+
+duplicate_finder::duplicate_finder(std::size_t const memory_limit, std::filesystem::path temp_dir):
+    memory_limit_(memory_limit),
+    temp_dir_(std::move(temp_dir))
+{
+}
+
+duplicate_finder::~duplicate_finder()
+{
+    dropped_merger_.reset();
+    std::error_code ignored;
+    for (auto const* runs: {&entry_runs_, &dropped_runs_})
+    {
+        for (auto const& run: *runs)
+        {
+            std::filesystem::remove(run, ignored);
+        }
+    }
+}
+
+template<typename T>
+void
+duplicate_finder::spill(std::vector<T>& records, std::vector<std::filesystem::path>& runs)
+{
+    runs.push_back(spill_run(records, temp_dir_, "mlp-chess-dedup"));
+    ++spill_count_;
+}
+
+void
+duplicate_finder::drop(std::uint64_t const game)
+{
+    dropped_.push_back(game);
+    if (dropped_.size() * sizeof(std::uint64_t) >= memory_limit_)
+    {
+        spill(dropped_, dropped_runs_);
+    }
+}
+
+void
+duplicate_finder::add(game_fingerprint const& fingerprint)
+{
+    entries_.push_back({fingerprint, game_count_++});
+    if (entries_.size() * sizeof(entry) >= memory_limit_)
+    {
+        spill(entries_, entry_runs_);
+    }
+}
+
+void
+duplicate_finder::add_dropped()
+{
+    drop(game_count_++);
+}
+
+void
+duplicate_finder::finish()
+{
+    // Games with the same fingerprint are adjacent in order of game number, all but the first are repeats
+    std::ranges::sort(entries_);
+    {
+        run_merger<entry> entries(entry_runs_, entries_);
+        entry current;
+        bool first = true;
+        game_fingerprint previous;
+        while (entries.next(current))
+        {
+            if (!first && (current.fingerprint == previous))
+            {
+                drop(current.game);
+                ++duplicate_count_;
+            }
+            previous = current.fingerprint;
+            first = false;
+        }
+    }
+    std::vector<entry>().swap(entries_);
+    std::error_code ignored;
+    for (auto const& run: entry_runs_)
+    {
+        std::filesystem::remove(run, ignored);
+    }
+    entry_runs_.clear();
+
+    std::ranges::sort(dropped_);
+    dropped_merger_ = std::make_unique<run_merger<std::uint64_t>>(dropped_runs_, dropped_);
+    has_next_dropped_ = dropped_merger_->next(next_dropped_);
+}
+
+bool
+duplicate_finder::is_dropped(std::uint64_t const game)
+{
+    while (has_next_dropped_ && (next_dropped_ < game))
+    {
+        has_next_dropped_ = dropped_merger_->next(next_dropped_);
+    }
+    return has_next_dropped_ && (next_dropped_ == game);
+}
+
+} // namespace mlp::chess
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <mlp/chess/packed_move.hpp>
+#include <mlp/chess/pgn_tags.hpp>
+#include <mlp/chess/sorted_runs.hpp>
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mlp::chess
+{
+
+// 128-bit identity of a game. Two different games share one with a probability of about 2^-128, so
+// billions of games can be told apart by fingerprint alone
+struct game_fingerprint
+{
+    std::uint64_t high = 0;
+    std::uint64_t low = 0;
+
+    friend auto operator<=>(game_fingerprint const&, game_fingerprint const&) = default;
+};
+
+// Fingerprint of a game's resolved moves and, if not empty, of key tags from append_key_tags()
+game_fingerprint fingerprint(std::span<packed_move const> moves, std::string_view key_tags = {});
+
+// Appends the White, Black, Date and Round tags, normalized so that the spellings of different sources
+// agree: letters lower cased and everything but letters and digits dropped ("Carlsen, Magnus" and
+// "carlsen magnus" match, and "????.??.??" is empty)
+void append_key_tags(pgn::tag_pairs const& tags, std::string& out);
+
+// Finds the games that repeat an earlier game, among any number of games. Each game is add()ed in
+// order, then finish() is called, then is_dropped() is asked about the games in the same order.
+//
+// Fingerprints are collected in memory up to memory_limit bytes, then sorted and spilled to a run file
+// in temp_dir. finish() merges the runs to find the repeats, whose game numbers are again collected,
+// spilled and merged the same way, so memory use stays bounded whatever the number of games.
+class duplicate_finder
+{
+public:
+    explicit duplicate_finder(std::size_t memory_limit = std::size_t{256} << 20,
+                              std::filesystem::path temp_dir = std::filesystem::temp_directory_path());
+    duplicate_finder(duplicate_finder const&) = delete;
+    duplicate_finder& operator=(duplicate_finder const&) = delete;
+    // Removes the run files
+    ~duplicate_finder();
+
+    // The next game
+    void add(game_fingerprint const& fingerprint);
+    // The next game, which is to be dropped whatever it is, e.g. because it failed to replay
+    void add_dropped();
+    void finish();
+    // Whether game number `game` (0 for the first one added) is dropped: a repeat of an earlier game, or
+    // added with add_dropped(). Must be called with increasing game numbers
+    bool is_dropped(std::uint64_t game);
+
+    std::uint64_t game_count() const noexcept { return game_count_; }
+    // Valid after finish()
+    std::uint64_t duplicate_count() const noexcept { return duplicate_count_; }
+    // Run files written so far, 0 as long as everything fits in memory
+    std::size_t spill_count() const noexcept { return spill_count_; }
+
+private:
+    struct entry
+    {
+        game_fingerprint fingerprint;
+        std::uint64_t game;
+
+        friend auto operator<=>(entry const&, entry const&) = default;
+    };
+    template<typename T>
+    void spill(std::vector<T>& records, std::vector<std::filesystem::path>& runs);
+    void drop(std::uint64_t game);
+
+    std::size_t memory_limit_;
+    std::filesystem::path temp_dir_;
+    std::vector<entry> entries_;
+    std::vector<std::uint64_t> dropped_;
+    std::vector<std::filesystem::path> entry_runs_;
+    std::vector<std::filesystem::path> dropped_runs_;
+    std::unique_ptr<run_merger<std::uint64_t>> dropped_merger_; // Over dropped_runs_ and dropped_, after finish()
+    bool has_next_dropped_ = false;
+    std::uint64_t next_dropped_ = 0;
+    std::uint64_t game_count_ = 0;
+    std::uint64_t duplicate_count_ = 0;
+    std::size_t spill_count_ = 0;
+};
+
+} // namespace mlp::chess
@@ -0,0 +1,92 @@
+#include <mlp/chess/mapped_file.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mlp::chess
+{
+
+mapped_file::mapped_file(std::filesystem::path const& file_path)
+{
+    int const fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Could not open file: " + file_path.string() + ": " + std::strerror(errno));
+    }
+    struct stat st{};
+    if (::fstat(fd, &st) != 0)
+    {
+        int const error = errno;
+        ::close(fd);
+        throw std::runtime_error("Could not stat file: " + file_path.string() + ": " + std::strerror(error));
+    }
+    if (!S_ISREG(st.st_mode))
+    {
+        // A pipe has no size and can't be mapped, it would look like an empty file
+        ::close(fd);
+        throw std::runtime_error("Could not map file: " + file_path.string()
+                                 + ": not a regular file (a pipe can only be streamed)");
+    }
+    size_ = static_cast<std::size_t>(st.st_size);
+    if (size_ == 0)
+    {
+        // mmap() refuses zero length mappings. An empty file is simply an empty range
+        ::close(fd);
+        static char const empty = '\0';
+        data_ = &empty;
+        return;
+    }
+    void* const addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    int const error = errno;
+    ::close(fd);
+    if (addr == MAP_FAILED)
+    {
+        size_ = 0;
+        throw std::runtime_error("Could not map file: " + file_path.string() + ": " + std::strerror(error));
+    }
+    ::madvise(addr, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<char const*>(addr);
+}
+
+mapped_file::mapped_file(mapped_file&& other) noexcept:
+    data_(std::exchange(other.data_, nullptr)),
+    size_(std::exchange(other.size_, 0))
+{
+}
+
+mapped_file&
+mapped_file::operator=(mapped_file&& other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+mapped_file::~mapped_file()
+{
+    close();
+}
+
+void
+mapped_file::close() noexcept
+{
+    if (data_ && (size_ != 0))
+    {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+}
+
+} // namespace mlp::chess
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+namespace mlp::chess
+{
+
+// Read-only memory mapping of a whole file. The kernel is advised that the mapping will be read
+// sequentially so it can read ahead aggressively and drop pages behind us.
+class mapped_file
+{
+public:
+    mapped_file() noexcept = default;
+    // Throws std::runtime_error if the file can't be mapped, e.g. a pipe
+    explicit mapped_file(std::filesystem::path const& file_path);
+    mapped_file(mapped_file&& other) noexcept;
+    mapped_file& operator=(mapped_file&& other) noexcept;
+    mapped_file(mapped_file const&) = delete;
+    mapped_file& operator=(mapped_file const&) = delete;
+    ~mapped_file();
+
+    char const* data() const noexcept { return data_; }
+    std::size_t size() const noexcept { return size_; }
+    char const* begin() const noexcept { return data_; }
+    char const* end() const noexcept { return data_ + size_; }
+    bool is_open() const noexcept { return data_ != nullptr; }
+
+    void close() noexcept;
+
+private:
+    char const* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+} // namespace mlp::chess
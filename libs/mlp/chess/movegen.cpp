@@ -0,0 +1,259 @@
+#include <mlp/chess/movegen.hpp>
+#include <mlp/chess/attacks.hpp>
+
+#include <bit>
+
+namespace mlp::chess
+{
+
+namespace
+{
+
+constexpr piece_colour
+opponent(piece_colour const colour) noexcept
+{
+    return (colour == piece_colour::White) ? piece_colour::Black : piece_colour::White;
+}
+
+constexpr chess::packed_move
+make_move(int const from, int const to) noexcept
+{
+    return chess::packed_move(static_cast<std::uint16_t>(from | (to << 6)));
+}
+
+// Adds a pawn move, as the four promotions if it reaches the last rank
+void
+add_pawn_move(move_list& moves, int const from, int const to)
+{
+    if ((to < 8) || (to >= 56))
+    {
+        for (std::uint16_t promotion = 0; promotion < 4; ++promotion)
+        {
+            auto const bits = make_move(from, to).bits()
+                            | (promotion << 12)
+                            | (static_cast<std::uint16_t>(chess::packed_move::kind::promotion) << 14);
+            moves.push_back(chess::packed_move(static_cast<std::uint16_t>(bits)));
+        }
+        return;
+    }
+    moves.push_back(make_move(from, to));
+}
+
+void
+add_moves(move_list& moves, int const from, bitboard targets)
+{
+    while (targets)
+    {
+        moves.push_back(make_move(from, pop_lsb(targets)));
+    }
+}
+
+// Every square on the line through two aligned squares, other than the first
+bitboard
+line_through(int const king, int const index) noexcept
+{
+    bitboard const straight = rook_attacks(king, 0) & rook_attacks(index, 0);
+    bitboard const diagonal = bishop_attacks(king, 0) & bishop_attacks(index, 0);
+    bool const is_straight = ((king & 7) == (index & 7)) || ((king >> 3) == (index >> 3));
+    return (is_straight ? straight : diagonal) | square_bit(index);
+}
+
+} // anonymous namespace
+
+bitboard
+attackers_of(board const& position, int const index, piece_colour const by, bitboard const occupied) noexcept
+{
+    bitboard const queens = position.squares_of(by, piece_type::Queen);
+    return (pawn_attacks[colour_index(opponent(by))][index] & position.squares_of(by, piece_type::Pawn))
+         | (knight_attacks[index] & position.squares_of(by, piece_type::Knight))
+         | (king_attacks[index] & position.squares_of(by, piece_type::King))
+         | (bishop_attacks(index, occupied) & (position.squares_of(by, piece_type::Bishop) | queens))
+         | (rook_attacks(index, occupied) & (position.squares_of(by, piece_type::Rook) | queens));
+}
+
+bool
+in_check(board const& position) noexcept
+{
+    piece_colour const us = position.side_to_move();
+    bitboard const king = position.squares_of(us, piece_type::King);
+    return king && attackers_of(position, std::countr_zero(king), opponent(us), position.occupancy());
+}
+
+void
+generate_legal_moves(board const& position, move_list& moves)
+{
+    moves.clear();
+    piece_colour const us = position.side_to_move();
+    piece_colour const them = opponent(us);
+    bitboard const occupied = position.occupancy();
+    bitboard const own = position.occupancy(us);
+    bitboard const enemy = position.occupancy(them);
+    bitboard const king_bit = position.squares_of(us, piece_type::King);
+    if (!king_bit)
+    {
+        return;
+    }
+    int const king = std::countr_zero(king_bit);
+
+    // The king may not step onto an attacked square, nor stay on the line of a slider it steps away from
+    bitboard const checkers = attackers_of(position, king, them, occupied);
+    bitboard const without_king = occupied ^ king_bit;
+    bitboard king_targets = king_attacks[king] & ~own;
+    while (king_targets)
+    {
+        int const to = pop_lsb(king_targets);
+        if (!attackers_of(position, to, them, without_king))
+        {
+            moves.push_back(make_move(king, to));
+        }
+    }
+    if (std::popcount(checkers) > 1)
+    {
+        return;
+    }
+
+    // Other pieces must capture or block a single checker, and pinned pieces must stay on the pin line
+    bitboard const check_mask = checkers ? (checkers | squares_between(king, std::countr_zero(checkers)))
+                                         : ~bitboard{0};
+    bitboard const their_queens = position.squares_of(them, piece_type::Queen);
+    bitboard snipers = (rook_attacks(king, enemy) & (position.squares_of(them, piece_type::Rook) | their_queens))
+                     | (bishop_attacks(king, enemy) & (position.squares_of(them, piece_type::Bishop) | their_queens));
+    bitboard pinned = 0;
+    while (snipers)
+    {
+        bitboard const blockers = squares_between(king, pop_lsb(snipers)) & occupied;
+        if (std::has_single_bit(blockers) && (blockers & own))
+        {
+            pinned |= blockers;
+        }
+    }
+    auto const allowed = [&](int const from)
+    {
+        return (pinned & square_bit(from)) ? (check_mask & line_through(king, from)) : check_mask;
+    };
+
+    // Pinned knights can never move
+    bitboard knights = position.squares_of(us, piece_type::Knight) & ~pinned;
+    while (knights)
+    {
+        int const from = pop_lsb(knights);
+        add_moves(moves, from, knight_attacks[from] & ~own & check_mask);
+    }
+    bitboard const queens = position.squares_of(us, piece_type::Queen);
+    bitboard diagonal = position.squares_of(us, piece_type::Bishop) | queens;
+    while (diagonal)
+    {
+        int const from = pop_lsb(diagonal);
+        add_moves(moves, from, bishop_attacks(from, occupied) & ~own & allowed(from));
+    }
+    bitboard straight = position.squares_of(us, piece_type::Rook) | queens;
+    while (straight)
+    {
+        int const from = pop_lsb(straight);
+        add_moves(moves, from, rook_attacks(from, occupied) & ~own & allowed(from));
+    }
+
+    bool const white = (us == piece_colour::White);
+    int const forward = white ? 8 : -8;
+    int const start_rank = white ? 1 : 6;
+    int en_passant = -1;
+    if (position.en_passant_file())
+    {
+        en_passant = ((white ? 5 : 2) * 8) + (position.en_passant_file() - 'a');
+    }
+    bitboard pawns = position.squares_of(us, piece_type::Pawn);
+    while (pawns)
+    {
+        int const from = pop_lsb(pawns);
+        bitboard const targets = allowed(from);
+        int const one = from + forward;
+        if (!(occupied & square_bit(one)))
+        {
+            if (targets & square_bit(one))
+            {
+                add_pawn_move(moves, from, one);
+            }
+            int const two = one + forward;
+            if (((from >> 3) == start_rank) && !(occupied & square_bit(two)) && (targets & square_bit(two)))
+            {
+                moves.push_back(make_move(from, two));
+            }
+        }
+        bitboard captures = pawn_attacks[colour_index(us)][from] & enemy & targets;
+        while (captures)
+        {
+            add_pawn_move(moves, from, pop_lsb(captures));
+        }
+        if ((en_passant >= 0) && (pawn_attacks[colour_index(us)][from] & square_bit(en_passant)))
+        {
+            // Two pawns leave the rank at once, so test the resulting position directly
+            int const captured = en_passant - forward;
+            bitboard const after = (occupied ^ square_bit(from) ^ square_bit(captured)) | square_bit(en_passant);
+            bitboard const sliders = (rook_attacks(king, after) & (position.squares_of(them, piece_type::Rook) | their_queens))
+                                   | (bishop_attacks(king, after) & (position.squares_of(them, piece_type::Bishop) | their_queens));
+            if (!sliders && !(checkers & ~square_bit(captured)))
+            {
+                moves.push_back(make_move(from, en_passant));
+            }
+        }
+    }
+
+    if (checkers)
+    {
+        return;
+    }
+    // Castling: the rights, empty squares up to the rook, and no attacked square on the king's way
+    unsigned const rights = position.castling_rights();
+    int const home = white ? 4 : 60;
+    bitboard const rooks = position.squares_of(us, piece_type::Rook);
+    auto const attacked = [&](int const index)
+    {
+        return attackers_of(position, index, them, occupied) != 0;
+    };
+    if ((king == home) && (rights & (white ? board::white_kingside : board::black_kingside))
+        && (rooks & square_bit(home + 3)) && !(occupied & (square_bit(home + 1) | square_bit(home + 2)))
+        && !attacked(home + 1) && !attacked(home + 2))
+    {
+        moves.push_back(chess::packed_move::castling(us, true));
+    }
+    if ((king == home) && (rights & (white ? board::white_queenside : board::black_queenside))
+        && (rooks & square_bit(home - 4))
+        && !(occupied & (square_bit(home - 1) | square_bit(home - 2) | square_bit(home - 3)))
+        && !attacked(home - 1) && !attacked(home - 2))
+    {
+        moves.push_back(chess::packed_move::castling(us, false));
+    }
+}
+
+std::uint64_t
+perft(board const& position, unsigned const depth)
+{
+    board scratch = position;
+    return perft(scratch, depth);
+}
+
+std::uint64_t
+perft(board& position, unsigned const depth)
+{
+    if (depth == 0)
+    {
+        return 1;
+    }
+    move_list moves;
+    generate_legal_moves(position, moves);
+    // Counting the moves of the last ply is enough, they don't need to be played
+    if (depth == 1)
+    {
+        return moves.size();
+    }
+    std::uint64_t nodes = 0;
+    for (auto const move: moves)
+    {
+        auto const undo = position.make(move);
+        nodes += perft(position, depth - 1);
+        position.unmake(undo);
+    }
+    return nodes;
+}
+
+} // namespace mlp::chess
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <mlp/chess/bitboard.hpp>
+#include <mlp/chess/board.hpp>
+#include <mlp/chess/packed_move.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace mlp::chess
+{
+
+// Fixed capacity list of moves. No legal position has more than 218 moves
+class move_list
+{
+public:
+    void push_back(chess::packed_move const move) noexcept { moves_[size_++] = move; }
+    void clear() noexcept { size_ = 0; }
+
+    std::size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+    chess::packed_move operator[](std::size_t const index) const noexcept { return moves_[index]; }
+    chess::packed_move const* begin() const noexcept { return moves_.data(); }
+    chess::packed_move const* end() const noexcept { return moves_.data() + size_; }
+
+private:
+    std::array<chess::packed_move, 256> moves_;
+    std::size_t size_ = 0;
+};
+
+// The pieces of the given colour attacking a square, given the occupied squares
+bitboard attackers_of(board const& position, int index, piece_colour by, bitboard occupied) noexcept;
+
+// Whether the side to move is in check
+bool in_check(board const& position) noexcept;
+
+// Every legal move of the side to move, in a form board::move(packed_move) plays. Castling moves are
+// flagged as such and promotions come as four moves, one per piece.
+void generate_legal_moves(board const& position, move_list& moves);
+
+// Number of leaf nodes of the legal move tree `depth` plies deep. The moves are made and unmade on
+// the given board, which ends up as it started; the const overload works on a copy
+std::uint64_t perft(board& position, unsigned depth);
+std::uint64_t perft(board const& position, unsigned depth);
+
+} // namespace mlp::chess
@@ -0,0 +1,358 @@
+#include <mlp/chess/opening_tree.hpp>
+#include <mlp/chess/sorted_runs.hpp>
+#include <mlp/chess/utility.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+namespace mlp::chess
+{
+
+namespace
+{
+
+constexpr std::size_t header_size = opening_tree_format::magic.size() + 4 + 4 + 8 + 8;
+constexpr std::size_t position_size = 8 + 4 + 4;
+constexpr std::size_t move_size = 2 + 2 + 4 + 4 + 4 + 4;
+
+template<typename T>
+void
+append_le(std::vector<char>& out, T const value)
+{
+    T const le = to_little_endian(value);
+    auto const bytes = reinterpret_cast<char const*>(&le);
+    out.insert(out.end(), bytes, bytes + sizeof(le));
+}
+
+template<typename T>
+T
+load_le(char const* const ptr) noexcept
+{
+    T value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return to_little_endian(value);
+}
+
+// Counts saturate rather than wrap when trees of huge databases are merged
+void
+add_count(std::uint32_t& count, std::uint32_t const add) noexcept
+{
+    count = (count > std::numeric_limits<std::uint32_t>::max() - add) ? std::numeric_limits<std::uint32_t>::max()
+                                                                       : count + add;
+}
+
+bool
+more_played(move_stats const& lhs, move_stats const& rhs) noexcept
+{
+    return (lhs.games != rhs.games) ? (lhs.games > rhs.games) : (lhs.move.bits() < rhs.move.bits());
+}
+
+} // anonymous namespace
+
+game_result
+to_game_result(std::string_view const result_tag) noexcept
+{
+    if (result_tag == "1-0")
+    {
+        return game_result::white_wins;
+    }
+    if (result_tag == "0-1")
+    {
+        return game_result::black_wins;
+    }
+    if (result_tag == "1/2-1/2")
+    {
+        return game_result::draw;
+    }
+    return game_result::unknown;
+}
+
+opening_tree_builder::opening_tree_builder(unsigned const max_plies, std::size_t const memory_limit,
+                                           std::filesystem::path temp_dir):
+    max_plies_(max_plies),
+    memory_limit_(memory_limit),
+    temp_dir_(std::move(temp_dir))
+{
+}
+
+opening_tree_builder&
+opening_tree_builder::operator=(opening_tree_builder&& other) noexcept
+{
+    if (this != &other)
+    {
+        remove_runs();
+        max_plies_ = other.max_plies_;
+        memory_limit_ = other.memory_limit_;
+        temp_dir_ = std::move(other.temp_dir_);
+        counts_ = std::move(other.counts_);
+        runs_ = std::move(other.runs_);
+        other.runs_.clear();
+    }
+    return *this;
+}
+
+opening_tree_builder::~opening_tree_builder()
+{
+    remove_runs();
+}
+
+void
+opening_tree_builder::remove_runs() noexcept
+{
+    std::error_code ignored;
+    for (auto const& run: runs_)
+    {
+        std::filesystem::remove(run, ignored);
+    }
+    runs_.clear();
+}
+
+void
+opening_tree_builder::add_game(std::span<zobrist_hash const> const positions,
+                               std::span<chess::packed_move const> const moves, game_result const result)
+{
+    std::size_t const plies = std::min({moves.size(), positions.size(), std::size_t{max_plies_}});
+    for (std::size_t ply = 0; ply < plies; ++ply)
+    {
+        auto& stats = counts_[key{positions[ply], moves[ply].bits()}];
+        stats.move = moves[ply];
+        add_count(stats.games, 1);
+        switch (result)
+        {
+            case game_result::white_wins: add_count(stats.white_wins, 1); break;
+            case game_result::draw: add_count(stats.draws, 1); break;
+            case game_result::black_wins: add_count(stats.black_wins, 1); break;
+            case game_result::unknown: break;
+        }
+    }
+    spill_if_full();
+}
+
+void
+opening_tree_builder::merge(opening_tree_builder&& other)
+{
+    runs_.insert(runs_.end(), std::make_move_iterator(other.runs_.begin()), std::make_move_iterator(other.runs_.end()));
+    other.runs_.clear();
+    if (counts_.empty())
+    {
+        counts_.swap(other.counts_);
+        return;
+    }
+    // The other's entries are freed as they are added, so the two maps together stay within the limit
+    for (auto it = other.counts_.begin(); it != other.counts_.end(); it = other.counts_.erase(it))
+    {
+        auto const& [k, other_stats] = *it;
+        auto& stats = counts_[k];
+        stats.move = other_stats.move;
+        add_count(stats.games, other_stats.games);
+        add_count(stats.white_wins, other_stats.white_wins);
+        add_count(stats.draws, other_stats.draws);
+        add_count(stats.black_wins, other_stats.black_wins);
+        spill_if_full();
+    }
+    decltype(other.counts_)().swap(other.counts_);
+}
+
+std::vector<opening_tree_builder::run_record>
+opening_tree_builder::take_counts()
+{
+    std::vector<run_record> records;
+    records.reserve(counts_.size());
+    for (auto const& [k, stats]: counts_)
+    {
+        records.push_back({k.position, k.move, stats.games, stats.white_wins, stats.draws, stats.black_wins});
+    }
+    decltype(counts_)().swap(counts_); // Frees the buckets too
+    return records;
+}
+
+void
+opening_tree_builder::spill_if_full()
+{
+    // A map entry costs its node, the node's link, up to two buckets and the allocator's overhead, and the
+    // record it becomes when it is spilled
+    constexpr std::size_t entry_size = sizeof(std::pair<key const, move_stats>) + (4 * sizeof(void*))
+                                     + sizeof(run_record);
+    if (counts_.size() * entry_size >= memory_limit_)
+    {
+        auto records = take_counts();
+        runs_.push_back(spill_run(records, temp_dir_, "mlp-chess-openings"));
+    }
+}
+
+void
+opening_tree_builder::write(std::filesystem::path const& file_path)
+{
+    auto in_memory = take_counts();
+    std::ranges::sort(in_memory);
+    // Merges the runs with the counts in memory, adding up the counts of each move, and calls visit with
+    // every position's moves, most played first
+    std::vector<move_stats> moves;
+    auto const for_each_position = [&](auto const& visit)
+    {
+        run_merger<run_record> merger(runs_, in_memory);
+        zobrist_hash position = 0;
+        moves.clear();
+        for (run_record record; merger.next(record);)
+        {
+            if (!moves.empty() && (record.position == position) && (record.move == moves.back().move.bits()))
+            {
+                auto& stats = moves.back();
+                add_count(stats.games, record.games);
+                add_count(stats.white_wins, record.white_wins);
+                add_count(stats.draws, record.draws);
+                add_count(stats.black_wins, record.black_wins);
+                continue;
+            }
+            if (!moves.empty() && (record.position != position))
+            {
+                std::ranges::sort(moves, more_played);
+                visit(position, moves);
+                moves.clear();
+            }
+            position = record.position;
+            moves.push_back({chess::packed_move(record.move), record.games, record.white_wins, record.draws,
+                             record.black_wins});
+        }
+        if (!moves.empty())
+        {
+            std::ranges::sort(moves, more_played);
+            visit(position, moves);
+        }
+    };
+
+    std::ofstream output;
+    output.exceptions(std::ios::badbit | std::ios::failbit);
+    output.open(file_path, std::ios::binary | std::ios::trunc);
+    // The records are formatted a buffer at a time, there can be billions of them
+    constexpr std::size_t flush_size = std::size_t{1} << 20;
+    std::vector<char> out(header_size); // Filled in once the counts are known
+    auto const flush = [&]
+    {
+        output.write(out.data(), static_cast<std::streamsize>(out.size()));
+        out.clear();
+    };
+    // The positions come before their moves, so the counts are merged twice: once for the positions, then
+    // for the moves
+    std::uint64_t position_count = 0;
+    std::uint64_t move_count = 0;
+    for_each_position([&](zobrist_hash const position, std::vector<move_stats> const& position_moves)
+    {
+        if (move_count + position_moves.size() > std::numeric_limits<std::uint32_t>::max())
+        {
+            throw std::runtime_error("Too many moves for an opening tree file");
+        }
+        append_le(out, position);
+        append_le(out, static_cast<std::uint32_t>(move_count));
+        append_le(out, static_cast<std::uint32_t>(position_moves.size()));
+        ++position_count;
+        move_count += position_moves.size();
+        if (out.size() >= flush_size)
+        {
+            flush();
+        }
+    });
+    for_each_position([&](zobrist_hash, std::vector<move_stats> const& position_moves)
+    {
+        for (auto const& stats: position_moves)
+        {
+            append_le(out, stats.move.bits());
+            append_le(out, std::uint16_t{0});
+            append_le(out, stats.games);
+            append_le(out, stats.white_wins);
+            append_le(out, stats.draws);
+            append_le(out, stats.black_wins);
+        }
+        if (out.size() >= flush_size)
+        {
+            flush();
+        }
+    });
+    flush();
+
+    out.insert(out.end(), opening_tree_format::magic.begin(), opening_tree_format::magic.end());
+    append_le(out, opening_tree_format::version);
+    append_le(out, std::uint32_t{max_plies_});
+    append_le(out, position_count);
+    append_le(out, move_count);
+    output.seekp(0);
+    flush();
+    remove_runs();
+}
+
+opening_tree::opening_tree(std::filesystem::path const& file_path):
+    file_(file_path)
+{
+    char const* const begin = file_.begin();
+    if ((file_.size() < header_size)
+        || (std::string_view(begin, opening_tree_format::magic.size()) != opening_tree_format::magic))
+    {
+        throw std::runtime_error("Not an opening tree file: " + file_path.string());
+    }
+    char const* ptr = begin + opening_tree_format::magic.size();
+    if (load_le<std::uint32_t>(ptr) != opening_tree_format::version)
+    {
+        throw std::runtime_error("Unsupported opening tree file version: " + file_path.string());
+    }
+    max_plies_ = load_le<std::uint32_t>(ptr + 4);
+    position_count_ = load_le<std::uint64_t>(ptr + 8);
+    move_count_ = load_le<std::uint64_t>(ptr + 16);
+    if ((file_.size() - header_size) / position_size < position_count_
+        || (file_.size() - header_size - (position_count_ * position_size)) / move_size < move_count_)
+    {
+        throw std::runtime_error("Truncated opening tree file: " + file_path.string());
+    }
+    positions_ = begin + header_size;
+    moves_ = positions_ + (position_count_ * position_size);
+}
+
+std::vector<move_stats>
+opening_tree::find(zobrist_hash const position) const
+{
+    // Binary search of the sorted position records, in place in the mapping
+    std::uint64_t low = 0;
+    std::uint64_t high = position_count_;
+    while (low < high)
+    {
+        std::uint64_t const mid = low + ((high - low) / 2);
+        if (load_le<zobrist_hash>(positions_ + (mid * position_size)) < position)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    std::vector<move_stats> moves;
+    char const* const record = positions_ + (low * position_size);
+    if ((low == position_count_) || (load_le<zobrist_hash>(record) != position))
+    {
+        return moves;
+    }
+    std::uint64_t const first = load_le<std::uint32_t>(record + 8);
+    std::uint64_t const count = load_le<std::uint32_t>(record + 12);
+    if (first + count > move_count_)
+    {
+        throw std::runtime_error("Corrupt opening tree file");
+    }
+    moves.reserve(count);
+    for (char const* ptr = moves_ + (first * move_size); count > moves.size(); ptr += move_size)
+    {
+        auto& stats = moves.emplace_back();
+        stats.move = chess::packed_move(load_le<std::uint16_t>(ptr));
+        stats.games = load_le<std::uint32_t>(ptr + 4);
+        stats.white_wins = load_le<std::uint32_t>(ptr + 8);
+        stats.draws = load_le<std::uint32_t>(ptr + 12);
+        stats.black_wins = load_le<std::uint32_t>(ptr + 16);
+    }
+    return moves;
+}
+
+} // namespace mlp::chess
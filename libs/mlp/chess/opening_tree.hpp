@@ -0,0 +1,141 @@
+#pragma once
+
+#include <mlp/chess/mapped_file.hpp>
+#include <mlp/chess/packed_move.hpp>
+#include <mlp/chess/zobrist.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mlp::chess
+{
+
+enum class game_result
+{
+    unknown,
+    white_wins,
+    draw,
+    black_wins,
+};
+
+// Maps a PGN Result tag value ("1-0", "0-1", "1/2-1/2") to a game_result. Anything else is unknown
+game_result to_game_result(std::string_view result_tag) noexcept;
+
+// How often a move was played in a position, and how those games ended. Games with an unknown result
+// are counted in `games` only.
+struct move_stats
+{
+    chess::packed_move move;
+    std::uint32_t games = 0;
+    std::uint32_t white_wins = 0;
+    std::uint32_t draws = 0;
+    std::uint32_t black_wins = 0;
+};
+
+// Opening tree file, sorted so positions are found with a binary search of the mapped file. All
+// integers are little endian.
+//
+//   header:     "MLPOPENT" | u32 version | u32 max plies | u64 position count | u64 move count
+//   positions:  { u64 hash | u32 first move | u32 move count }[position count], sorted by hash
+//   moves:      { u16 move | u16 reserved | u32 games | u32 white wins | u32 draws | u32 black wins }[move count]
+//
+// A position's moves are stored together, most played first.
+namespace opening_tree_format
+{
+constexpr std::string_view magic = "MLPOPENT";
+constexpr std::uint32_t version = 1;
+}
+
+// Counts the moves played in every position of the first max_plies plies of each game. Each thread
+// should add games to a builder of its own; the builders are then merged into one before writing.
+// The counts are kept in memory up to about memory_limit bytes, then sorted and spilled to a run file in
+// temp_dir; write() merges the runs, adding up the counts of the same move, so databases of any size fit
+class opening_tree_builder
+{
+public:
+    explicit opening_tree_builder(unsigned max_plies = 20, std::size_t memory_limit = std::size_t{256} << 20,
+                                  std::filesystem::path temp_dir = std::filesystem::temp_directory_path());
+    opening_tree_builder(opening_tree_builder&&) = default;
+    // Removes this builder's run files before taking the other's
+    opening_tree_builder& operator=(opening_tree_builder&& other) noexcept;
+    // Removes the run files
+    ~opening_tree_builder();
+
+    unsigned max_plies() const noexcept { return max_plies_; }
+    std::size_t memory_limit() const noexcept { return memory_limit_; }
+    // Moves counted in memory, since the last spill
+    std::size_t size() const noexcept { return counts_.size(); }
+    // Run files written so far, 0 as long as everything fits in memory
+    std::size_t spill_count() const noexcept { return runs_.size(); }
+
+    // positions[i] is the hash of the position moves[i] was played in, e.g. board::hash_history()
+    void add_game(std::span<zobrist_hash const> positions, std::span<chess::packed_move const> moves,
+                  game_result result);
+    // Adds the counts of another builder to this one, run files included, leaving the other empty
+    void merge(opening_tree_builder&& other);
+    // Writes the tree of the games added. Called once, the counts are consumed
+    void write(std::filesystem::path const& file_path);
+
+private:
+    struct key
+    {
+        zobrist_hash position;
+        std::uint16_t move;
+        friend bool operator==(key const&, key const&) noexcept = default;
+    };
+    struct key_hash
+    {
+        // Zobrist hashes are already uniformly distributed
+        std::size_t operator()(key const& k) const noexcept { return k.position ^ (k.move * 0x9e3779b97f4a7c15); }
+    };
+    // The counts of a move as spilled to run files, sorted by position and move
+    struct run_record
+    {
+        zobrist_hash position;
+        std::uint16_t move;
+        std::uint32_t games;
+        std::uint32_t white_wins;
+        std::uint32_t draws;
+        std::uint32_t black_wins;
+
+        friend auto operator<=>(run_record const&, run_record const&) = default;
+    };
+
+    // Moves the counts in memory to sorted records
+    std::vector<run_record> take_counts();
+    void spill_if_full();
+    void remove_runs() noexcept;
+
+    unsigned max_plies_;
+    std::size_t memory_limit_;
+    std::filesystem::path temp_dir_;
+    std::unordered_map<key, move_stats, key_hash> counts_;
+    std::vector<std::filesystem::path> runs_;
+};
+
+// Read-only view of an opening tree file. Lookups read the memory mapped file in place
+class opening_tree
+{
+public:
+    explicit opening_tree(std::filesystem::path const& file_path);
+
+    unsigned max_plies() const noexcept { return max_plies_; }
+    std::uint64_t position_count() const noexcept { return position_count_; }
+
+    // The moves played in a position, most played first. Empty if the position isn't in the tree
+    std::vector<move_stats> find(zobrist_hash position) const;
+
+private:
+    chess::mapped_file file_;
+    unsigned max_plies_ = 0;
+    std::uint64_t position_count_ = 0;
+    std::uint64_t move_count_ = 0;
+    char const* positions_ = nullptr;
+    char const* moves_ = nullptr;
+};
+
+} // namespace mlp::chess
@@ -0,0 +1,76 @@
+#include <mlp/chess/packed_move.hpp>
+
+#include <cctype>
+#include <ostream>
+
+namespace mlp::chess
+{
+
+namespace
+{
+
+constexpr piece_type promotion_pieces[] =
+{
+    piece_type::Knight, piece_type::Bishop, piece_type::Rook, piece_type::Queen
+};
+
+std::uint16_t
+promotion_code(piece_type const type) noexcept
+{
+    switch (type)
+    {
+        case piece_type::Bishop:
+            return 1;
+        case piece_type::Rook:
+            return 2;
+        case piece_type::Queen:
+            return 3;
+        default:
+            return 0;
+    }
+}
+
+} // anonymous namespace
+
+packed_move::packed_move(chess::square const& src, chess::square const& dest,
+                         piece_type const promotion) noexcept:
+    bits_(static_cast<std::uint16_t>(to_index(src) | (to_index(dest) << 6)))
+{
+    if (promotion != piece_type::None)
+    {
+        bits_ |= static_cast<std::uint16_t>((promotion_code(promotion) << 12)
+                                            | (static_cast<std::uint16_t>(kind::promotion) << 14));
+    }
+}
+
+packed_move
+packed_move::castling(piece_colour const side, bool const kingside) noexcept
+{
+    char const rank = (side == piece_colour::White) ? '1' : '8';
+    packed_move move(chess::square('e', rank), chess::square(kingside ? 'g' : 'c', rank));
+    move.bits_ |= static_cast<std::uint16_t>(kind::castling) << 14;
+    return move;
+}
+
+piece_type
+packed_move::promotion() const noexcept
+{
+    if (move_kind() != kind::promotion)
+    {
+        return piece_type::None;
+    }
+    return promotion_pieces[(bits_ >> 12) & 3];
+}
+
+std::ostream&
+operator<<(std::ostream& os, packed_move const move)
+{
+    os << move.src() << move.dest();
+    if (move.promotion() != piece_type::None)
+    {
+        os.put(static_cast<char>(std::tolower(static_cast<char>(move.promotion()))));
+    }
+    return os;
+}
+
+} // namespace mlp::chess
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <mlp/chess/piece.hpp>
+#include <mlp/chess/square.hpp>
+
+#include <cstdint>
+#include <iosfwd>
+
+namespace mlp::chess
+{
+
+// A fully resolved move in 16 bits:
+//
+//   bits  0-5   source square (a1 = 0, b1 = 1, ... h8 = 63)
+//   bits  6-11  destination square
+//   bits 12-13  promotion piece (Knight, Bishop, Rook, Queen) when the kind is promotion
+//   bits 14-15  move kind
+//
+// Castling is stored as the King's move (e.g. e1 to g1).
+class packed_move
+{
+public:
+    enum class kind: std::uint16_t
+    {
+        normal    = 0,
+        promotion = 1,
+        castling  = 2,
+    };
+
+    constexpr packed_move() noexcept = default;
+    constexpr explicit packed_move(std::uint16_t bits) noexcept: bits_(bits) {}
+    packed_move(chess::square const& src, chess::square const& dest,
+                piece_type promotion = piece_type::None) noexcept;
+    static packed_move castling(piece_colour side, bool kingside) noexcept;
+
+    constexpr std::uint16_t bits() const noexcept { return bits_; }
+    constexpr int src_index() const noexcept { return bits_ & 0x3f; }
+    constexpr int dest_index() const noexcept { return (bits_ >> 6) & 0x3f; }
+    constexpr kind move_kind() const noexcept { return static_cast<kind>(bits_ >> 14); }
+
+    chess::square src() const noexcept { return to_square(src_index()); }
+    chess::square dest() const noexcept { return to_square(dest_index()); }
+    piece_type promotion() const noexcept;
+    bool is_castling() const noexcept { return move_kind() == kind::castling; }
+    bool is_kingside_castling() const noexcept { return is_castling() && ((dest_index() & 7) == 6); }
+
+    static constexpr int to_index(chess::square const& sq) noexcept
+    {
+        return ((sq.rank - '1') * 8) + (sq.file - 'a');
+    }
+    static chess::square to_square(int const index) noexcept
+    {
+        return chess::square(static_cast<char>('a' + (index & 7)), static_cast<char>('1' + (index >> 3)));
+    }
+
+    friend constexpr bool operator==(packed_move, packed_move) noexcept = default;
+
+private:
+    std::uint16_t bits_ = 0;
+};
+
+static_assert(sizeof(packed_move) == 2);
+
+// Coordinate notation, e.g. e2e4, e1g1 (castling) or e7e8q
+std::ostream& operator<<(std::ostream& os, packed_move move);
+
+} // namespace mlp::chess
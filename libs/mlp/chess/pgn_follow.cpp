@@ -0,0 +1,239 @@
+#include <mlp/chess/pgn_follow.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mlp::chess::pgn
+{
+
+namespace
+{
+
+// An update reads at most this much, so catching up with a large file doesn't read it all into memory
+constexpr std::uint64_t max_update_size = std::uint64_t{16} << 20;
+
+bool
+is_result(std::string_view const token) noexcept
+{
+    return (token == "1-0") || (token == "0-1") || (token == "1/2-1/2") || (token == "*");
+}
+
+} // anonymous namespace
+
+std::size_t
+complete_games_size(std::string_view const text, bool const at_end) noexcept
+{
+    std::size_t complete = 0;
+    bool in_move_text = false;
+    bool in_comment = false;
+    for (std::size_t line_begin = 0; line_begin < text.size();)
+    {
+        std::size_t line_end = text.find('\n', line_begin);
+        if (line_end == std::string_view::npos)
+        {
+            if (!at_end)
+            {
+                // The last line is still being written
+                break;
+            }
+            line_end = text.size();
+        }
+        std::string_view line = text.substr(line_begin, line_end - line_begin);
+        if (!in_comment && (line.starts_with('[') || line.starts_with('%')))
+        {
+            if (in_move_text && line.starts_with('['))
+            {
+                // A game without a result, ended by the next game's tags
+                complete = line_begin;
+                in_move_text = false;
+            }
+            line_begin = line_end + 1;
+            continue;
+        }
+        // What the line ends with outside comments
+        std::size_t last_token_end = 0;
+        std::size_t last_token_begin = 0;
+        for (std::size_t i = 0; i < line.size(); ++i)
+        {
+            char const c = line[i];
+            if (in_comment)
+            {
+                in_comment = (c != '}');
+                continue;
+            }
+            if (c == '{')
+            {
+                in_comment = true;
+                last_token_end = 0;
+            }
+            else if (c == ';')
+            {
+                break;
+            }
+            else if ((c != ' ') && (c != '\t') && (c != '\r'))
+            {
+                if (last_token_end != i)
+                {
+                    last_token_begin = i;
+                }
+                last_token_end = i + 1;
+            }
+        }
+        if (last_token_end)
+        {
+            in_move_text = true;
+        }
+        if (in_move_text && !in_comment && last_token_end
+            && is_result(line.substr(last_token_begin, last_token_end - last_token_begin)))
+        {
+            complete = std::min(line_end + 1, text.size());
+            in_move_text = false;
+        }
+        line_begin = line_end + 1;
+    }
+    return complete;
+}
+
+follower::follower(std::filesystem::path const& file_path, std::uint64_t const offset):
+    file_path_(file_path),
+    fd_(::open(file_path.c_str(), O_RDONLY | O_CLOEXEC)),
+    games_offset_(offset)
+{
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("Could not open file: " + file_path.string() + ": " + std::strerror(errno));
+    }
+    // The watch is in place before the first update, so no modification after it goes unnoticed
+    inotify_fd_ = ::inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if ((inotify_fd_ >= 0) && (::inotify_add_watch(inotify_fd_, file_path.c_str(), IN_MODIFY | IN_CLOSE_WRITE) < 0))
+    {
+        ::close(inotify_fd_);
+        inotify_fd_ = -1;
+    }
+}
+
+follower::~follower()
+{
+    if (inotify_fd_ >= 0)
+    {
+        ::close(inotify_fd_);
+    }
+    ::close(fd_);
+}
+
+std::uint64_t
+follower::file_size() const
+{
+    struct stat st{};
+    if (::fstat(fd_, &st) != 0)
+    {
+        throw std::runtime_error("Could not stat file: " + file_path_.string() + ": " + std::strerror(errno));
+    }
+    return static_cast<std::uint64_t>(st.st_size);
+}
+
+std::string_view
+follower::update()
+{
+    return read_games(false);
+}
+
+std::string_view
+follower::finish()
+{
+    return read_games(true);
+}
+
+std::string_view
+follower::read_games(bool const at_end)
+{
+    // The games handed out last time are done with, the incomplete one moves to the front
+    pending_.erase(0, games_size_);
+    games_offset_ += games_size_;
+    games_size_ = 0;
+
+    std::uint64_t const read_offset = games_offset_ + pending_.size();
+    std::uint64_t const size = file_size();
+    if (size < read_offset)
+    {
+        throw std::runtime_error("File was truncated while it was followed: " + file_path_.string());
+    }
+    std::uint64_t const count = std::min(size - read_offset, max_update_size);
+    unread_ = (count < size - read_offset);
+    std::size_t used = pending_.size();
+    pending_.resize(used + count);
+    while (used < pending_.size())
+    {
+        ssize_t const read = ::pread(fd_, pending_.data() + used, pending_.size() - used,
+                                     static_cast<off_t>(games_offset_ + used));
+        if (read < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::runtime_error("Could not read file: " + file_path_.string() + ": " + std::strerror(errno));
+        }
+        if (read == 0)
+        {
+            break;
+        }
+        used += static_cast<std::size_t>(read);
+    }
+    pending_.resize(used);
+    // Only the end of the file is the end of the text
+    games_size_ = complete_games_size(pending_, at_end && !unread_);
+    return std::string_view(pending_.data(), games_size_);
+}
+
+bool
+follower::wait(std::chrono::milliseconds const timeout)
+{
+    if (unread_)
+    {
+        return true;
+    }
+    if (inotify_fd_ < 0)
+    {
+        // Without inotify the file size is polled
+        std::uint64_t const read_offset = games_offset_ + pending_.size();
+        auto const deadline = std::chrono::steady_clock::now() + timeout;
+        while (file_size() <= read_offset)
+        {
+            if ((timeout.count() >= 0) && (std::chrono::steady_clock::now() >= deadline))
+            {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        return true;
+    }
+    pollfd poll_fd{inotify_fd_, POLLIN, 0};
+    int const ready = ::poll(&poll_fd, 1, static_cast<int>(timeout.count()));
+    if (ready < 0)
+    {
+        if (errno == EINTR)
+        {
+            return true;
+        }
+        throw std::runtime_error("Could not wait for " + file_path_.string() + ": " + std::strerror(errno));
+    }
+    // The events only say that the file changed, update() finds out how
+    std::array<char, 4096> events;
+    while (::read(inotify_fd_, events.data(), events.size()) > 0)
+    {
+    }
+    return ready > 0;
+}
+
+} // namespace mlp::chess::pgn
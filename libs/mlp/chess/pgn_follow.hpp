@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace mlp::chess::pgn
+{
+
+// The length of the complete games at the start of `text`: up to the end of the line holding the
+// last game's result, or up to the tag section of a game that follows one without a result. What
+// comes after is a game still being written. With at_end, nothing more is coming: a result on a last
+// line without a newline completes its game too
+std::size_t complete_games_size(std::string_view text, bool at_end = false) noexcept;
+
+// Follows a PGN file that another program keeps appending games to, e.g. a live broadcast. Each
+// update() reads only the bytes appended since the previous one, so its cost doesn't depend on how
+// large the file has grown, and hands out the games completed in them. Catching up with a large file
+// takes several updates of up to 16 MiB. wait() blocks until the file
+// is modified, notified by inotify where available and polled otherwise.
+class follower
+{
+public:
+    // Starts at `offset`, the start of a game: 0, or the offset() reached by an earlier run
+    explicit follower(std::filesystem::path const& file_path, std::uint64_t offset = 0);
+    follower(follower const&) = delete;
+    follower& operator=(follower const&) = delete;
+    ~follower();
+
+    // The complete games appended since the last call, possibly none. Valid until the next call.
+    // Throws std::runtime_error if the file was truncated to before what was already read
+    std::string_view update();
+    // Like update(), once the file has gone idle: a last game whose result has no newline after it is
+    // taken as complete too
+    std::string_view finish();
+    // Blocks until the file is modified or the timeout, if not negative, expires. Returns false on timeout
+    bool wait(std::chrono::milliseconds timeout);
+
+    // File offset of the games update() returned last
+    std::uint64_t games_offset() const noexcept { return games_offset_; }
+    // File offset of the first byte not handed out yet: the start of the game being written, if any
+    std::uint64_t offset() const noexcept { return games_offset_ + games_size_; }
+
+private:
+    std::uint64_t file_size() const;
+    std::string_view read_games(bool at_end);
+
+    std::filesystem::path file_path_;
+    int fd_ = -1;
+    int inotify_fd_ = -1;            // -1 if inotify isn't available
+    std::string pending_;            // The bytes read from games_offset_ on
+    std::uint64_t games_offset_ = 0;
+    std::size_t games_size_ = 0;     // The complete games at the start of pending_
+    bool unread_ = false;            // The last update left part of the file to the next one
+};
+
+} // namespace mlp::chess::pgn
@@ -0,0 +1,218 @@
+#include <mlp/chess/pgn_index.hpp>
+#include <mlp/chess/compressed_file.hpp>
+#include <mlp/chess/pgn_scanner.hpp>
+#include <mlp/chess/utility.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+namespace mlp::chess::pgn
+{
+
+namespace
+{
+
+constexpr std::size_t header_size = game_index_format::magic.size() + 4 + 4 + 8 + 8 + 8;
+constexpr std::size_t record_size = 8 + 4 + 4;
+
+template<typename T>
+void
+append_le(std::vector<char>& out, T const value)
+{
+    T const le = to_little_endian(value);
+    auto const bytes = reinterpret_cast<char const*>(&le);
+    out.insert(out.end(), bytes, bytes + sizeof(le));
+}
+
+template<typename T>
+T
+load_le(char const* const ptr) noexcept
+{
+    T value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return to_little_endian(value);
+}
+
+// What an index records of its PGN file to tell whether it is out of date
+struct file_stamp
+{
+    std::uint64_t size = 0;
+    std::int64_t mtime = 0;
+};
+
+file_stamp
+stamp(std::filesystem::path const& file_path)
+{
+    return {std::filesystem::file_size(file_path),
+            static_cast<std::int64_t>(std::filesystem::last_write_time(file_path).time_since_epoch().count())};
+}
+
+// Header and game records of the index of `text`. Games are split as the parser splits them (see
+// pgn::game_boundary)
+std::vector<char>
+scan_games(std::string_view const text, file_stamp const& pgn_stamp)
+{
+    std::vector<char> index;
+    index.reserve(header_size + (text.size() / 256));
+    index.insert(index.end(), game_index_format::magic.begin(), game_index_format::magic.end());
+    append_le(index, game_index_format::version);
+    append_le(index, std::uint32_t{0});
+    append_le(index, pgn_stamp.size);
+    append_le(index, pgn_stamp.mtime);
+    append_le(index, std::uint64_t{0}); // Game count, filled in at the end
+
+    char const* const begin = text.data();
+    char const* const end = begin + text.size();
+    std::uint64_t game_count = 0;
+    char const* game = nullptr;
+    char const* move_text = nullptr;
+    auto const add_game = [&](char const* const game_end)
+    {
+        std::uint64_t const move_text_offset = (move_text ? move_text : game_end) - game;
+        std::uint64_t const size = game_end - game;
+        if (size > std::numeric_limits<std::uint32_t>::max())
+        {
+            throw std::runtime_error("Game too large to index at offset " + std::to_string(game - begin));
+        }
+        append_le(index, static_cast<std::uint64_t>(game - begin));
+        append_le(index, static_cast<std::uint32_t>(move_text_offset));
+        append_le(index, static_cast<std::uint32_t>(size));
+        ++game_count;
+    };
+    pgn::game_boundary boundary;
+    for (char const* line = begin; line != end;)
+    {
+        auto const newline = static_cast<char const*>(std::memchr(line, '\n', end - line));
+        auto const type = pgn::classify_line(*line);
+        if (boundary.next_line(type))
+        {
+            if (game)
+            {
+                add_game(line);
+            }
+            game = line;
+            move_text = nullptr;
+        }
+        if ((type == pgn::line_type::move_text) && !move_text)
+        {
+            move_text = line;
+        }
+        line = newline ? newline + 1 : end;
+    }
+    if (game)
+    {
+        add_game(end);
+    }
+    auto const count = to_little_endian(game_count);
+    std::memcpy(index.data() + header_size - sizeof(count), &count, sizeof(count));
+    return index;
+}
+
+void
+write_index(std::filesystem::path const& index_path, std::vector<char> const& index)
+{
+    // Written aside and renamed, so a reader never sees half an index
+    auto temp_path = index_path;
+    temp_path += ".tmp";
+    {
+        std::ofstream output;
+        output.exceptions(std::ios::badbit | std::ios::failbit);
+        output.open(temp_path, std::ios::binary | std::ios::trunc);
+        output.write(index.data(), static_cast<std::streamsize>(index.size()));
+    }
+    std::filesystem::rename(temp_path, index_path);
+}
+
+} // anonymous namespace
+
+game_index::game_index(std::filesystem::path const& pgn_path, std::filesystem::path index_path)
+{
+    if (chess::detect_compression(pgn_path) != chess::compression::none)
+    {
+        throw std::runtime_error("Compressed PGN files can't be indexed: " + pgn_path.string());
+    }
+    if (index_path.empty())
+    {
+        index_path = default_path(pgn_path);
+    }
+    file_stamp const pgn_stamp = stamp(pgn_path);
+    pgn_ = chess::mapped_file(pgn_path);
+
+    std::error_code error;
+    if (std::filesystem::exists(index_path, error))
+    {
+        index_ = chess::mapped_file(index_path);
+        char const* const begin = index_.data();
+        if ((index_.size() >= header_size)
+            && (std::string_view(begin, game_index_format::magic.size()) == game_index_format::magic))
+        {
+            char const* const ptr = begin + game_index_format::magic.size();
+            std::uint64_t const count = load_le<std::uint64_t>(ptr + 24);
+            if ((load_le<std::uint32_t>(ptr) == game_index_format::version)
+                && (load_le<std::uint64_t>(ptr + 8) == pgn_stamp.size)
+                && (load_le<std::int64_t>(ptr + 16) == pgn_stamp.mtime)
+                && ((index_.size() - header_size) / record_size == count)
+                && ((index_.size() - header_size) % record_size == 0))
+            {
+                records_ = begin + header_size;
+                game_count_ = count;
+                return;
+            }
+        }
+        index_.close();
+    }
+
+    rebuilt_ = true;
+    records_in_memory_ = scan_games(text(), pgn_stamp);
+    records_ = records_in_memory_.data() + header_size;
+    game_count_ = (records_in_memory_.size() - header_size) / record_size;
+    try
+    {
+        write_index(index_path, records_in_memory_);
+    }
+    catch (std::exception const&)
+    {
+        // E.g. a read-only directory. The index still serves this run
+    }
+}
+
+void
+game_index::build(std::filesystem::path const& pgn_path, std::filesystem::path const& index_path)
+{
+    file_stamp const pgn_stamp = stamp(pgn_path);
+    chess::mapped_file const pgn(pgn_path);
+    write_index(index_path, scan_games({pgn.data(), pgn.size()}, pgn_stamp));
+}
+
+std::filesystem::path
+game_index::default_path(std::filesystem::path const& pgn_path)
+{
+    auto index_path = pgn_path;
+    index_path += ".idx";
+    return index_path;
+}
+
+game_index::game
+game_index::at(std::uint64_t const n) const
+{
+    if (n >= game_count_)
+    {
+        // Reported from 1, as games are numbered everywhere else
+        throw std::out_of_range("No game " + std::to_string(n + 1) + " in an index of " + std::to_string(game_count_)
+                                + " games");
+    }
+    char const* const record = records_ + (n * record_size);
+    std::uint64_t const offset = load_le<std::uint64_t>(record);
+    std::uint64_t const size = load_le<std::uint32_t>(record + 12);
+    if (offset + size > pgn_.size())
+    {
+        throw std::runtime_error("Corrupt game index");
+    }
+    return {offset, offset + load_le<std::uint32_t>(record + 8), size};
+}
+
+} // namespace mlp::chess::pgn
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <mlp/chess/mapped_file.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+namespace mlp::chess::pgn
+{
+
+// Game index file, kept next to its PGN file. The PGN file's size and modification time are recorded,
+// and an index that no longer matches them is rebuilt. All integers are little endian.
+//
+//   header:  "MLPGAMIX" | u32 version | u32 reserved | u64 PGN size | i64 PGN mtime | u64 game count
+//   games:   { u64 game offset | u32 movetext offset from the game offset | u32 game size }[game count]
+namespace game_index_format
+{
+constexpr std::string_view magic = "MLPGAMIX";
+constexpr std::uint32_t version = 2;
+}
+
+// Where each game of an uncompressed PGN file starts, so any game can be parsed without reading the
+// ones before it (see parser::parse_game()). The games are found by scanning the file's lines, without
+// parsing any movetext, and split as the parser splits them (see pgn::game_boundary).
+class game_index
+{
+public:
+    struct game
+    {
+        std::uint64_t offset = 0;           // Start of the tag section
+        std::uint64_t move_text_offset = 0; // Start of the movetext
+        std::uint64_t size = 0;             // Up to the next game, trailing blank lines included
+    };
+
+    // Loads index_path, or builds it if it's missing or out of date. If it can't be written the index
+    // is kept in memory only. By default the index is the PGN path with ".idx" appended
+    explicit game_index(std::filesystem::path const& pgn_path, std::filesystem::path index_path = {});
+    game_index(game_index const&) = delete;
+    game_index& operator=(game_index const&) = delete;
+
+    // Writes the index of pgn_path to index_path, whether or not there is one already
+    static void build(std::filesystem::path const& pgn_path, std::filesystem::path const& index_path);
+    static std::filesystem::path default_path(std::filesystem::path const& pgn_path);
+
+    std::uint64_t size() const noexcept { return game_count_; }
+    // Game n, from 0. Throws std::out_of_range past the last game
+    game at(std::uint64_t n) const;
+    // The whole PGN text, mapped
+    std::string_view text() const noexcept { return {pgn_.data(), pgn_.size()}; }
+    // Whether the index had to be built, rather than loaded
+    bool rebuilt() const noexcept { return rebuilt_; }
+
+private:
+    chess::mapped_file pgn_;
+    chess::mapped_file index_;
+    std::vector<char> records_in_memory_; // When the index couldn't be written
+    char const* records_ = nullptr;
+    std::uint64_t game_count_ = 0;
+    bool rebuilt_ = false;
+};
+
+} // namespace mlp::chess::pgn
@@ -0,0 +1,47 @@
+#include <mlp/chess/pgn_move_tree.hpp>
+
+#include <stdexcept>
+
+namespace mlp::chess::pgn
+{
+
+move_tree::index_type
+move_tree::add(index_type const parent, pgn::player_move const& move)
+{
+    if (nodes_.size() >= no_node)
+    {
+        throw std::runtime_error("Too many moves in a game");
+    }
+    auto const index = static_cast<index_type>(nodes_.size());
+    // The first move from the initial position is the root, alternatives to it are its siblings
+    index_type sibling = (parent == no_node) ? root() : nodes_[parent].first_child;
+    if (sibling == no_node)
+    {
+        if (parent != no_node)
+        {
+            nodes_[parent].first_child = index;
+        }
+    }
+    else
+    {
+        while (nodes_[sibling].next_sibling != no_node)
+        {
+            sibling = nodes_[sibling].next_sibling;
+        }
+        nodes_[sibling].next_sibling = index;
+    }
+    nodes_.push_back(node{move, parent});
+    return index;
+}
+
+void
+move_tree::main_line(std::vector<pgn::player_move>& moves) const
+{
+    moves.clear();
+    for (index_type index = root(); index != no_node; index = nodes_[index].first_child)
+    {
+        moves.push_back(nodes_[index].move);
+    }
+}
+
+} // namespace mlp::chess::pgn
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <mlp/chess/pgn_playermove.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <vector>
+
+namespace mlp::chess::pgn
+{
+
+// A game's moves together with its recursive annotation variations. Nodes are stored in the order
+// they appear in the movetext, so node 0 is the first move of the main line. Each node links to
+// the move it is played after, to its continuations and to its alternatives: a node's first child
+// continues the line and the child's siblings are the variations that replace it.
+class move_tree
+{
+public:
+    using index_type = std::uint32_t;
+    static constexpr index_type no_node = std::numeric_limits<index_type>::max();
+
+    struct node
+    {
+        pgn::player_move move;
+        index_type parent = no_node;       // no_node for moves played from the initial position
+        index_type first_child = no_node;
+        index_type next_sibling = no_node;
+    };
+
+    explicit move_tree(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) noexcept:
+        nodes_(resource)
+    {
+    }
+
+    // Keeps the storage, so a tree reused from game to game stops allocating once it fits the longest game
+    void clear() noexcept { nodes_.clear(); }
+    bool empty() const noexcept { return nodes_.empty(); }
+    std::size_t size() const noexcept { return nodes_.size(); }
+    index_type root() const noexcept { return nodes_.empty() ? no_node : 0; }
+
+    node& operator[](index_type const index) noexcept { return nodes_[index]; }
+    node const& operator[](index_type const index) const noexcept { return nodes_[index]; }
+
+    // Adds a move played after `parent`, as the last alternative of that position. Returns its index
+    index_type add(index_type parent, pgn::player_move const& move);
+    // Copies the main line, the first child of every node from the root on
+    void main_line(std::vector<pgn::player_move>& moves) const;
+
+private:
+    std::pmr::vector<node> nodes_;
+};
+
+} // namespace mlp::chess::pgn
@@ -0,0 +1,297 @@
+#include <mlp/chess/pgn_parallel.hpp>
+#include <mlp/chess/compressed_file.hpp>
+#include <mlp/chess/mapped_file.hpp>
+#include <mlp/chess/pgn_parser.hpp>
+#include <mlp/chess/pgn_scanner.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace mlp::chess::pgn
+{
+
+namespace
+{
+
+char const*
+next_line(char const* const ptr, char const* const end) noexcept
+{
+    auto const eol = static_cast<char const*>(std::memchr(ptr, '\n', end - ptr));
+    return eol ? (eol + 1) : end;
+}
+
+struct game_error
+{
+    std::size_t games_before; // Number of the chunk's games output before this one
+    std::uint64_t offset;
+    std::string reason;
+};
+
+// The results of one chunk. All games of a chunk share one output buffer
+struct chunk_result
+{
+    std::string output;
+    std::vector<std::size_t> game_ends; // End offset of each game's output
+    std::vector<game_error> game_errors;
+    std::size_t skipped_games = 0;
+    std::exception_ptr error;
+    bool done = false;
+};
+
+thread_local unsigned current_worker_index = 0;
+
+} // anonymous namespace
+
+unsigned
+parallel_parser::worker_index() noexcept
+{
+    return current_worker_index;
+}
+
+parallel_parser::parallel_parser(unsigned const thread_count, std::size_t const chunk_size):
+    thread_count_(thread_count ? thread_count : std::max(1u, std::thread::hardware_concurrency())),
+    chunk_size_(std::max<std::size_t>(chunk_size, 1))
+{
+}
+
+void
+parallel_parser::set_filter(pgn::parser::game_filter filter)
+{
+    filter_ = std::move(filter);
+}
+
+void
+parallel_parser::set_error_handler(error_handler on_error)
+{
+    on_error_ = std::move(on_error);
+}
+
+void
+parallel_parser::set_progress_handler(progress_handler on_progress)
+{
+    on_progress_ = std::move(on_progress);
+}
+
+char const*
+parallel_parser::find_game_start(char const* const begin, char const* pos,
+                                 char const* const end) noexcept
+{
+    if (pos <= begin)
+    {
+        return begin;
+    }
+    if (pos >= end)
+    {
+        return end;
+    }
+    // Align to the start of a line
+    if (pos[-1] != '\n')
+    {
+        pos = next_line(pos, end);
+    }
+    // Whether pos is in a tag section or in movetext depends on the last tag or movetext line before it
+    pgn::game_boundary boundary;
+    for (char const* line_end = pos; line_end != begin;)
+    {
+        char const* line = line_end - 1;
+        while ((line != begin) && (line[-1] != '\n'))
+        {
+            --line;
+        }
+        auto const type = pgn::classify_line(*line);
+        if ((type == pgn::line_type::tag) || (type == pgn::line_type::move_text))
+        {
+            boundary.next_line(type);
+            break;
+        }
+        line_end = line;
+    }
+    for (; pos != end; pos = next_line(pos, end))
+    {
+        if (boundary.next_line(pgn::classify_line(*pos)))
+        {
+            return pos;
+        }
+    }
+    return end;
+}
+
+void
+parallel_parser::run(std::filesystem::path const& file_path,
+                     game_handler const& on_game, output_handler const& on_output,
+                     std::uint64_t const start_offset, std::size_t const first_game_id)
+{
+    if (chess::detect_compression(file_path) != chess::compression::none)
+    {
+        throw std::runtime_error("Compressed PGN files can only be parsed by a single thread: " + file_path.string());
+    }
+    chess::mapped_file const file(file_path);
+    skipped_games_ = 0;
+    char const* const begin = file.begin();
+    char const* const end = file.end();
+    std::size_t const start = std::min<std::uint64_t>(start_offset, file.size());
+    std::size_t const chunk_count = (file.size() - start + chunk_size_ - 1) / chunk_size_;
+    auto const chunk_start = [&](std::size_t const chunk)
+    {
+        std::size_t const offset = start + (chunk * chunk_size_);
+        if (chunk == 0)
+        {
+            return begin + start;
+        }
+        return (offset >= file.size()) ? end : find_game_start(begin, begin + offset, end);
+    };
+
+    // Results are kept in a ring of slots, which bounds how far workers can run ahead of the output
+    std::size_t const window = std::size_t{4} * thread_count_;
+    std::vector<chunk_result> slots(window);
+    std::mutex mutex;
+    std::condition_variable chunk_done;
+    std::condition_variable slot_free;
+    std::size_t next_chunk = 0;
+    std::size_t emitted_chunks = 0;
+    bool stop = false;
+
+    auto const worker = [&](unsigned const index)
+    {
+        current_worker_index = index;
+        pgn::parser parser;
+        parser.set_filter(filter_);
+        std::vector<pgn::player_move> moves;
+        while (true)
+        {
+            std::size_t chunk;
+            {
+                std::unique_lock lock(mutex);
+                slot_free.wait(lock, [&] { return stop || (next_chunk < emitted_chunks + window); });
+                if (stop || (next_chunk >= chunk_count))
+                {
+                    return;
+                }
+                chunk = next_chunk++;
+            }
+
+            auto& result = slots[chunk % window];
+            try
+            {
+                char const* const chunk_begin = chunk_start(chunk);
+                parser.open(chunk_begin, chunk_start(chunk + 1));
+                while (true)
+                {
+                    std::size_t const output_size = result.output.size();
+                    std::uint64_t const offset = parser.offset();
+                    try
+                    {
+                        if (!parser.next_game(moves))
+                        {
+                            break;
+                        }
+                        on_game(parser, moves, result.output);
+                        result.game_ends.push_back(result.output.size());
+                    }
+                    catch (std::exception const& e)
+                    {
+                        // Bad games are skipped as long as the parser got past them
+                        if (!on_error_ || (parser.offset() == offset))
+                        {
+                            throw;
+                        }
+                        result.output.resize(output_size);
+                        result.game_errors.push_back(game_error{result.game_ends.size(),
+                                                                (chunk_begin - begin) + parser.game_offset(),
+                                                                e.what()});
+                    }
+                }
+                result.skipped_games = parser.skipped_games();
+            }
+            catch (...)
+            {
+                result.error = std::current_exception();
+            }
+
+            {
+                std::lock_guard lock(mutex);
+                result.done = true;
+            }
+            chunk_done.notify_all();
+        }
+    };
+
+    std::vector<std::jthread> workers;
+    auto const stop_workers = [&]
+    {
+        {
+            std::lock_guard lock(mutex);
+            stop = true;
+        }
+        slot_free.notify_all();
+        workers.clear(); // Joins
+    };
+
+    try
+    {
+        for (unsigned i = 0; i < thread_count_; ++i)
+        {
+            workers.emplace_back(worker, i);
+        }
+
+        std::size_t game_id = first_game_id - 1;
+        for (std::size_t chunk = 0; chunk < chunk_count; ++chunk)
+        {
+            auto& result = slots[chunk % window];
+            {
+                std::unique_lock lock(mutex);
+                chunk_done.wait(lock, [&] { return result.done; });
+            }
+
+            std::size_t game_begin = 0;
+            auto error = result.game_errors.begin();
+            for (std::size_t game = 0; game <= result.game_ends.size(); ++game)
+            {
+                for (; (error != result.game_errors.end()) && (error->games_before == game); ++error)
+                {
+                    on_error_(error->offset, error->reason);
+                }
+                if (game < result.game_ends.size())
+                {
+                    std::size_t const game_end = result.game_ends[game];
+                    on_output(++game_id, std::string_view(result.output).substr(game_begin, game_end - game_begin));
+                    game_begin = game_end;
+                }
+            }
+            if (result.error)
+            {
+                std::rethrow_exception(result.error);
+            }
+            if (on_progress_)
+            {
+                on_progress_(static_cast<std::uint64_t>(chunk_start(chunk + 1) - begin), game_id);
+            }
+
+            skipped_games_ += result.skipped_games;
+            result.skipped_games = 0;
+            result.output.clear();
+            result.game_ends.clear();
+            result.game_errors.clear();
+            {
+                std::lock_guard lock(mutex);
+                result.done = false;
+                ++emitted_chunks;
+            }
+            slot_free.notify_all();
+        }
+    }
+    catch (...)
+    {
+        stop_workers();
+        throw;
+    }
+    stop_workers();
+}
+
+} // namespace mlp::chess::pgn
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <mlp/chess/pgn_parser.hpp>
+#include <mlp/chess/pgn_playermove.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mlp::chess::pgn
+{
+
+// Parses a single PGN file on a pool of worker threads.
+//
+// The memory mapped file is cut into fixed size chunks whose edges are moved forward to the next
+// game boundary, so every game belongs to exactly one chunk. Idle workers claim the next unclaimed
+// chunk, which keeps all threads busy however unevenly games are distributed. Only a bounded window
+// of chunks is in flight at a time, and their results are handed back in the original game order.
+class parallel_parser
+{
+public:
+    // Called on a worker thread for each game, with the worker's parser positioned on that game
+    // (e.g. for its tags). Anything appended to `output` is passed to the output handler for that game.
+    using game_handler = std::function<void(pgn::parser& parser, std::vector<pgn::player_move>& moves,
+                                            std::string& output)>;
+    // Called on the thread that called run(), once per game, in file order. Game ids start at 1
+    using output_handler = std::function<void(std::size_t game_id, std::string_view output)>;
+    // Called on the thread that called run(), in file order, for each game that failed to parse or
+    // whose game handler threw, with the byte offset of the game in the file
+    using error_handler = std::function<void(std::uint64_t offset, std::string_view reason)>;
+    // Called on the thread that called run() whenever every game before `offset` has been output.
+    // `game_id` is the id of the last game output
+    using progress_handler = std::function<void(std::uint64_t offset, std::size_t game_id)>;
+
+    // A thread_count of 0 uses every hardware thread
+    explicit parallel_parser(unsigned thread_count = 0, std::size_t chunk_size = default_chunk_size);
+
+    unsigned thread_count() const noexcept { return thread_count_; }
+    // Index (0 to thread_count() - 1) of the worker running the calling game handler, e.g. to select
+    // per-thread state without locking. 0 on any other thread
+    static unsigned worker_index() noexcept;
+
+    // Applied by every worker's parser, see parser::set_filter(). Must be safe to call concurrently
+    void set_filter(pgn::parser::game_filter filter);
+    // Number of games rejected by the filter during the last run()
+    std::size_t skipped_games() const noexcept { return skipped_games_; }
+    // With an error handler, bad games are reported to it and skipped instead of ending the run
+    void set_error_handler(error_handler on_error);
+    void set_progress_handler(progress_handler on_progress);
+
+    // Compressed files are rejected, they can only be read sequentially with pgn::parser.
+    // Unless there is an error handler, exceptions thrown by the game handler are rethrown from run()
+    // once every preceding game has been output, exactly as a sequential run would.
+    // Parsing starts at `start_offset`, which must be a game start such as a previous progress offset.
+    // Game ids then start at `first_game_id`.
+    void run(std::filesystem::path const& file_path,
+             game_handler const& on_game, output_handler const& on_output,
+             std::uint64_t start_offset = 0, std::size_t first_game_id = 1);
+
+    // Returns the first game start at or after `pos`, as pgn::game_boundary splits games
+    static char const* find_game_start(char const* begin, char const* pos, char const* end) noexcept;
+
+    static constexpr std::size_t default_chunk_size = std::size_t{1} << 20;
+
+private:
+    unsigned thread_count_;
+    std::size_t chunk_size_;
+    pgn::parser::game_filter filter_;
+    error_handler on_error_;
+    progress_handler on_progress_;
+    std::size_t skipped_games_ = 0;
+};
+
+} // namespace mlp::chess::pgn
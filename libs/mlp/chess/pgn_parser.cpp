@@ -1,10 +1,17 @@
 #include <mlp/chess/pgn_parser.hpp>
+#include <mlp/chess/pgn_san.hpp>
+#include <mlp/chess/pgn_scanner.hpp>
+#include <mlp/chess/stats.hpp>
 #include <mlp/chess/utility.hpp>
 
+#include <algorithm>
+#include <bit>
 #include <charconv>
+#include <cstring>
 #include <fstream>
 #include <iostream>
-#include <stack>
+#include <limits>
+#include <stdexcept>
 #include <variant>
 
 namespace mlp::chess::pgn
@@ -13,359 +20,654 @@ namespace mlp::chess::pgn
 namespace
 {
 
+bool
+skip_one(char const*& ptr, char const* const end, char const c)
+{
+    if ((ptr != end) && (*ptr == c))
+    {
+        ++ptr;
+        return true;
+    }
+    return false;
+}
+
 void
-remove_annotations(std::string& str)
+skip_to_end_of_line(char const*& ptr, char const* const end)
 {
-    std::stack<int> parens;
-    int out = 0;
-    for (int i = 0; i < str.size(); ++i)
+    auto const eol = static_cast<char const*>(std::memchr(ptr, '\n', end - ptr));
+    ptr = eol ? eol : end;
+}
+
+void
+skip_comment(char const*& ptr, char const* const end)
+{
+    // Brace comments don't nest, so the first closing brace ends the comment
+    auto const close = static_cast<char const*>(std::memchr(ptr, '}', end - ptr));
+    if (!close)
     {
-        if (str[i] == '(' || str[i] == '{')
-        {
-            parens.push(i);
-        }
-        else if (!parens.empty())
+        throw std::runtime_error ("PGN movetext ended with open parens (comments/annotations)");
+    }
+    ptr = close + 1;
+}
+
+// Skips a recursive annotation variation, including nested variations and any comments in them.
+// Only the structural characters found by the scanner are looked at.
+void
+skip_variation(char const*& ptr, char const* const end)
+{
+    int depth = 0;
+    while (ptr != end)
+    {
+        std::size_t const size = std::min<std::size_t>(structural_block::size, end - ptr);
+        auto const block = scan_block(ptr, size);
+        auto bits = block.open_paren | block.close_paren | block.open_brace | block.semicolon;
+        char const* resume = ptr + size;
+        while (bits)
         {
-            if (((str[i] == ')') && (str[parens.top()] == '('))
-                || ((str[i] == '}') && (str[parens.top()] == '{')))
+            char const* pos = ptr + std::countr_zero(bits);
+            bits &= bits - 1;
+            if (*pos == '(')
             {
-                parens.pop();
+                ++depth;
+            }
+            else if (*pos == ')')
+            {
+                if (--depth == 0)
+                {
+                    ptr = pos + 1;
+                    return;
+                }
+            }
+            else
+            {
+                // A comment may contain parens, so skip it and rescan from its end
+                (*pos == '{') ? skip_comment(pos, end) : skip_to_end_of_line(pos, end);
+                resume = pos;
+                break;
             }
         }
-        else
-        {
-            str[out++] = str[i];
-        }
+        ptr = resume;
     }
-    if (!parens.empty())
+    throw std::runtime_error ("PGN movetext ended with open parens (comments/annotations)");
+}
+
+// Skips everything that can separate two movetext tokens: whitespace (including line breaks),
+// brace and end of line comments, escaped lines and, unless they are wanted, recursive annotation
+// variations. This lets the movetext be tokenized directly from the raw file bytes.
+void
+skip_separators(char const*& ptr, char const* const end, bool const skip_variations = true)
+{
+    bool at_line_start = false;
+    while (ptr != end)
     {
-        throw std::runtime_error ("PGN movetext ended with open parens (comments/annotations)");
+        switch (*ptr)
+        {
+            case '\n':
+                at_line_start = true;
+                ++ptr;
+                continue;
+            case ' ':
+            case '\t':
+            case '\r':
+                ++ptr;
+                break;
+            case '{':
+                skip_comment(ptr, end);
+                break;
+            case ';':
+                skip_to_end_of_line(ptr, end);
+                break;
+            case '(':
+                if (!skip_variations)
+                {
+                    return;
+                }
+                skip_variation(ptr, end);
+                break;
+            case '$':
+                // Numeric annotation glyph
+                ++ptr;
+                while ((ptr != end) && (*ptr >= '0') && (*ptr <= '9'))
+                {
+                    ++ptr;
+                }
+                break;
+            case '!':
+            case '?':
+                // Move annotation standing apart from its move, e.g. "e4 !?"
+                ++ptr;
+                break;
+            case '%':
+                if (!at_line_start)
+                {
+                    return;
+                }
+                skip_to_end_of_line(ptr, end);
+                break;
+            default:
+                return;
+        }
+        at_line_start = false;
     }
-    str.resize(out);
 }
 
 bool
-skip_one(char const*& ptr, char const* const end, char const c)
+match_literal(char const*& begin, char const* const end, char const* str)
 {
-    if ((ptr != end) && (*ptr == c))
+    auto ptr = begin;
+    while (*str != '\0')
     {
+        if (ptr >= end || *ptr != *str)
+        {
+            return false;
+        }
         ++ptr;
-        return true;
+        ++str;
     }
-    return false;
+    begin = ptr;
+    return true;
 }
 
+// After a comment or variation PGN repeats the move number before Black's move, e.g. "3... a6"
 void
-skip_kleene_star(char const*& ptr, char const* const end, char const c)
+skip_black_move_number(char const*& begin, char const* const end)
 {
-    while ((ptr != end) && (*ptr == c))
+    auto ptr = begin;
+    unsigned move_id = 0;
+    auto const id_conv = std::from_chars(ptr, end, move_id);
+    if (id_conv.ec != std::errc{})
     {
-        ++ptr;
+        return; // Backtrack
+    }
+    ptr = id_conv.ptr;
+    if (!match_literal(ptr, end, "..."))
+    {
+        return; // Backtrack
     }
+    skip_separators(ptr, end);
+    begin = ptr; // Commit
 }
 
-void skip_ws(char const*& ptr, char const* const end)
+bool
+parse_game_result(char const*& begin, char const* const end)
 {
-    return skip_kleene_star(ptr, end, ' ');
+    return match_literal(begin, end, "1-0")
+           || match_literal(begin, end, "0-1")
+           || match_literal(begin, end, "1/2-1/2")
+           || match_literal(begin, end, "*");
 }
 
+// Skips a move number, e.g. "12." or "12...". Returns false if there is none
 bool
-parse_piece(char const*& ptr, char const* const end, chess::piece_type& piece)
+skip_move_number(char const*& begin, char const* const end)
 {
-    if (ptr == end) {
+    unsigned move_id = 0;
+    auto const id_conv = std::from_chars(begin, end, move_id);
+    if ((id_conv.ec != std::errc{}) || (id_conv.ptr == end) || (*id_conv.ptr != '.'))
+    {
         return false;
     }
-    switch (*ptr)
+    begin = id_conv.ptr;
+    while (skip_one(begin, end, '.'))
     {
-        case ' ':
-            break;
-        case 'B':
-        case 'K':
-        case 'N':
-        case 'Q':
-        case 'R':
-            piece = static_cast<chess::piece_type>(*ptr++);
-            return true;
     }
-    return false;
+    return true;
 }
 
-bool
-parse_file(char const*& ptr, char const* const end, char& file)
+piece_colour
+colour_of(pgn::player_move const& move) noexcept
 {
-    if (ptr == end) {
-        return false;
-    }
-    switch (*ptr)
-    {
-        case 'a':
-        case 'b':
-        case 'c':
-        case 'd':
-        case 'e':
-        case 'f':
-        case 'g':
-        case 'h':
-            file = *ptr++;
-            return true;
-        default:
-            return false;
-    }
+    return std::visit(overloaded([](auto const& m) { return m.colour; },
+                                 [](std::monostate const&) { return piece_colour::None; }), move);
 }
 
-bool
-parse_rank(char const*& ptr, char const* const end, char& rank)
+// Moves the text outside comments and variations to the front, returns where it ends
+char*
+strip_annotations(char* const begin, char const* const end) noexcept
 {
-    if (ptr == end) {
-        return false;
-    }
-    if ((*ptr >= '1') && (*ptr <= '8'))
+    char* out = begin;
+    char const* ptr = begin;
+    while (ptr != end)
     {
-        rank = *ptr++;
-        return true;
+        std::size_t const size = std::min<std::size_t>(structural_block::size, end - ptr);
+        auto const block = scan_block(ptr, size);
+        auto const bits = block.open_paren | block.open_brace;
+        std::size_t const plain = bits ? std::countr_zero(bits) : size;
+        std::memmove(out, ptr, plain);
+        out += plain;
+        ptr += plain;
+        if (bits)
+        {
+            (*ptr == '{') ? skip_comment(ptr, end) : skip_variation(ptr, end);
+        }
     }
-    return false;
+    return out;
 }
 
-bool
-parse_square(char const*& begin, char const* const end, char& file, char& rank)
+} //anonymous namespace
+
+void
+remove_annotations(std::string& str)
 {
-    return parse_file(begin, end, file) && parse_rank(begin, end, rank);
+    str.resize(strip_annotations(str.data(), str.data() + str.size()) - str.data());
 }
 
-bool
-parse_capture(char const*& begin, char const* const end, bool& capture)
+void
+remove_annotations(std::pmr::string& str)
+{
+    str.resize(strip_annotations(str.data(), str.data() + str.size()) - str.data());
+}
+
+parser::parser(std::pmr::memory_resource* const resource) noexcept:
+    line_(resource),
+    move_text_(resource),
+    tag_text_(resource),
+    variations_(resource),
+    tag_pairs_(resource)
 {
-    if ((begin != end) && (*begin == 'x'))
+}
+
+void
+parser::parse_file(std::filesystem::path const& file_path,
+                   std::vector<pgn::player_move>& moves)
+{
+    open(file_path);
+    if (!next_game(moves))
     {
-        ++begin;
-        capture = true;
-        return true;
+        moves.clear();
     }
-    return false;
+    close();
 }
 
-bool
-match_literal(char const*& begin, char const* const end, char const* str)
+void
+parser::open(std::filesystem::path const& file_path, input_mode const mode)
 {
-    auto ptr = begin;
-    while (*str != '\0')
+    if (!exists(file_path)) {
+        throw std::runtime_error("Could not open PGN file: " + absolute(file_path).string());
+    }
+
+    close();
+    // Compressed text can't be tokenized in place, so it is decompressed as a stream
+    auto const format = chess::detect_compression(file_path);
+    mode_ = (format == chess::compression::none) ? mode : input_mode::stream;
+    switch (mode_)
     {
-        if (ptr >= end || *ptr != *str)
-        {
-            return false;
-        }
-        ++ptr;
-        ++str;
+        case input_mode::stream:
+            if ((format == chess::compression::none)
+                && !chess::read_ahead_streambuf::worthwhile(file_path, read_ahead_options_))
+            {
+                file_.open(file_path.string());
+                input_.rdbuf(file_.rdbuf());
+            }
+            else if (format == chess::compression::none)
+            {
+                read_ahead_ = std::make_unique<chess::read_ahead_streambuf>(file_path, read_ahead_options_);
+                input_.rdbuf(read_ahead_.get());
+            }
+            else
+            {
+                decompressor_ = std::make_unique<chess::decompressing_streambuf>(file_path, format);
+                input_.rdbuf(decompressor_.get());
+            }
+            input_.exceptions(std::ios::badbit);
+            break;
+        case input_mode::mapped:
+            mapped_ = chess::mapped_file(file_path);
+            begin_ = mapped_.begin();
+            cursor_ = begin_;
+            end_ = mapped_.end();
+            break;
     }
-    begin = ptr;
-    return true;
 }
 
-bool
-parse_kingside_castling(char const*& begin, char const* const end, kingside_castling& kc)
+void
+parser::open(char const* const begin, char const* const end)
 {
-    return match_literal(begin, end, "O-O");
+    close();
+    mode_ = input_mode::mapped;
+    begin_ = begin;
+    cursor_ = begin;
+    end_ = end;
 }
 
 bool
-parse_queenside_castling(char const*& begin, char const* const end, queenside_castling& qc)
+parser::parse_game(pgn::game_index const& index, std::uint64_t const n, std::vector<pgn::player_move>& moves)
 {
-    return match_literal(begin, end, "O-O-O");
+    auto const game = index.at(n);
+    auto const text = index.text();
+    // The whole text up to the game's end, so the offsets stay those of the file
+    open(text.data(), text.data() + game.offset + game.size);
+    cursor_ = begin_ + game.offset;
+    return next_game(moves);
 }
 
 bool
-parse_pawn_promotion(char const*& begin, char const* const end, pgn::standard_move& move)
+parser::next_game(std::vector<pgn::player_move>& moves)
 {
-    auto ptr = begin;
-    if ((ptr == end) || !skip_one(ptr, end, '='))
+    moves.clear();
+    std::string_view move_text;
+    if (!next_move_text(move_text))
     {
-        return false; // Backtrack
+        return false;
     }
-    chess::piece_type piece = chess::piece_type::Pawn;
-    if ((ptr == end) || !parse_piece(ptr, end, piece)
-        || (piece == chess::piece_type::Pawn)) // Can't promote Pawn to Pawn (whitespace is detected as Pawn)
+    if (mode_ == input_mode::stream)
     {
-        return false; // Backtrack
+        // The joined lines are ours to modify. Mapped text is tokenized with the variations skipped in place
+        MLP_CHESS_TIME(strip_annotations);
+        remove_annotations(move_text_);
+        move_text = move_text_;
     }
-    move.promotion = piece;
-    begin = ptr; // Commit
+    {
+        MLP_CHESS_TIME(parse_moves);
+        parse_move_text(move_text.data(), move_text.data() + move_text.size(), moves);
+    }
+    MLP_CHESS_COUNT(games, 1);
+    MLP_CHESS_COUNT(plies, moves.size());
     return true;
 }
 
 bool
-parse_check_or_mate(char const*& begin, char const* const end, pgn::standard_move& move)
+parser::next_game(pgn::move_tree& tree)
 {
-    if (begin == end)
+    tree.clear();
+    std::string_view move_text;
+    if (!next_move_text(move_text))
     {
         return false;
     }
-    switch (*begin)
     {
-        case '+':
-            move.is_check = true;
-            ++begin;
-            return true;
-        case '#':
-            move.is_mate = true;
-            ++begin;
-            return true;
+        MLP_CHESS_TIME(parse_moves);
+        parse_move_tree(move_text.data(), move_text.data() + move_text.size(), tree);
     }
-    return false;
+    MLP_CHESS_COUNT(games, 1);
+    MLP_CHESS_COUNT(plies, tree.size());
+    return true;
 }
 
 bool
-parse_standard_move(char const*& begin, char const* const end, pgn::standard_move& move)
+parser::next_move_text(std::string_view& move_text)
 {
-    auto ptr = begin;
-    move.piece = chess::piece_type::Pawn;
-    if (!parse_piece(ptr, end, move.piece))
-    {
-        move.piece = piece_type::Pawn;
-    }
-    /*
-     * When disambiguating a player move, PGN uses the following rules:
-     *
-     * If two (or more) identical pieces can player move to the same square, PGN first tries to disambiguate using the
-     * file (column) of departure. If they share the same file but are on different ranks (rows), then the rank of
-     * departure is used to disambiguate.
-     *
-     * If the pieces are on the same file and rank (which would typically only occur in the case of pawns promoting
-     * and then one of the promoted pieces returning to the back rank, a very rare occurrence), then the piece is
-     * identified by _both_ file and rank of departure.
-     */
-    move.src.file = 0; // So we can detect failure
-    move.src.rank = 0;
-    parse_file(ptr, end, move.src.file); // Optional, so ignore failure
-    parse_rank(ptr, end, move.src.rank); // Optional, so ignore failure
-    move.is_capture = false;
-    parse_capture(ptr, end, move.is_capture); // Optional, so ignore failure
-    move.dest.file = 0; // So we can detect failure
-    move.dest.rank = 0;
-    if (!parse_square(ptr, end, move.dest.file, move.dest.rank))
-    {
-        // If we just saw a capture ('x') then a destination square should have followed
-        if (move.is_capture)
+    reset();
+#ifdef MLP_CHESS_STATS
+    std::uint64_t const start = offset();
+#endif
+    bool const found = (mode_ == input_mode::stream) ? next_stream_game(move_text) : next_mapped_game(move_text);
+    MLP_CHESS_COUNT(bytes_read, offset() - start);
+    return found;
+}
+
+bool
+parser::next_stream_game(std::string_view& move_text)
+{
+    pgn::game_boundary boundary;
+    bool skip_game = false;
+    while (line_pending_ || read_line())
+    {
+        line_pending_ = false;
+        auto const type = pgn::classify_line(line_.empty() ? '\n' : line_[0]);
+        bool const in_game = boundary.in_game();
+        bool const in_move_text = boundary.in_move_text();
+        if (boundary.next_line(type))
         {
-            move = pgn::standard_move{};
-            return false;
+            if (in_game)
+            {
+                if (!skip_game)
+                {
+                    line_pending_ = true;
+                    break;
+                }
+                // The skipped game is over, this line starts the next one
+                ++skipped_games_;
+                reset();
+                skip_game = false;
+            }
+            game_offset_ = line_offset_;
         }
-        // If we eagerly parsed the destination square as the departing square, then
-        // both file and rank must be present.
-        if (!move.src.file || !move.src.rank)
+        // Remove tag lines, blank lines and escaped lines
+        if (type == pgn::line_type::tag)
         {
-            move = pgn::standard_move{};
-            return false;
+            tag_text_ += line_;
+            tag_text_ += '\n';
+            continue;
         }
-        std::swap(move.dest.file, move.src.file);
-        std::swap(move.dest.rank, move.src.rank);
-    }
-    move.promotion = chess::piece_type::None;
-    parse_pawn_promotion(ptr, end, move);
-    move.is_check = false;
-    move.is_mate = false;
-    parse_check_or_mate(ptr, end, move);
-    begin = ptr; // Commit
+        if (type != pgn::line_type::move_text)
+        {
+            continue;
+        }
+        if (!in_move_text)
+        {
+            // All the tags have been read, so we can tell if the game is wanted
+            skip_game = !accept_game(tag_text_);
+        }
+        if (skip_game)
+        {
+            continue;
+        }
+        // Remove end of line comments
+        auto const semi_colon_pos = line_.rfind(';');
+        if (semi_colon_pos != std::string::npos)
+        {
+            line_.resize(semi_colon_pos);
+        }
+        while (!line_.empty() && ((line_.back() == ' ') || (line_.back() == '\r')))
+        {
+            line_.pop_back();
+        }
+        // Aggregate the player_move text
+        if (!line_.empty())
+        {
+            if (!move_text_.empty() && (line_.front() != ' '))
+                move_text_ += ' ';
+            move_text_ += line_;
+        }
+    }
+
+    if (!boundary.in_game())
+    {
+        return false;
+    }
+    if (skip_game || (!boundary.in_move_text() && !accept_game(tag_text_)))
+    {
+        ++skipped_games_;
+        return false;
+    }
+    move_text = move_text_;
     return true;
 }
 
 bool
-parse_single_move(char const*& begin, char const* const end, pgn::player_move& move)
+parser::next_mapped_game(std::string_view& move_text)
 {
-    auto ptr = begin;
-    if (parse_queenside_castling(ptr, end, move.emplace<pgn::queenside_castling>()))
+    // Find the extent of the next game without copying anything: the movetext runs from the first
+    // line after the tag section up to the next tag line (or the end of the input), as pgn::game_boundary
+    // splits games. Line starts are derived from the scanner's newline mask, so blocks of pure movetext
+    // are skipped with a few mask operations.
+    MLP_CHESS_TIME(read_lines);
+    char const* const end = end_;
+    while (true)
     {
-        move = queenside_castling{};
-        begin = ptr;
+        char const* ptr = cursor_;
+        char const* move_text_begin = nullptr;
+        char const* first_tag = nullptr;
+        char const* last_tag = nullptr;
+        char const* game_end = end;
+        std::uint64_t line_start_carry = 1; // The cursor is always at the start of a line
+        while (ptr != end)
+        {
+            std::size_t const size = std::min<std::size_t>(structural_block::size, end - ptr);
+            auto const block = scan_block(ptr, size);
+            std::uint64_t const in_block = (size == structural_block::size) ? ~std::uint64_t{0}
+                                                                             : ((std::uint64_t{1} << size) - 1);
+            std::uint64_t const line_starts = ((block.newline << 1) | line_start_carry) & in_block;
+            line_start_carry = block.newline >> (structural_block::size - 1);
+            std::uint64_t tag_lines = line_starts & block.open_bracket;
+            if (!move_text_begin)
+            {
+                std::uint64_t const text_lines = pgn::move_text_lines(block, line_starts);
+                std::uint64_t const before_text = text_lines ? ((text_lines & -text_lines) - 1) : ~std::uint64_t{0};
+                if (std::uint64_t const tags = tag_lines & before_text)
+                {
+                    first_tag = first_tag ? first_tag : (ptr + std::countr_zero(tags));
+                    last_tag = ptr + (63 - std::countl_zero(tags));
+                }
+                if (text_lines)
+                {
+                    move_text_begin = ptr + std::countr_zero(text_lines);
+                }
+                tag_lines &= ~before_text;
+            }
+            if (move_text_begin && tag_lines)
+            {
+                game_end = ptr + std::countr_zero(tag_lines);
+                break;
+            }
+            ptr += size;
+        }
+        cursor_ = game_end;
+
+        if (!first_tag && !move_text_begin)
+        {
+            return false;
+        }
+        game_offset_ = static_cast<std::uint64_t>((first_tag ? first_tag : move_text_begin) - begin_);
+        std::string_view tag_section;
+        if (first_tag)
+        {
+            skip_to_end_of_line(last_tag, end);
+            tag_section = std::string_view(first_tag, (last_tag == end) ? end : (last_tag + 1));
+        }
+        if (!accept_game(tag_section))
+        {
+            ++skipped_games_;
+            continue;
+        }
+        if (move_text_begin)
+        {
+            move_text = std::string_view(move_text_begin, game_end);
+        }
         return true;
     }
-    else if (parse_kingside_castling(ptr, end, move.emplace<pgn::kingside_castling>()))
+}
+
+bool
+parser::read_line()
+{
+    MLP_CHESS_TIME(read_lines);
+    line_offset_ = read_offset_;
+    if (!std::getline(input_, line_))
+    {
+        return false;
+    }
+    // The last line may end without a line break
+    read_offset_ += line_.size() + (input_.eof() ? 0 : 1);
+    return true;
+}
+
+std::uint64_t
+parser::offset() const noexcept
+{
+    if (mode_ == input_mode::mapped)
     {
-        move = kingside_castling{};
-        begin = ptr;
-        return true;
+        return static_cast<std::uint64_t>(cursor_ - begin_);
     }
-    else if (parse_standard_move(ptr, end, move.emplace<pgn::standard_move>()))
+    return line_pending_ ? line_offset_ : read_offset_;
+}
+
+void
+parser::seek(std::uint64_t const offset)
+{
+    reset();
+    line_pending_ = false;
+    if (mode_ == input_mode::mapped)
     {
-        begin = ptr;
-        return true;
+        cursor_ = begin_ + std::min<std::uint64_t>(offset, end_ - begin_);
+        return;
+    }
+    if (decompressor_)
+    {
+        // Compressed text can't be seeked, it is decompressed and dropped up to the offset
+        for (std::uint64_t left = offset; left && input_;)
+        {
+            auto const count = std::min<std::uint64_t>(left, std::numeric_limits<std::streamsize>::max());
+            input_.ignore(static_cast<std::streamsize>(count));
+            left -= count;
+        }
     }
     else
     {
-        move = std::monostate{};
-        return false;
+        input_.clear();
+        input_.seekg(static_cast<std::streamoff>(offset));
     }
+    read_offset_ = offset;
+    line_offset_ = offset;
 }
 
 bool
-parse_game_result(char const*& begin, char const* const end)
+parser::accept_game(std::string_view const tag_section)
 {
-    return match_literal(begin, end, "1-0")
-           || match_literal(begin, end, "0-1")
-           || match_literal(begin, end, "1/2-1/2")
-           || match_literal(begin, end, "*");
+    tag_section_ = tag_section;
+    tag_pairs_parsed_ = false;
+    if (!filter_)
+    {
+        return true;
+    }
+    return filter_(tags());
 }
 
-} //anonymous namespace
-
-parser::parser() noexcept
+pgn::tag_pairs const&
+parser::tags()
 {
+    if (!tag_pairs_parsed_)
+    {
+        tag_pairs_.parse(tag_section_);
+        tag_pairs_parsed_ = true;
+    }
+    return tag_pairs_;
 }
 
 void
-parser::parse_file(std::filesystem::path const& file_path,
-                   std::vector<pgn::player_move>& moves)
+parser::set_filter(game_filter filter)
 {
-    if (!exists(file_path)) {
-        throw std::runtime_error("Could not open PGN file: " + absolute(file_path).string());
-    }
-
-    std::ifstream ifs;
-    ifs.exceptions(std::ios::badbit);
-    ifs.open(file_path.string());
-    reset();
+    filter_ = std::move(filter);
+}
 
+void
+parser::close()
+{
+    // Detaching the stream buffer sets badbit, which must not throw
+    input_.exceptions(std::ios::goodbit);
+    input_.rdbuf(nullptr);
+    decompressor_.reset();
+    read_ahead_.reset();
+    if (file_.is_open())
     {
-        std::string line;
-        while (std::getline(ifs, line))
-        {
-            // Remove tag lines
-            if (line.empty() || (line[0] == '['))
-            {
-                continue;
-            }
-            // Remove end of line comments
-            auto const semi_colon_pos = line.rfind(';');
-            if (semi_colon_pos != std::string::npos)
-            {
-                line.resize(semi_colon_pos);
-            }
-            while (!line.empty() && line.back() == ' ')
-            {
-                line.pop_back();
-            }
-            // Aggregate the player_move text
-            if (!line.empty())
-            {
-                if (!move_text_.empty() && (line.front() != ' '))
-                    move_text_ += ' ';
-                move_text_ += line;
-            }
-        }
+        file_.close();
     }
+    file_.clear();
+    line_pending_ = false;
+    skipped_games_ = 0;
+    mapped_.close();
+    begin_ = nullptr;
+    cursor_ = nullptr;
+    end_ = nullptr;
+    read_offset_ = 0;
+    line_offset_ = 0;
+    game_offset_ = 0;
+}
 
-    remove_annotations(move_text_);
+void
+parser::parse_move_text(char const* const begin, char const* const end,
+                        std::vector<pgn::player_move>& moves)
+{
 #ifdef MLP_CHESS_DEBUG
-    std::cout << "Movetext: " << move_text_ << std::endl;
+    std::cout << "Movetext: " << std::string_view(begin, end) << std::endl;
 #endif
 
-    char const* mt_itr = move_text_.data();
-    char const* const mt_end = mt_itr + move_text_.size();
+    char const* mt_itr = begin;
     unsigned int move_id = 0;
     pgn::player_move white_move, black_move;
-    moves.clear();
 
-    while (parse_move(mt_itr, mt_end, move_id, white_move, black_move))
+    while (parse_move(mt_itr, end, move_id, white_move, black_move))
     {
 #ifdef MLP_CHESS_DEBUG
         std::cout << "Parsed Move: " << move_id << ": " << white_move << ", " << black_move << "\n";
@@ -373,13 +675,82 @@ parser::parse_file(std::filesystem::path const& file_path,
         moves.push_back(white_move);
         moves.push_back(black_move);
     }
-    skip_ws(mt_itr, mt_end);
-    parse_game_result(mt_itr, mt_end);
-    if (std::distance(mt_itr, mt_end) > 0)
+    skip_separators(mt_itr, end);
+    parse_game_result(mt_itr, end);
+    skip_separators(mt_itr, end);
+    if (std::distance(mt_itr, end) > 0)
     {
-        throw std::runtime_error("Failed to parse movetext: " + std::string(mt_itr));
+        throw std::runtime_error("Failed to parse movetext: " + std::string(mt_itr, end));
+    }
+}
+
+void
+parser::parse_move_tree(char const* const begin, char const* const end, pgn::move_tree& tree)
+{
+    // The move leading to the position the next move is played from, no_node for the initial position
+    auto position = pgn::move_tree::no_node;
+    // The positions to go back to at the end of each open variation
+    auto& variations = variations_;
+    variations.clear();
+    char const* ptr = begin;
+    while (true)
+    {
+        skip_separators(ptr, end, false);
+        if (ptr == end)
+        {
+            break;
+        }
+        if (*ptr == '(')
+        {
+            // A variation replaces the move before it, so it starts from the position that move was played in
+            if (position == pgn::move_tree::no_node)
+            {
+                throw std::runtime_error("PGN variation before any move: " + std::string(ptr, end));
+            }
+            variations.push_back(position);
+            position = tree[position].parent;
+            ++ptr;
+            continue;
+        }
+        if (*ptr == ')')
+        {
+            if (variations.empty())
+            {
+                throw std::runtime_error("PGN variation closed but never opened: " + std::string(ptr, end));
+            }
+            position = variations.back();
+            variations.pop_back();
+            ++ptr;
+            continue;
+        }
+        if (skip_move_number(ptr, end))
+        {
+            continue;
+        }
+        if (variations.empty() && parse_game_result(ptr, end))
+        {
+            break;
+        }
+        pgn::player_move move;
+        if (!pgn::parse_san(ptr, end, move))
+        {
+            throw std::runtime_error("Failed to parse movetext: " + std::string(ptr, end));
+        }
+        bool const white = (position == pgn::move_tree::no_node)
+                        || (colour_of(tree[position].move) == piece_colour::Black);
+        std::visit(overloaded([&](auto& m) { m.colour = white ? piece_colour::White : piece_colour::Black; },
+                              [](std::monostate&) {}), move);
+        position = tree.add(position, move);
+    }
+    if (!variations.empty())
+    {
+        throw std::runtime_error("PGN movetext ended with open parens (comments/annotations)");
+    }
+    skip_separators(ptr, end);
+    if (ptr != end)
+    {
+        throw std::runtime_error("Failed to parse movetext: " + std::string(ptr, end));
     }
-    move_text_.clear();
 }
 
 bool
@@ -388,7 +759,7 @@ parser::parse_move(char const*& begin, const char *end,
                    pgn::player_move& white_move, pgn::player_move& black_move)
 {
     auto ptr = begin;
-    skip_ws(ptr, end);
+    skip_separators(ptr, end);
     auto id_conv = std::from_chars(ptr, end, move_id);
     if (id_conv.ec != std::errc{}) {
         return false;
@@ -397,15 +768,16 @@ parser::parse_move(char const*& begin, const char *end,
     if (!skip_one(ptr, end, '.')) {
         return false;
     }
-    skip_ws(ptr, end);
-    if (!parse_single_move(ptr, end, white_move))
+    skip_separators(ptr, end);
+    if (!pgn::parse_san(ptr, end, white_move))
     {
         return false;
     }
     std::visit (overloaded([](auto& move) { move.colour = piece_colour::White; },
                                   [](std::monostate&){}), white_move);
-    skip_ws(ptr, end);
-    if (!parse_single_move(ptr, end, black_move))
+    skip_separators(ptr, end);
+    skip_black_move_number(ptr, end);
+    if (!pgn::parse_san(ptr, end, black_move))
     {
         if (parse_game_result(ptr, end))
         {
@@ -424,6 +796,9 @@ void
 parser::reset()
 {
     move_text_.clear();
+    tag_text_.clear();
+    tag_section_ = {};
+    tag_pairs_parsed_ = false;
 }
 
 } // namespace mlp::chess::pgn
@@ -1,22 +1,92 @@
 #pragma once
 
+#include <mlp/chess/compressed_file.hpp>
+#include <mlp/chess/mapped_file.hpp>
+#include <mlp/chess/read_ahead_file.hpp>
+#include <mlp/chess/pgn_index.hpp>
+#include <mlp/chess/pgn_move_tree.hpp>
 #include <mlp/chess/pgn_playermove.hpp>
+#include <mlp/chess/pgn_tags.hpp>
 
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace mlp::chess::pgn
 {
 
+enum class input_mode
+{
+    stream, // Read line by line through an std::istream
+    mapped, // Memory map the file and tokenize the mapped bytes in place. Compressed files are always streamed
+};
+
+// Strips comments and variations from movetext that has been joined into a single line
+void remove_annotations(std::string& move_text);
+void remove_annotations(std::pmr::string& move_text);
+
 class parser
 {
 public:
-    parser() noexcept;
+    // Decides from a game's tags whether the game is wanted
+    using game_filter = std::function<bool(pgn::tag_pairs const& tags)>;
+
+    // The parser's buffers are allocated from `resource`. They grow to fit the largest line and game seen
+    // and are then reused, so once warmed up the parser allocates nothing while it parses games
+    explicit parser(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) noexcept;
 
+    // Parses the first game in a PGN file
     void parse_file(std::filesystem::path const& file_path,
                     std::vector<pgn::player_move>& moves);
 
+    // Streaming interface for PGN databases: open() a file, then pull one game at a time with
+    // next_game() until it returns false. Only one game is held in memory at any time, and the
+    // internal buffers are reused from game to game.
+    // gzip, bzip2 and zstd compressed files are recognised by their magic bytes and decompressed on
+    // a background thread while the games are parsed.
+    // Uncompressed files are streamed with reads of options.block_size bytes kept options.depth deep
+    // in flight (see chess::read_ahead_streambuf)
+    void open(std::filesystem::path const& file_path, input_mode mode = input_mode::stream);
+    // Parses games from a PGN text that is already in memory. The text must outlive the parser
+    void open(char const* begin, char const* end);
+    bool next_game(std::vector<pgn::player_move>& moves);
+    // Like next_game() above, but keeps the recursive annotation variations as branches of the tree
+    bool next_game(pgn::move_tree& tree);
+    // Parses game n of an indexed file without reading the games before it, e.g. to show any game of a
+    // large database at once. Offsets are those of the file; next_game() then returns false until the
+    // parser is opened again. Returns false if the filter rejects the game
+    bool parse_game(pgn::game_index const& index, std::uint64_t n, std::vector<pgn::player_move>& moves);
+    void close();
+    // Applies to the files opened afterwards
+    void set_read_ahead(chess::read_ahead_options const& options) noexcept { read_ahead_options_ = options; }
+
+    // Byte offsets in the (decompressed) text. game_offset() is where the game last returned by
+    // next_game(), or the one whose movetext it failed to parse, starts. offset() is where the next game
+    // starts, i.e. how far the input has been consumed.
+    std::uint64_t game_offset() const noexcept { return game_offset_; }
+    std::uint64_t offset() const noexcept;
+    // Continues reading at an offset previously returned by offset(), e.g. to resume an interrupted
+    // run. Compressed input is decompressed and dropped up to the offset
+    void seek(std::uint64_t offset);
+
+    // The raw tag pair lines of the game last returned by next_game(). Valid until the next call
+    std::string_view tag_section() const noexcept { return tag_section_; }
+    // The parsed tags of the game last returned by next_game(). Parsed on first use
+    pgn::tag_pairs const& tags();
+
+    // next_game() skips games rejected by the filter. The filter runs as soon as a game's tags have
+    // been read, so the movetext of skipped games is never parsed.
+    void set_filter(game_filter filter);
+    std::size_t skipped_games() const noexcept { return skipped_games_; }
+
     static bool parse_move(char const*& begin, char const* end,
                            unsigned& move_id,
                            pgn::player_move& white_move,
@@ -24,7 +94,40 @@ public:
     void reset();
 
 private:
-    std::string move_text_;
+    bool read_line();
+    // Finds the next wanted game and the extent of its movetext, comments and variations included
+    bool next_move_text(std::string_view& move_text);
+    bool next_stream_game(std::string_view& move_text);
+    bool next_mapped_game(std::string_view& move_text);
+    static void parse_move_text(char const* begin, char const* end,
+                                std::vector<pgn::player_move>& moves);
+    void parse_move_tree(char const* begin, char const* end, pgn::move_tree& tree);
+    bool accept_game(std::string_view tag_section);
+
+private:
+    input_mode mode_ = input_mode::stream;
+    std::ifstream file_;
+    std::unique_ptr<chess::decompressing_streambuf> decompressor_;
+    chess::read_ahead_options read_ahead_options_;
+    std::unique_ptr<chess::read_ahead_streambuf> read_ahead_;
+    std::istream input_{nullptr}; // Reads from file_, read_ahead_ or decompressor_
+    chess::mapped_file mapped_;
+    char const* begin_ = nullptr; // Start of the mapped/in-memory text
+    char const* cursor_ = nullptr; // Read position within the mapped/in-memory text
+    char const* end_ = nullptr;
+    std::uint64_t read_offset_ = 0; // Bytes of the stream consumed
+    std::uint64_t line_offset_ = 0; // Where line_ starts
+    std::uint64_t game_offset_ = 0;
+    std::pmr::string line_;
+    bool line_pending_ = false; // line_ holds the first tag line of the next game
+    std::pmr::string move_text_;
+    std::pmr::string tag_text_;
+    std::pmr::vector<pgn::move_tree::index_type> variations_; // Nodes that open variations are played after
+    std::string_view tag_section_;
+    pgn::tag_pairs tag_pairs_;
+    bool tag_pairs_parsed_ = false;
+    game_filter filter_;
+    std::size_t skipped_games_ = 0;
 };
 
 } // namespace mlp::chess::pgn
@@ -0,0 +1,194 @@
+#include <mlp/chess/pgn_replay.hpp>
+#include <mlp/chess/utility.hpp>
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace mlp::chess::pgn
+{
+
+namespace
+{
+
+// Only a pawn reaching the last rank promotes, and only to a knight, bishop, rook or queen
+bool
+is_valid_promotion(pgn::standard_move const& move) noexcept
+{
+    if (move.promotion == chess::piece_type::None)
+    {
+        return true;
+    }
+    char const last_rank = (move.colour == chess::piece_colour::White) ? '8' : '1';
+    return (move.piece == chess::piece_type::Pawn) && (move.dest.rank == last_rank)
+        && ((move.promotion == chess::piece_type::Knight) || (move.promotion == chess::piece_type::Bishop)
+            || (move.promotion == chess::piece_type::Rook) || (move.promotion == chess::piece_type::Queen));
+}
+
+// Finds the source square of a move and packs it
+chess::packed_move
+resolve(chess::board& board, pgn::player_move& move_var)
+{
+    return std::visit(chess::overloaded
+    (
+        [&](pgn::standard_move& move)
+        {
+            if (!board.identify_moving_piece(move.colour, move.piece, move.src, move.dest, move.is_capture))
+            {
+                std::ostringstream oss;
+                oss << "Failed to find piece to make move " << board.fullmove_number() << ": " << move;
+                throw std::runtime_error(oss.str());
+            }
+            if (!is_valid_promotion(move))
+            {
+                std::ostringstream oss;
+                oss << "Invalid promotion in move " << board.fullmove_number() << ": " << move;
+                throw std::runtime_error(oss.str());
+            }
+            if (!move.is_capture && !board.empty_at(move.dest))
+            {
+                throw std::runtime_error("Move to occupied square, but no capture was declared");
+            }
+            return chess::packed_move(move.src, move.dest, move.promotion);
+        },
+        [&](pgn::kingside_castling const& move)
+        {
+            return chess::packed_move::castling(move.colour, true);
+        },
+        [&](pgn::queenside_castling const& move)
+        {
+            return chess::packed_move::castling(move.colour, false);
+        },
+        [](std::monostate const&) -> chess::packed_move
+        {
+            throw std::runtime_error("Empty move in a move tree");
+        }
+    ), move_var);
+}
+
+} // anonymous namespace
+
+void
+replay(chess::board& board, std::vector<pgn::player_move>& moves)
+{
+#ifdef MLP_CHESS_DEBUG
+    std::cout << "\nMove 0:\n" << board << "\n";
+#endif
+
+    int move_id = 2;
+    for (auto& move_var: moves)
+    {
+#ifdef MLP_CHESS_DEBUG
+        std::cout << "\nMove " << (move_id/2) << ": " <<  move_var << "\n";
+#endif
+
+        std::visit(chess::overloaded
+        (
+            [&](pgn::standard_move& move)
+            {
+                if (!board.identify_moving_piece(move.colour, move.piece,
+                                                 move.src, move.dest, move.is_capture))
+                {
+                    std::ostringstream oss;
+                    oss << "Failed to find piece to make move " << (move_id / 2) << ": " << move;
+                    throw std::runtime_error(oss.str());
+                }
+                if (!is_valid_promotion(move))
+                {
+                    std::ostringstream oss;
+                    oss << "Invalid promotion in move " << (move_id / 2) << ": " << move;
+                    throw std::runtime_error(oss.str());
+                }
+#ifdef MLP_CHESS_DEBUG
+                std::cout << "Move " << (move_id/2) << ": " << move <<  "\n";
+#endif
+                board.move(move.src, move.dest, move.is_capture, move.promotion);
+            },
+            [&](pgn::kingside_castling& move)
+            {
+                board.perform_kingside_castling(move.colour);
+            },
+            [&](pgn::queenside_castling& move)
+            {
+                board.perform_queenside_castling(move.colour);
+            },
+            [](auto& other) {} // no op
+        ), move_var);
+
+#ifdef MLP_CHESS_DEBUG
+        std::cout << board;
+#endif
+        ++move_id;
+    }
+}
+
+void
+replay(chess::board& board, pgn::move_tree& tree, tree_visitor const& visit, chess::board* main_line_end)
+{
+    // The moves from the initial position to the current one, with what it takes to undo them. The
+    // storage is kept for the thread's next tree, and taken while in use in case the visitor replays one
+    using line_type = std::vector<std::pair<pgn::move_tree::index_type, chess::board::undo_record>>;
+    thread_local line_type spare_line;
+    line_type line = std::move(spare_line);
+    line.clear();
+    auto next = tree.root();
+    while (true)
+    {
+        while (next != pgn::move_tree::no_node)
+        {
+            line.emplace_back(next, board.make(resolve(board, tree[next].move)));
+            if (visit)
+            {
+                visit(next, board);
+            }
+            next = tree[next].first_child;
+        }
+        if (main_line_end)
+        {
+            // The first line played is the main line
+            *main_line_end = board;
+            main_line_end = nullptr;
+        }
+        // Take moves back up to the closest one with an alternative left to play
+        while (!line.empty() && (next == pgn::move_tree::no_node))
+        {
+            board.unmake(line.back().second);
+            next = tree[line.back().first].next_sibling;
+            line.pop_back();
+        }
+        if (next == pgn::move_tree::no_node)
+        {
+            spare_line = std::move(line);
+            return;
+        }
+    }
+}
+
+void
+pack(std::vector<pgn::player_move> const& moves, std::vector<chess::packed_move>& packed)
+{
+    packed.clear();
+    for (auto const& move_var: moves)
+    {
+        std::visit(chess::overloaded
+        (
+            [&](pgn::standard_move const& move)
+            {
+                packed.emplace_back(move.src, move.dest, move.promotion);
+            },
+            [&](pgn::kingside_castling const& move)
+            {
+                packed.push_back(chess::packed_move::castling(move.colour, true));
+            },
+            [&](pgn::queenside_castling const& move)
+            {
+                packed.push_back(chess::packed_move::castling(move.colour, false));
+            },
+            [](std::monostate const&) {} // no op
+        ), move_var);
+    }
+}
+
+} // namespace mlp::chess::pgn
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <mlp/chess/board.hpp>
+#include <mlp/chess/packed_move.hpp>
+#include <mlp/chess/pgn_move_tree.hpp>
+#include <mlp/chess/pgn_playermove.hpp>
+
+#include <functional>
+#include <vector>
+
+namespace mlp::chess::pgn
+{
+
+// Plays a parsed game on the board. The source square of every standard move is resolved in place.
+// Throws std::runtime_error if a move can't be matched to a piece on the board.
+void replay(chess::board& board, std::vector<pgn::player_move>& moves);
+
+// Called for every move of a tree right after it has been played, with the board it led to
+using tree_visitor = std::function<void(pgn::move_tree::index_type node, chess::board const& board)>;
+
+// Plays every line of a tree depth first, main line first. Branches are reached by taking moves back
+// with board::unmake(), so the board is never copied, and it ends in the position it started from.
+// Standard moves are resolved in place, as by replay() above. If main_line_end is given it is set to the
+// position at the end of the main line, hash history included, as it is reached.
+void replay(chess::board& board, pgn::move_tree& tree, tree_visitor const& visit = {},
+            chess::board* main_line_end = nullptr);
+
+// Packs moves that have been resolved by replay(). Moves that weren't played are skipped
+void pack(std::vector<pgn::player_move> const& moves, std::vector<chess::packed_move>& packed);
+
+} // namespace mlp::chess::pgn
@@ -0,0 +1,238 @@
+#include <mlp/chess/pgn_san.hpp>
+
+#include <string_view>
+
+namespace mlp::chess::pgn
+{
+
+namespace
+{
+
+bool
+parse_piece(char const*& ptr, char const* const end, chess::piece_type& piece) noexcept
+{
+    if (ptr == end) {
+        return false;
+    }
+    switch (*ptr)
+    {
+        case 'B':
+        case 'K':
+        case 'N':
+        case 'Q':
+        case 'R':
+            piece = static_cast<chess::piece_type>(*ptr++);
+            return true;
+    }
+    return false;
+}
+
+// The pieces a pawn can promote to
+bool
+parse_promotion_piece(char const*& ptr, char const* const end, chess::piece_type& piece) noexcept
+{
+    if ((ptr != end) && (*ptr != 'K'))
+    {
+        return parse_piece(ptr, end, piece);
+    }
+    return false;
+}
+
+bool
+parse_file(char const*& ptr, char const* const end, char& file) noexcept
+{
+    if ((ptr != end) && (*ptr >= 'a') && (*ptr <= 'h'))
+    {
+        file = *ptr++;
+        return true;
+    }
+    return false;
+}
+
+bool
+parse_rank(char const*& ptr, char const* const end, char& rank) noexcept
+{
+    if ((ptr != end) && (*ptr >= '1') && (*ptr <= '8'))
+    {
+        rank = *ptr++;
+        return true;
+    }
+    return false;
+}
+
+bool
+parse_square(char const*& begin, char const* const end, char& file, char& rank) noexcept
+{
+    return parse_file(begin, end, file) && parse_rank(begin, end, rank);
+}
+
+bool
+skip_literal(char const*& begin, char const* const end, std::string_view const str) noexcept
+{
+    if ((static_cast<std::size_t>(end - begin) < str.size()) || (std::string_view(begin, str.size()) != str))
+    {
+        return false;
+    }
+    begin += str.size();
+    return true;
+}
+
+void
+parse_check_or_mate(char const*& ptr, char const* const end, pgn::standard_move& move) noexcept
+{
+    if (ptr == end)
+    {
+        return;
+    }
+    switch (*ptr)
+    {
+        case '+':
+            move.is_check = true;
+            ++ptr;
+            break;
+        case '#':
+            move.is_mate = true;
+            ++ptr;
+            break;
+    }
+}
+
+// "e.p." after an en passant capture, attached or after one space. Left alone unless it is all there
+void
+skip_en_passant(char const*& ptr, char const* const end) noexcept
+{
+    auto p = ptr;
+    if ((p != end) && (*p == ' '))
+    {
+        ++p;
+    }
+    if (skip_literal(p, end, "e.p."))
+    {
+        ptr = p;
+    }
+}
+
+// Suffix annotations ("!", "?", "!!", "!?", ...) and a NAG ("$14") attached to the move
+void
+skip_annotations(char const*& ptr, char const* const end) noexcept
+{
+    for (int i = 0; (i < 2) && (ptr != end) && ((*ptr == '!') || (*ptr == '?')); ++i)
+    {
+        ++ptr;
+    }
+    if ((end - ptr >= 2) && (*ptr == '$') && (ptr[1] >= '0') && (ptr[1] <= '9'))
+    {
+        for (ptr += 2; (ptr != end) && (*ptr >= '0') && (*ptr <= '9'); ++ptr)
+        {
+        }
+    }
+}
+
+bool
+parse_standard_move(char const*& begin, char const* const end, pgn::standard_move& move) noexcept
+{
+    auto ptr = begin;
+    move.piece = chess::piece_type::Pawn;
+    parse_piece(ptr, end, move.piece); // Optional, pawns have no letter
+    /*
+     * When disambiguating a player move, PGN uses the following rules:
+     *
+     * If two (or more) identical pieces can player move to the same square, PGN first tries to disambiguate using the
+     * file (column) of departure. If they share the same file but are on different ranks (rows), then the rank of
+     * departure is used to disambiguate.
+     *
+     * If the pieces are on the same file and rank (which would typically only occur in the case of pawns promoting
+     * and then one of the promoted pieces returning to the back rank, a very rare occurrence), then the piece is
+     * identified by _both_ file and rank of departure.
+     */
+    move.src.file = 0; // So we can detect failure
+    move.src.rank = 0;
+    parse_file(ptr, end, move.src.file); // Optional, so ignore failure
+    parse_rank(ptr, end, move.src.rank); // Optional, so ignore failure
+    move.is_capture = (ptr != end) && (*ptr == 'x');
+    ptr += move.is_capture;
+    auto const first_square_end = ptr;
+    bool const two_squares = parse_square(ptr, end, move.dest.file, move.dest.rank);
+    if (!two_squares)
+    {
+        // If we eagerly parsed the destination square as the departing square, then both file and rank must be
+        // present, and a capture must have been followed by its destination
+        if (move.is_capture || !move.src.file || !move.src.rank)
+        {
+            return false;
+        }
+        ptr = first_square_end;
+        move.dest = move.src;
+        move.src = chess::square{};
+    }
+    move.promotion = chess::piece_type::None;
+    if ((move.piece == chess::piece_type::Pawn) && ((move.dest.rank == '1') || (move.dest.rank == '8')))
+    {
+        // "e8=Q" or "e8Q"
+        bool const equals = (ptr != end) && (*ptr == '=');
+        ptr += equals;
+        if (!parse_promotion_piece(ptr, end, move.promotion) && equals)
+        {
+            return false;
+        }
+    }
+    else if ((ptr != end) && (*ptr == '='))
+    {
+        return false;
+    }
+    move.is_check = false;
+    move.is_mate = false;
+    parse_check_or_mate(ptr, end, move);
+    if (two_squares && (move.promotion == chess::piece_type::None))
+    {
+        auto const before = ptr;
+        skip_en_passant(ptr, end);
+        if ((ptr != before) && !move.is_check && !move.is_mate)
+        {
+            parse_check_or_mate(ptr, end, move);
+        }
+    }
+    skip_annotations(ptr, end);
+    begin = ptr; // Commit
+    return true;
+}
+
+} // anonymous namespace
+
+bool
+parse_san(char const*& begin, char const* const end, pgn::player_move& move) noexcept
+{
+    if ((begin != end) && (*begin == 'O')) [[unlikely]]
+    {
+        auto ptr = begin;
+        if (skip_literal(ptr, end, "O-O-O"))
+        {
+            move = pgn::queenside_castling{};
+        }
+        else if (skip_literal(ptr, end, "O-O"))
+        {
+            move = pgn::kingside_castling{};
+        }
+        else
+        {
+            move = std::monostate{};
+            return false;
+        }
+        // Castling gives check too, but the flag isn't kept
+        pgn::standard_move ignored;
+        parse_check_or_mate(ptr, end, ignored);
+        skip_annotations(ptr, end);
+        begin = ptr;
+        return true;
+    }
+    auto ptr = begin;
+    if (!parse_standard_move(ptr, end, move.emplace<pgn::standard_move>()))
+    {
+        move = std::monostate{};
+        return false;
+    }
+    begin = ptr;
+    return true;
+}
+
+} // namespace mlp::chess::pgn
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <mlp/chess/pgn_playermove.hpp>
+
+namespace mlp::chess::pgn
+{
+
+// Reads one SAN move, e.g. "e4", "Nbd2", "exd6 e.p.", "e8=Q+", "O-O-O#" or "Qh4e1!?". Suffix
+// annotations ("!", "?", "!!", "!?", ...), an attached NAG ("$1") and "e.p." are accepted and dropped.
+// A promotion, with or without '=', is only read after a pawn move to the first or last rank, and only
+// to a knight, bishop, rook or queen.
+// The move's colour is left for the caller to set. On success `begin` is moved past the move;
+// otherwise `move` is reset to std::monostate and `begin` is left as it was.
+bool parse_san(char const*& begin, char const* end, pgn::player_move& move) noexcept;
+
+} // namespace mlp::chess::pgn
@@ -0,0 +1,151 @@
+#include <mlp/chess/pgn_scanner.hpp>
+
+#include <cstring>
+#include <iterator>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MLP_CHESS_X86_SCANNER 1
+#endif
+
+namespace mlp::chess::pgn
+{
+
+namespace
+{
+
+using scan_function = void (*)(char const* block, structural_block& out) noexcept;
+
+void
+scan_scalar(char const* const block, structural_block& out) noexcept
+{
+    for (std::size_t i = 0; i < structural_block::size; ++i)
+    {
+        std::uint64_t const bit = std::uint64_t{1} << i;
+        switch (block[i])
+        {
+            case '\n': out.newline |= bit; break;
+            case '\r': out.carriage_return |= bit; break;
+            case '[': out.open_bracket |= bit; break;
+            case '{': out.open_brace |= bit; break;
+            case '}': out.close_brace |= bit; break;
+            case '(': out.open_paren |= bit; break;
+            case ')': out.close_paren |= bit; break;
+            case ';': out.semicolon |= bit; break;
+            case '%': out.percent |= bit; break;
+            default: break;
+        }
+    }
+}
+
+#ifdef MLP_CHESS_X86_SCANNER
+
+// The structural characters, and the mask each of them is reported in
+constexpr char structural_chars[] = {'\n', '\r', '[', '{', '}', '(', ')', ';', '%'};
+
+constexpr std::uint64_t structural_block::* structural_masks[] =
+{
+    &structural_block::newline,
+    &structural_block::carriage_return,
+    &structural_block::open_bracket,
+    &structural_block::open_brace,
+    &structural_block::close_brace,
+    &structural_block::open_paren,
+    &structural_block::close_paren,
+    &structural_block::semicolon,
+    &structural_block::percent,
+};
+
+static_assert(std::size(structural_chars) == std::size(structural_masks));
+
+__attribute__((target("sse2")))
+void
+scan_sse2(char const* const block, structural_block& out) noexcept
+{
+    __m128i chunks[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        chunks[i] = _mm_loadu_si128(reinterpret_cast<__m128i const*>(block + (i * 16)));
+    }
+    for (std::size_t c = 0; c < std::size(structural_chars); ++c)
+    {
+        __m128i const needle = _mm_set1_epi8(structural_chars[c]);
+        std::uint64_t mask = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            auto const bits = static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunks[i], needle)));
+            mask |= std::uint64_t{bits} << (i * 16);
+        }
+        out.*structural_masks[c] = mask;
+    }
+}
+
+__attribute__((target("avx2")))
+void
+scan_avx2(char const* const block, structural_block& out) noexcept
+{
+    __m256i const lo = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(block));
+    __m256i const hi = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(block + 32));
+    for (std::size_t c = 0; c < std::size(structural_chars); ++c)
+    {
+        __m256i const needle = _mm256_set1_epi8(structural_chars[c]);
+        auto const lo_bits = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, needle)));
+        auto const hi_bits = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, needle)));
+        out.*structural_masks[c] = std::uint64_t{lo_bits} | (std::uint64_t{hi_bits} << 32);
+    }
+}
+
+#endif // MLP_CHESS_X86_SCANNER
+
+struct implementation
+{
+    scan_function scan;
+    char const* name;
+};
+
+implementation
+select_implementation() noexcept
+{
+#ifdef MLP_CHESS_X86_SCANNER
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return {scan_avx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return {scan_sse2, "sse2"};
+    }
+#endif
+    return {scan_scalar, "scalar"};
+}
+
+implementation const selected = select_implementation();
+
+} // anonymous namespace
+
+structural_block
+scan_block(char const* const data, std::size_t const size) noexcept
+{
+    structural_block out;
+    if (size >= structural_block::size) [[likely]]
+    {
+        selected.scan(data, out);
+    }
+    else
+    {
+        // Pad the tail with bytes that aren't structural, so we never read past the input
+        char padded[structural_block::size] = {};
+        std::memcpy(padded, data, size);
+        selected.scan(padded, out);
+    }
+    return out;
+}
+
+char const*
+scanner_implementation() noexcept
+{
+    return selected.name;
+}
+
+} // namespace mlp::chess::pgn
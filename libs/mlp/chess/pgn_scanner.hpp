@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mlp::chess::pgn
+{
+
+// Structural character positions within a block of PGN text, one bit per byte (bit 0 is the first
+// byte of the block). This is the first pass over every byte we read, so it is vectorized: with
+// AVX2 or SSE2 a whole block is classified with a handful of compares and movemasks, and the parser
+// then works on the masks instead of looking at every character.
+struct structural_block
+{
+    static constexpr std::size_t size = 64;
+
+    std::uint64_t newline = 0;         // '\n'
+    std::uint64_t carriage_return = 0; // '\r'
+    std::uint64_t open_bracket = 0;    // '[' starts a tag pair
+    std::uint64_t open_brace = 0;      // '{' starts a comment
+    std::uint64_t close_brace = 0;     // '}'
+    std::uint64_t open_paren = 0;      // '(' starts a variation
+    std::uint64_t close_paren = 0;     // ')'
+    std::uint64_t semicolon = 0;       // ';' starts an end of line comment
+    std::uint64_t percent = 0;         // '%' at the start of a line escapes it
+};
+
+// Classifies up to structural_block::size bytes. Bits for bytes at or past `size` are always clear
+structural_block scan_block(char const* data, std::size_t size) noexcept;
+
+// What a line of PGN text holds, told by its first character ('\n' for an empty line)
+enum class line_type
+{
+    tag,       // '['
+    escape,    // '%'
+    blank,     // '\n' or '\r'
+    move_text, // Anything else
+};
+
+constexpr line_type
+classify_line(char const first) noexcept
+{
+    switch (first)
+    {
+        case '[':
+            return line_type::tag;
+        case '%':
+            return line_type::escape;
+        case '\n':
+        case '\r':
+            return line_type::blank;
+        default:
+            return line_type::move_text;
+    }
+}
+
+// The line starts of a block that classify_line() takes for movetext
+constexpr std::uint64_t
+move_text_lines(structural_block const& block, std::uint64_t const line_starts) noexcept
+{
+    return line_starts & ~(block.open_bracket | block.percent | block.newline | block.carriage_return);
+}
+
+// Splits PGN text into games, fed one line at a time. A game starts at its first tag line, or at its
+// first movetext line if it has no tags, and the next one starts at the first tag line after its movetext.
+// Blank and escape lines belong to the game they are in. The parser, the game index and the parallel
+// splitter all follow this rule, so they agree on what the n-th game is
+class game_boundary
+{
+public:
+    // Returns true if the line starts a new game
+    constexpr bool next_line(line_type const type) noexcept
+    {
+        switch (type)
+        {
+            case line_type::tag:
+                if (in_game_ && !in_move_text_)
+                {
+                    return false;
+                }
+                in_game_ = true;
+                in_move_text_ = false;
+                return true;
+            case line_type::move_text:
+                if (in_game_)
+                {
+                    in_move_text_ = true;
+                    return false;
+                }
+                in_game_ = true;
+                in_move_text_ = true;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    constexpr bool in_game() const noexcept { return in_game_; }
+    constexpr bool in_move_text() const noexcept { return in_move_text_; }
+
+private:
+    bool in_game_ = false;
+    bool in_move_text_ = false;
+};
+
+// The instruction set scan_block() dispatches to on this machine: "avx2", "sse2" or "scalar"
+char const* scanner_implementation() noexcept;
+
+} // namespace mlp::chess::pgn
@@ -0,0 +1,258 @@
+#include <mlp/chess/pgn_tags.hpp>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace mlp::chess::pgn
+{
+
+namespace
+{
+
+constexpr std::array<std::string_view, static_cast<std::size_t>(tag_key::Other)> known_keys =
+{
+    "Event", "Site", "Date", "Round", "White", "Black", "Result",
+    "WhiteElo", "BlackElo", "ECO", "Opening", "TimeControl", "Termination", "FEN", "SetUp"
+};
+
+class key_table
+{
+public:
+    tag_key intern(std::string_view const name)
+    {
+        {
+            std::shared_lock lock(mutex_);
+            if (auto const it = ids_.find(name); it != ids_.end())
+            {
+                return it->second;
+            }
+        }
+        std::unique_lock lock(mutex_);
+        if (auto const it = ids_.find(name); it != ids_.end())
+        {
+            return it->second;
+        }
+        if (names_.size() + static_cast<std::size_t>(tag_key::FirstCustom) > UINT16_MAX)
+        {
+            throw std::runtime_error("Too many distinct PGN tag names");
+        }
+        auto const key = static_cast<tag_key>(names_.size() + static_cast<std::size_t>(tag_key::FirstCustom));
+        auto const& stored = names_.emplace_back(name); // deque never moves its elements
+        ids_.emplace(stored, key);
+        return key;
+    }
+
+    std::string_view name(tag_key const key) const
+    {
+        std::shared_lock lock(mutex_);
+        auto const index = static_cast<std::size_t>(key) - static_cast<std::size_t>(tag_key::FirstCustom);
+        return (index < names_.size()) ? std::string_view(names_[index]) : std::string_view();
+    }
+
+private:
+    mutable std::shared_mutex mutex_;
+    std::deque<std::string> names_;
+    std::unordered_map<std::string_view, tag_key> ids_;
+};
+
+key_table&
+custom_keys()
+{
+    static key_table table;
+    return table;
+}
+
+void
+skip_spaces(char const*& ptr, char const* const end)
+{
+    while ((ptr != end) && ((*ptr == ' ') || (*ptr == '\t')))
+    {
+        ++ptr;
+    }
+}
+
+// Other if the name has no fixed id
+tag_key
+known_key(std::string_view const name) noexcept
+{
+    for (std::size_t i = 0; i < known_keys.size(); ++i)
+    {
+        if (known_keys[i] == name)
+        {
+            return static_cast<tag_key>(i);
+        }
+    }
+    return tag_key::Other;
+}
+
+bool
+has_fixed_id(tag_key const key) noexcept
+{
+    return key < tag_key::Other;
+}
+
+} // anonymous namespace
+
+tag_key
+intern_tag_key(std::string_view const name)
+{
+    auto const key = known_key(name);
+    return has_fixed_id(key) ? key : custom_keys().intern(name);
+}
+
+std::string_view
+tag_key_name(tag_key const key)
+{
+    auto const index = static_cast<std::size_t>(key);
+    return (index < known_keys.size()) ? known_keys[index] : custom_keys().name(key);
+}
+
+void
+tag_pairs::parse(std::string_view const tag_section)
+{
+    tags_.clear();
+    char const* ptr = tag_section.data();
+    char const* const end = ptr + tag_section.size();
+    while (ptr != end)
+    {
+        auto const eol = std::find(ptr, end, '\n');
+        char const* p = ptr;
+        ptr = (eol == end) ? end : (eol + 1);
+
+        skip_spaces(p, eol);
+        if ((p == eol) || (*p++ != '['))
+        {
+            continue;
+        }
+        char const* const name_begin = p;
+        while ((p != eol) && (*p != ' ') && (*p != '\t') && (*p != '"'))
+        {
+            ++p;
+        }
+        char const* const name_end = p;
+        skip_spaces(p, eol);
+        if ((name_begin == name_end) || (p == eol) || (*p++ != '"'))
+        {
+            continue;
+        }
+        char const* const value_begin = p;
+        while ((p != eol) && (*p != '"'))
+        {
+            p += ((*p == '\\') && (p + 1 != eol)) ? 2 : 1; // Skip escaped quotes
+        }
+        if (p == eol)
+        {
+            continue;
+        }
+        std::string_view const name(name_begin, name_end);
+        tags_.push_back({known_key(name), name, std::string_view(value_begin, p)});
+    }
+}
+
+std::string_view
+tag_pairs::get(tag_key const key) const
+{
+    if (!has_fixed_id(key))
+    {
+        return get(tag_key_name(key));
+    }
+    for (auto const& tag: tags_)
+    {
+        if (tag.key == key)
+        {
+            return tag.value;
+        }
+    }
+    return {};
+}
+
+std::string_view
+tag_pairs::get(std::string_view const name) const noexcept
+{
+    if (name.empty())
+    {
+        return {};
+    }
+    for (auto const& tag: tags_)
+    {
+        if (tag.name == name)
+        {
+            return tag.value;
+        }
+    }
+    return {};
+}
+
+void
+tag_filter::require_equal(tag_key const key, std::string value)
+{
+    conditions_.push_back({condition_type::Equal, key, tag_key_name(key), std::move(value), {}});
+}
+
+void
+tag_filter::require_prefix(tag_key const key, std::string prefix)
+{
+    conditions_.push_back({condition_type::Prefix, key, tag_key_name(key), std::move(prefix), {}});
+}
+
+void
+tag_filter::require_range(tag_key const key, std::string min, std::string max)
+{
+    conditions_.push_back({condition_type::Range, key, tag_key_name(key), std::move(min), std::move(max)});
+}
+
+void
+tag_filter::require_at_least(tag_key const key, long const min)
+{
+    conditions_.push_back({condition_type::AtLeast, key, tag_key_name(key), {}, {}, min});
+}
+
+bool
+tag_filter::operator()(tag_pairs const& tags) const noexcept
+{
+    for (auto const& condition: conditions_)
+    {
+        auto const value = has_fixed_id(condition.key) ? tags.get(condition.key) : tags.get(condition.name);
+        switch (condition.type)
+        {
+            case condition_type::Equal:
+                if (value != condition.first)
+                {
+                    return false;
+                }
+                break;
+            case condition_type::Prefix:
+                if (!value.starts_with(condition.first))
+                {
+                    return false;
+                }
+                break;
+            case condition_type::Range:
+                if ((!condition.first.empty() && (value < condition.first))
+                    || (!condition.second.empty() && (value > condition.second)))
+                {
+                    return false;
+                }
+                break;
+            case condition_type::AtLeast:
+            {
+                long number = 0;
+                auto const result = std::from_chars(value.data(), value.data() + value.size(), number);
+                if ((result.ec != std::errc{}) || (number < condition.number))
+                {
+                    return false;
+                }
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace mlp::chess::pgn
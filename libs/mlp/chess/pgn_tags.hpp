@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mlp::chess::pgn
+{
+
+// The common tag names have fixed ids, so they are compared and looked up by integer rather than by
+// string. Other names get an id only when a caller asks for one (e.g. a filter on that tag); tags in
+// the input keep them as views and are matched by name.
+enum class tag_key: std::uint16_t
+{
+    // Seven Tag Roster
+    Event,
+    Site,
+    Date,
+    Round,
+    White,
+    Black,
+    Result,
+    // Common supplemental tags
+    WhiteElo,
+    BlackElo,
+    ECO,
+    Opening,
+    TimeControl,
+    Termination,
+    FEN,
+    SetUp,
+    // Any name not above, read from the input
+    Other,
+    // Ids from here on are assigned at runtime
+    FirstCustom
+};
+
+// Thread safe. Returns the same key for the same name for the lifetime of the process. Only meant for
+// the names a program looks for, not for every name in its input
+tag_key intern_tag_key(std::string_view name);
+std::string_view tag_key_name(tag_key key);
+
+// The tag pairs of one game. Values are views into the parsed tag section, with PGN string escapes
+// left as they are.
+class tag_pairs
+{
+public:
+    struct tag
+    {
+        tag_key key; // Other unless the name has a fixed id
+        std::string_view name;
+        std::string_view value;
+    };
+
+    explicit tag_pairs(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) noexcept:
+        tags_(resource)
+    {
+    }
+
+    // Parses tag pair lines, e.g. `[White "Fischer, Robert J."]`. Malformed lines are ignored
+    void parse(std::string_view tag_section);
+    void clear() noexcept { tags_.clear(); }
+
+    // Return an empty view if the game doesn't have the tag
+    std::string_view get(tag_key key) const;
+    std::string_view get(std::string_view name) const noexcept;
+    std::span<tag const> tags() const noexcept { return tags_; }
+
+private:
+    std::pmr::vector<tag> tags_; // Reused from game to game
+};
+
+// A conjunction of conditions on tag values, evaluated before the game's movetext is parsed
+class tag_filter
+{
+public:
+    void require_equal(tag_key key, std::string value);
+    void require_prefix(tag_key key, std::string prefix);
+    // Inclusive range, compared as strings. This suits PGN dates ("1992.11.04"). Empty bounds are open
+    void require_range(tag_key key, std::string min, std::string max);
+    // The tag must hold an integer of at least `min` (e.g. a rating)
+    void require_at_least(tag_key key, long min);
+
+    bool empty() const noexcept { return conditions_.empty(); }
+    bool operator()(tag_pairs const& tags) const noexcept;
+
+private:
+    enum class condition_type
+    {
+        Equal,
+        Prefix,
+        Range,
+        AtLeast,
+    };
+    struct condition
+    {
+        condition_type type;
+        tag_key key;
+        std::string_view name; // Looked up by name unless the key has a fixed id
+        std::string first;
+        std::string second;
+        long number = 0;
+    };
+    std::vector<condition> conditions_;
+};
+
+} // namespace mlp::chess::pgn
@@ -28,6 +28,10 @@ public:
         colour_(static_cast<piece_colour>(init[0])),
         type_(static_cast<piece_type>(init[1]))
     {}
+    constexpr piece(piece_colour colour, piece_type type) noexcept:
+        colour_(colour),
+        type_(type)
+    {}
     constexpr piece() noexcept = default;
     piece_colour colour() const noexcept { return colour_; };
     piece_type type() const noexcept { return type_; };
@@ -0,0 +1,280 @@
+#include <mlp/chess/position_export.hpp>
+#include <mlp/chess/utility.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mlp::chess
+{
+
+namespace
+{
+
+std::uint8_t
+record_code(piece const p) noexcept
+{
+    std::uint8_t code = 0;
+    switch (p.type())
+    {
+        case piece_type::Pawn: code = 1; break;
+        case piece_type::Knight: code = 2; break;
+        case piece_type::Bishop: code = 3; break;
+        case piece_type::Rook: code = 4; break;
+        case piece_type::Queen: code = 5; break;
+        case piece_type::King: code = 6; break;
+        case piece_type::None: return 0;
+    }
+    return (p.colour() == piece_colour::Black) ? (code | 8) : code;
+}
+
+char*
+format_placement(board const& position, char* out) noexcept
+{
+    auto const& ranks = position.ranks();
+    for (int rank = 7; rank >= 0; --rank)
+    {
+        char empty = 0;
+        for (auto const square: ranks[rank])
+        {
+            if (square.is_null())
+            {
+                ++empty;
+                continue;
+            }
+            if (empty)
+            {
+                *out++ = static_cast<char>('0' + empty);
+                empty = 0;
+            }
+            char const type = static_cast<char>(square.type());
+            *out++ = (square.colour() == piece_colour::Black) ? static_cast<char>(type - 'A' + 'a') : type;
+        }
+        if (empty)
+        {
+            *out++ = static_cast<char>('0' + empty);
+        }
+        if (rank)
+        {
+            *out++ = '/';
+        }
+    }
+    return out;
+}
+
+char*
+format_fen(board const& position, bool const with_counters, char* out) noexcept
+{
+    out = format_placement(position, out);
+    *out++ = ' ';
+    *out++ = (position.side_to_move() == piece_colour::Black) ? 'b' : 'w';
+    *out++ = ' ';
+    unsigned const rights = position.castling_rights();
+    if (!rights)
+    {
+        *out++ = '-';
+    }
+    for (auto const& [right, c]: {std::pair{board::white_kingside, 'K'}, std::pair{board::white_queenside, 'Q'},
+                                  std::pair{board::black_kingside, 'k'}, std::pair{board::black_queenside, 'q'}})
+    {
+        if (rights & right)
+        {
+            *out++ = c;
+        }
+    }
+    *out++ = ' ';
+    if (char const file = position.en_passant_file())
+    {
+        *out++ = file;
+        *out++ = (position.side_to_move() == piece_colour::White) ? '6' : '3';
+    }
+    else
+    {
+        *out++ = '-';
+    }
+    if (with_counters)
+    {
+        *out++ = ' ';
+        out = std::to_chars(out, out + 5, position.halfmove_clock()).ptr;
+        *out++ = ' ';
+        out = std::to_chars(out, out + 5, position.fullmove_number()).ptr;
+    }
+    *out++ = '\n';
+    return out;
+}
+
+char*
+format_record(board const& position, char* out) noexcept
+{
+    auto const& ranks = position.ranks();
+    for (int rank = 0; rank < 8; ++rank)
+    {
+        for (int file = 0; file < 8; file += 2)
+        {
+            *out++ = static_cast<char>(record_code(ranks[rank][file]) | (record_code(ranks[rank][file + 1]) << 4));
+        }
+    }
+    *out++ = (position.side_to_move() == piece_colour::Black) ? 1 : 0;
+    *out++ = static_cast<char>(position.castling_rights());
+    *out++ = static_cast<char>(position.en_passant_file() ? (position.en_passant_file() - 'a' + 1) : 0);
+    *out++ = 0;
+    for (auto const counter: {position.halfmove_clock(), position.fullmove_number()})
+    {
+        auto const le = to_little_endian(static_cast<std::uint16_t>(counter));
+        std::memcpy(out, &le, sizeof(le));
+        out += sizeof(le);
+    }
+    return out;
+}
+
+void
+write_all(int const fd, char const* data, std::size_t size)
+{
+    while (size)
+    {
+        ssize_t const written = ::write(fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::runtime_error(std::string("Could not write positions: ") + std::strerror(errno));
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+}
+
+} // anonymous namespace
+
+position_format
+to_position_format(std::string_view const name)
+{
+    if (name == "fen")
+    {
+        return position_format::fen;
+    }
+    if (name == "epd")
+    {
+        return position_format::epd;
+    }
+    if (name == "binary")
+    {
+        return position_format::binary;
+    }
+    throw std::runtime_error("Unknown position format: " + std::string(name));
+}
+
+std::size_t
+format_position(board const& position, position_format const format, char* const out) noexcept
+{
+    switch (format)
+    {
+        case position_format::fen: return format_fen(position, true, out) - out;
+        case position_format::epd: return format_fen(position, false, out) - out;
+        case position_format::binary: return format_record(position, out) - out;
+    }
+    return 0;
+}
+
+std::string
+to_fen(board const& position)
+{
+    char buffer[max_position_size];
+    std::size_t const size = format_position(position, position_format::fen, buffer);
+    return std::string(buffer, size - 1); // Without the line break
+}
+
+position_writer::position_writer(std::filesystem::path const& file_path, position_format const format,
+                                 std::uint64_t const resume_size, std::size_t const buffer_size):
+    format_(format),
+    buffer_(new char[std::max(buffer_size, max_position_size)]),
+    buffer_size_(std::max(buffer_size, max_position_size))
+{
+    if (file_path == "-")
+    {
+        fd_ = STDOUT_FILENO;
+        return;
+    }
+    fd_ = ::open(file_path.c_str(), O_WRONLY | O_CREAT | (resume_size ? 0 : O_TRUNC) | O_CLOEXEC, 0666);
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("Could not open file: " + file_path.string() + ": " + std::strerror(errno));
+    }
+    owns_fd_ = true;
+    if (resume_size)
+    {
+        struct stat st{};
+        if ((::fstat(fd_, &st) != 0) || (static_cast<std::uint64_t>(st.st_size) < resume_size)
+            || (::ftruncate(fd_, static_cast<off_t>(resume_size)) != 0)
+            || (::lseek(fd_, 0, SEEK_END) < 0))
+        {
+            ::close(fd_);
+            throw std::runtime_error("Could not resume writing to file: " + file_path.string());
+        }
+        flushed_size_ = resume_size;
+    }
+}
+
+position_writer::~position_writer()
+{
+    try
+    {
+        close();
+    }
+    catch (...)
+    {
+    }
+}
+
+void
+position_writer::write_formatted(std::string_view const records)
+{
+    position_count_ += (format_ == position_format::binary) ? (records.size() / position_record_format::size)
+                                                            : std::count(records.begin(), records.end(), '\n');
+    if (records.size() > buffer_size_ - used_)
+    {
+        flush();
+        if (records.size() > buffer_size_)
+        {
+            write_all(fd_, records.data(), records.size());
+            flushed_size_ += records.size();
+            return;
+        }
+    }
+    std::memcpy(buffer_.get() + used_, records.data(), records.size());
+    used_ += records.size();
+}
+
+void
+position_writer::flush()
+{
+    std::size_t const size = std::exchange(used_, 0);
+    write_all(fd_, buffer_.get(), size);
+    flushed_size_ += size;
+}
+
+void
+position_writer::close()
+{
+    if (fd_ < 0)
+    {
+        return;
+    }
+    flush();
+    int const fd = std::exchange(fd_, -1);
+    if (owns_fd_ && (::close(fd) != 0))
+    {
+        throw std::runtime_error(std::string("Could not close the position file: ") + std::strerror(errno));
+    }
+}
+
+} // namespace mlp::chess
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <mlp/chess/board.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace mlp::chess
+{
+
+enum class position_format
+{
+    fen,    // One FEN record per line
+    epd,    // FEN without the move counters
+    binary, // Fixed size records, see position_record_format
+};
+
+// Parses "fen", "epd" or "binary". Throws std::runtime_error for anything else
+position_format to_position_format(std::string_view name);
+
+// Fixed size binary position record. All integers are little endian.
+//
+//   u8 placement[32]     4 bits per square, a1 to h8, low nibble first: 0 empty, 1-6 white
+//                        Pawn, Knight, Bishop, Rook, Queen, King, 9-14 the black pieces
+//   u8 side to move      0 White, 1 Black
+//   u8 castling rights   board::castling_right bits
+//   u8 en passant file   1-8, 0 when there is no en passant capture
+//   u8 reserved
+//   u16 halfmove clock
+//   u16 fullmove number
+namespace position_record_format
+{
+constexpr std::size_t size = 40;
+}
+
+// Upper bound of the bytes format_position() writes for one position
+constexpr std::size_t max_position_size = 128;
+
+// Writes one record (a line for FEN and EPD) for the position to `out`, which must have room for
+// max_position_size bytes. Returns the number of bytes written
+std::size_t format_position(board const& position, position_format format, char* out) noexcept;
+
+std::string to_fen(board const& position);
+
+// Writes positions to a file through a large buffer that is handed to write(2) whenever it fills up,
+// so exporting millions of positions costs a few system calls and no stream formatting.
+// A file path of "-" writes to standard output.
+class position_writer
+{
+public:
+    // The first `resume_size` bytes of an existing file are kept and the positions written after them,
+    // e.g. to resume an interrupted export from a checkpoint. The rest of the file is discarded
+    position_writer(std::filesystem::path const& file_path, position_format format,
+                    std::uint64_t resume_size = 0, std::size_t buffer_size = 4 << 20);
+    position_writer(position_writer const&) = delete;
+    position_writer& operator=(position_writer const&) = delete;
+    ~position_writer();
+
+    position_format format() const noexcept { return format_; }
+    std::uint64_t position_count() const noexcept { return position_count_; }
+    // Size of the file once flushed, the kept bytes included
+    std::uint64_t size() const noexcept { return flushed_size_ + used_; }
+
+    void write(board const& position)
+    {
+        if (buffer_size_ - used_ < max_position_size)
+        {
+            flush();
+        }
+        used_ += format_position(position, format_, buffer_.get() + used_);
+        ++position_count_;
+    }
+    // Writes records formatted elsewhere, e.g. by format_position() on a worker thread
+    void write_formatted(std::string_view records);
+    void flush();
+    // Flushes and closes the file. Called by the destructor if not called explicitly
+    void close();
+
+private:
+    int fd_ = -1;
+    bool owns_fd_ = false;
+    position_format format_;
+    std::unique_ptr<char[]> buffer_;
+    std::size_t buffer_size_;
+    std::size_t used_ = 0;
+    std::uint64_t flushed_size_ = 0;
+    std::uint64_t position_count_ = 0;
+};
+
+} // namespace mlp::chess
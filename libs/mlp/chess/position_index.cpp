@@ -0,0 +1,375 @@
+#include <mlp/chess/position_index.hpp>
+#include <mlp/chess/bitboard.hpp>
+#include <mlp/chess/sorted_runs.hpp>
+#include <mlp/chess/utility.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+namespace mlp::chess
+{
+
+namespace
+{
+
+constexpr std::size_t header_size = position_index_format::magic.size() + 4 + 4 + 8 + 8 + 8;
+constexpr std::size_t bucket_size = 8 + 8 + 8;
+constexpr std::size_t position_size = 8 + 4 + 2 + 2;
+constexpr std::size_t game_size = 4 + 2 + 2;
+
+// The pieces counted in a material signature, in the order of their counts
+constexpr std::array<piece_type, 5> material_types{piece_type::Pawn, piece_type::Knight, piece_type::Bishop,
+                                                   piece_type::Rook, piece_type::Queen};
+
+template<typename T>
+void
+append_le(std::vector<char>& out, T const value)
+{
+    T const le = to_little_endian(value);
+    auto const bytes = reinterpret_cast<char const*>(&le);
+    out.insert(out.end(), bytes, bytes + sizeof(le));
+}
+
+template<typename T>
+T
+load_le(char const* const ptr) noexcept
+{
+    T value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return to_little_endian(value);
+}
+
+int
+material_shift(piece_colour const colour, std::size_t const type) noexcept
+{
+    return static_cast<int>(((colour_index(colour) * material_types.size()) + type) * 4);
+}
+
+} // anonymous namespace
+
+material_signature
+material_of(board const& position) noexcept
+{
+    material_signature material = 0;
+    for (auto const colour: {piece_colour::White, piece_colour::Black})
+    {
+        for (std::size_t type = 0; type < material_types.size(); ++type)
+        {
+            auto const count = std::min(std::popcount(position.squares_of(colour, material_types[type])), 15);
+            material |= material_signature(count) << material_shift(colour, type);
+        }
+    }
+    return material;
+}
+
+material_signature
+parse_material(std::string_view const text)
+{
+    material_signature material = 0;
+    for (char const c: text)
+    {
+        if ((c == 'K') || (c == 'k'))
+        {
+            continue;
+        }
+        auto const colour = ((c >= 'a') && (c <= 'z')) ? piece_colour::Black : piece_colour::White;
+        auto const upper = static_cast<piece_type>((colour == piece_colour::Black) ? (c - 'a' + 'A') : c);
+        auto const type = std::ranges::find(material_types, upper);
+        if (type == material_types.end())
+        {
+            throw std::runtime_error("Invalid material \"" + std::string(text) + "\": unexpected '" + c + "'");
+        }
+        int const shift = material_shift(colour, type - material_types.begin());
+        if (((material >> shift) & 15) == 15)
+        {
+            throw std::runtime_error("Invalid material \"" + std::string(text) + "\": too many pieces");
+        }
+        material += material_signature{1} << shift;
+    }
+    return material;
+}
+
+std::string
+format_material(material_signature const material)
+{
+    std::string text;
+    for (auto const colour: {piece_colour::White, piece_colour::Black})
+    {
+        bool const black = (colour == piece_colour::Black);
+        text += black ? 'k' : 'K';
+        // Most valuable first, as endgames are usually written
+        for (std::size_t type = material_types.size(); type-- > 0;)
+        {
+            auto const count = (material >> material_shift(colour, type)) & 15;
+            char const letter = static_cast<char>(material_types[type]);
+            text.append(count, black ? static_cast<char>(letter - 'A' + 'a') : letter);
+        }
+    }
+    return text;
+}
+
+position_index_builder::position_index_builder(std::size_t const memory_limit, std::filesystem::path temp_dir):
+    memory_limit_(memory_limit),
+    temp_dir_(std::move(temp_dir))
+{
+}
+
+position_index_builder::~position_index_builder()
+{
+    remove_runs();
+}
+
+void
+position_index_builder::remove_runs() noexcept
+{
+    std::error_code ignored;
+    for (auto* const runs: {&position_runs_, &game_runs_})
+    {
+        for (auto const& run: *runs)
+        {
+            std::filesystem::remove(run, ignored);
+        }
+        runs->clear();
+    }
+}
+
+void
+position_index_builder::add_game(std::uint32_t const game, std::span<zobrist_hash const> const positions,
+                                 std::span<material_signature const> const materials)
+{
+    std::size_t const plies = std::min({positions.size(), materials.size(),
+                                        std::size_t{std::numeric_limits<std::uint16_t>::max()} + 1});
+    game_materials_.clear();
+    for (std::size_t ply = 0; ply < plies; ++ply)
+    {
+        auto const material = materials[ply];
+        positions_.push_back({material, positions[ply], game, static_cast<std::uint16_t>(ply)});
+        auto& count = materials_[material];
+        ++count.positions;
+        // Material only changes with captures and promotions, so a game has few materials
+        if (std::ranges::find(game_materials_, material) == game_materials_.end())
+        {
+            game_materials_.push_back(material);
+            games_.push_back({material, game, static_cast<std::uint16_t>(ply)});
+            ++count.games;
+        }
+    }
+    position_count_ += plies;
+    game_count_ += game_materials_.size();
+    if ((positions_.size() * sizeof(position_record)) + (games_.size() * sizeof(game_record)) >= memory_limit_)
+    {
+        position_runs_.push_back(spill_run(positions_, temp_dir_, "mlp-chess-positions"));
+        if (!games_.empty())
+        {
+            game_runs_.push_back(spill_run(games_, temp_dir_, "mlp-chess-positions"));
+        }
+    }
+}
+
+void
+position_index_builder::write(std::filesystem::path const& file_path)
+{
+    std::vector<char> out;
+    out.insert(out.end(), position_index_format::magic.begin(), position_index_format::magic.end());
+    append_le(out, position_index_format::version);
+    append_le(out, std::uint32_t{0});
+    append_le(out, std::uint64_t{materials_.size()});
+    append_le(out, position_count_);
+    append_le(out, game_count_);
+    // Every material has both positions and games, and the records are merged in order of material, so
+    // the buckets are known before the records are
+    std::uint64_t first_position = 0;
+    std::uint64_t first_game = 0;
+    for (auto const& [material, count]: materials_)
+    {
+        append_le(out, material);
+        append_le(out, first_position);
+        append_le(out, first_game);
+        first_position += count.positions;
+        first_game += count.games;
+    }
+
+    std::ofstream output;
+    output.exceptions(std::ios::badbit | std::ios::failbit);
+    output.open(file_path, std::ios::binary | std::ios::trunc);
+    // The records are formatted a buffer at a time, there can be billions of them
+    constexpr std::size_t flush_size = std::size_t{1} << 20;
+    auto const flush = [&]
+    {
+        output.write(out.data(), static_cast<std::streamsize>(out.size()));
+        out.clear();
+    };
+    std::ranges::sort(positions_);
+    {
+        run_merger<position_record> positions(position_runs_, positions_);
+        for (position_record record; positions.next(record);)
+        {
+            append_le(out, record.hash);
+            append_le(out, record.game);
+            append_le(out, record.ply);
+            append_le(out, std::uint16_t{0});
+            if (out.size() >= flush_size)
+            {
+                flush();
+            }
+        }
+    }
+    std::vector<position_record>().swap(positions_);
+    std::ranges::sort(games_);
+    {
+        run_merger<game_record> games(game_runs_, games_);
+        for (game_record record; games.next(record);)
+        {
+            append_le(out, record.game);
+            append_le(out, record.ply);
+            append_le(out, std::uint16_t{0});
+            if (out.size() >= flush_size)
+            {
+                flush();
+            }
+        }
+    }
+    flush();
+    std::vector<game_record>().swap(games_);
+    materials_.clear();
+    remove_runs();
+}
+
+position_index::position_index(std::filesystem::path const& file_path):
+    file_(file_path)
+{
+    char const* const begin = file_.begin();
+    if ((file_.size() < header_size)
+        || (std::string_view(begin, position_index_format::magic.size()) != position_index_format::magic))
+    {
+        throw std::runtime_error("Not a position index file: " + file_path.string());
+    }
+    char const* ptr = begin + position_index_format::magic.size();
+    if (load_le<std::uint32_t>(ptr) != position_index_format::version)
+    {
+        throw std::runtime_error("Unsupported position index file version: " + file_path.string());
+    }
+    bucket_count_ = load_le<std::uint64_t>(ptr + 8);
+    position_count_ = load_le<std::uint64_t>(ptr + 16);
+    game_count_ = load_le<std::uint64_t>(ptr + 24);
+    std::uint64_t const records_size = file_.size() - header_size;
+    if ((records_size / bucket_size < bucket_count_)
+        || ((records_size - (bucket_count_ * bucket_size)) / position_size < position_count_)
+        || ((records_size - (bucket_count_ * bucket_size) - (position_count_ * position_size)) / game_size
+            < game_count_))
+    {
+        throw std::runtime_error("Truncated position index file: " + file_path.string());
+    }
+    buckets_ = begin + header_size;
+    positions_ = buckets_ + (bucket_count_ * bucket_size);
+    games_ = positions_ + (position_count_ * position_size);
+}
+
+bool
+position_index::find_bucket(material_signature const material, bucket& found) const
+{
+    std::uint64_t low = 0;
+    std::uint64_t high = bucket_count_;
+    while (low < high)
+    {
+        std::uint64_t const mid = low + ((high - low) / 2);
+        if (load_le<material_signature>(buckets_ + (mid * bucket_size)) < material)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    char const* const record = buckets_ + (low * bucket_size);
+    if ((low == bucket_count_) || (load_le<material_signature>(record) != material))
+    {
+        return false;
+    }
+    bool const last = (low + 1 == bucket_count_);
+    found.first_position = load_le<std::uint64_t>(record + 8);
+    found.first_game = load_le<std::uint64_t>(record + 16);
+    std::uint64_t const end_position = last ? position_count_ : load_le<std::uint64_t>(record + bucket_size + 8);
+    std::uint64_t const end_game = last ? game_count_ : load_le<std::uint64_t>(record + bucket_size + 16);
+    if ((found.first_position > end_position) || (end_position > position_count_)
+        || (found.first_game > end_game) || (end_game > game_count_))
+    {
+        throw std::runtime_error("Corrupt position index file");
+    }
+    found.position_count = end_position - found.first_position;
+    found.game_count = end_game - found.first_game;
+    return true;
+}
+
+std::vector<position_hit>
+position_index::find(board const& position) const
+{
+    std::vector<position_hit> hits;
+    bucket found;
+    if (!find_bucket(material_of(position), found))
+    {
+        return hits;
+    }
+    zobrist_hash const hash = position.hash();
+    std::uint64_t low = found.first_position;
+    std::uint64_t high = found.first_position + found.position_count;
+    std::uint64_t const end = high;
+    while (low < high)
+    {
+        std::uint64_t const mid = low + ((high - low) / 2);
+        if (load_le<zobrist_hash>(positions_ + (mid * position_size)) < hash)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    for (char const* record = positions_ + (low * position_size);
+         (low < end) && (load_le<zobrist_hash>(record) == hash); ++low, record += position_size)
+    {
+        hits.push_back({load_le<std::uint32_t>(record + 8), load_le<std::uint16_t>(record + 12)});
+    }
+    return hits;
+}
+
+std::vector<position_hit>
+position_index::find(material_signature const material) const
+{
+    std::vector<position_hit> hits;
+    bucket found;
+    if (!find_bucket(material, found))
+    {
+        return hits;
+    }
+    hits.reserve(found.game_count);
+    char const* record = games_ + (found.first_game * game_size);
+    for (std::uint64_t i = 0; i < found.game_count; ++i, record += game_size)
+    {
+        hits.push_back({load_le<std::uint32_t>(record), load_le<std::uint16_t>(record + 4)});
+    }
+    return hits;
+}
+
+std::vector<material_signature>
+position_index::materials() const
+{
+    std::vector<material_signature> materials;
+    materials.reserve(bucket_count_);
+    for (std::uint64_t i = 0; i < bucket_count_; ++i)
+    {
+        materials.push_back(load_le<material_signature>(buckets_ + (i * bucket_size)));
+    }
+    return materials;
+}
+
+} // namespace mlp::chess
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <mlp/chess/board.hpp>
+#include <mlp/chess/mapped_file.hpp>
+#include <mlp/chess/zobrist.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mlp::chess
+{
+
+// The pieces on the board, kings aside: 4 bits per count (capped at 15) of White's pawns, knights,
+// bishops, rooks and queens in the low 20 bits, then Black's
+using material_signature = std::uint64_t;
+
+material_signature material_of(board const& position) noexcept;
+// Parses material written as piece letters, White's upper case and Black's lower case, e.g. "KRPkr" for
+// king, rook and pawn against king and rook. Kings may be left out. Throws std::runtime_error if malformed
+material_signature parse_material(std::string_view text);
+std::string format_material(material_signature material);
+
+// Position index file. Positions are grouped in buckets of equal material and sorted by hash within
+// each, so a position is found with two binary searches of the mapped file and all the games that had
+// some material are read off in one run. All integers are little endian.
+//
+//   header:     "MLPPOSIX" | u32 version | u32 reserved | u64 bucket count | u64 position count
+//               | u64 game count
+//   buckets:    { u64 material | u64 first position | u64 first game }[bucket count], sorted by material
+//   positions:  { u64 hash | u32 game | u16 ply | u16 reserved }[position count], by hash, game and ply
+//   games:      { u32 game | u16 ply | u16 reserved }[game count], by game
+//
+// A bucket's games are the games that had its material, each with the first ply it did.
+namespace position_index_format
+{
+constexpr std::string_view magic = "MLPPOSIX";
+constexpr std::uint32_t version = 1;
+}
+
+// Where a game reached a position: its game number (from 1, in file order) and the ply, 0 being the
+// initial position
+struct position_hit
+{
+    std::uint32_t game = 0;
+    std::uint16_t ply = 0;
+
+    friend auto operator<=>(position_hit const&, position_hit const&) = default;
+};
+
+// Collects every position of every game, then sorts and writes them to a position index file. The
+// positions are kept in memory up to memory_limit bytes (24 per position), then sorted and spilled to a
+// run file in temp_dir; write() merges the runs into the index, so databases of any size can be indexed
+class position_index_builder
+{
+public:
+    explicit position_index_builder(std::size_t memory_limit = std::size_t{256} << 20,
+                                    std::filesystem::path temp_dir = std::filesystem::temp_directory_path());
+    position_index_builder(position_index_builder const&) = delete;
+    position_index_builder& operator=(position_index_builder const&) = delete;
+    // Removes the run files
+    ~position_index_builder();
+
+    // positions[i] and materials[i] describe the position after ply i, e.g. from board::hash_history()
+    void add_game(std::uint32_t game, std::span<zobrist_hash const> positions,
+                  std::span<material_signature const> materials);
+    // Writes the index of the games added. Called once, the games are consumed
+    void write(std::filesystem::path const& file_path);
+
+    std::uint64_t size() const noexcept { return position_count_; }
+    // Run files written so far, 0 as long as everything fits in memory
+    std::size_t spill_count() const noexcept { return position_runs_.size() + game_runs_.size(); }
+
+private:
+    struct position_record
+    {
+        material_signature material;
+        zobrist_hash hash;
+        std::uint32_t game;
+        std::uint16_t ply;
+
+        friend auto operator<=>(position_record const&, position_record const&) = default;
+    };
+    struct game_record
+    {
+        material_signature material;
+        std::uint32_t game;
+        std::uint16_t ply;
+
+        friend auto operator<=>(game_record const&, game_record const&) = default;
+    };
+    // How many records each material has, to lay out the buckets before the records are merged
+    struct material_count
+    {
+        std::uint64_t positions = 0;
+        std::uint64_t games = 0;
+    };
+
+    void remove_runs() noexcept;
+
+    std::size_t memory_limit_;
+    std::filesystem::path temp_dir_;
+    std::vector<position_record> positions_;
+    std::vector<game_record> games_;
+    std::vector<std::filesystem::path> position_runs_;
+    std::vector<std::filesystem::path> game_runs_;
+    std::map<material_signature, material_count> materials_;
+    std::vector<material_signature> game_materials_; // Materials of the game being added, reused
+    std::uint64_t position_count_ = 0;
+    std::uint64_t game_count_ = 0;
+};
+
+// Read-only view of a position index file. Lookups read the memory mapped file in place
+class position_index
+{
+public:
+    explicit position_index(std::filesystem::path const& file_path);
+
+    std::uint64_t position_count() const noexcept { return position_count_; }
+
+    // Every game and ply the position occurred at, in game order
+    std::vector<position_hit> find(board const& position) const;
+    // Every game that had the material, with the first ply it did, in game order
+    std::vector<position_hit> find(material_signature material) const;
+    // The materials the games had, in increasing order, e.g. to select several with a pattern
+    std::vector<material_signature> materials() const;
+
+private:
+    struct bucket
+    {
+        std::uint64_t first_position = 0;
+        std::uint64_t position_count = 0;
+        std::uint64_t first_game = 0;
+        std::uint64_t game_count = 0;
+    };
+    // False if no game had the material
+    bool find_bucket(material_signature material, bucket& found) const;
+
+    chess::mapped_file file_;
+    std::uint64_t bucket_count_ = 0;
+    std::uint64_t position_count_ = 0;
+    std::uint64_t game_count_ = 0;
+    char const* buckets_ = nullptr;
+    char const* positions_ = nullptr;
+    char const* games_ = nullptr;
+};
+
+} // namespace mlp::chess
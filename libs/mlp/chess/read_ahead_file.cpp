@@ -0,0 +1,617 @@
+#include <mlp/chess/read_ahead_file.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef MLP_CHESS_WITH_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace mlp::chess
+{
+
+// Reads the blocks of a file in order, some ahead of the one being consumed
+class read_ahead_streambuf::reader
+{
+public:
+    reader(std::filesystem::path const& file_path, read_ahead_options const& options):
+        file_path_(file_path),
+        fd_(::open(file_path.c_str(), O_RDONLY | O_CLOEXEC)),
+        depth_(std::max<std::size_t>(options.depth, 1)),
+        block_size_(std::max<std::size_t>(options.block_size, 4096))
+    {
+        if (fd_ < 0)
+        {
+            fail("Could not open file");
+        }
+        // No more buffers than the file has blocks, it may grow but is usually read once
+        struct stat st{};
+        if ((::fstat(fd_, &st) == 0) && S_ISREG(st.st_mode))
+        {
+            auto const blocks = (static_cast<std::uint64_t>(st.st_size) + block_size_ - 1) / block_size_;
+            depth_ = static_cast<std::size_t>(std::clamp<std::uint64_t>(blocks, 1, depth_));
+        }
+        ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    reader(reader const&) = delete;
+    reader& operator=(reader const&) = delete;
+    virtual ~reader()
+    {
+        if (fd_ >= 0)
+        {
+            ::close(fd_);
+        }
+    }
+
+    virtual char const* name() const noexcept = 0;
+    // Drops whatever was read ahead and starts reading again at offset
+    virtual void start(std::uint64_t offset) = 0;
+    // Hands the previous block back to be refilled and returns the next one, empty at the end of the file
+    virtual std::span<char const> next() = 0;
+
+protected:
+    [[noreturn]] void
+    fail(std::string_view const reason, int const error = errno) const
+    {
+        throw std::runtime_error(std::string(reason) + ": " + file_path_.string() + ": " + std::strerror(error));
+    }
+
+    std::filesystem::path file_path_;
+    int fd_;
+    std::size_t depth_;
+    std::size_t block_size_;
+};
+
+namespace
+{
+
+// A thread of our own reads the blocks one after the other into a ring of depth buffers
+class thread_reader final: public read_ahead_streambuf::reader
+{
+public:
+    thread_reader(std::filesystem::path const& file_path, read_ahead_options const& options):
+        reader(file_path, options),
+        buffers_(depth_)
+    {
+        // Left uninitialized, every byte handed out has been read into first
+        for (auto& buffer: buffers_)
+        {
+            buffer.data = std::make_unique_for_overwrite<char[]>(block_size_);
+        }
+    }
+
+    ~thread_reader() override
+    {
+        stop();
+    }
+
+    char const*
+    name() const noexcept override
+    {
+        return "thread";
+    }
+
+    void
+    start(std::uint64_t const offset) override
+    {
+        stop();
+        for (auto& buffer: buffers_)
+        {
+            buffer.size = 0;
+            buffer.ready = false;
+        }
+        reading_ = 0;
+        holding_ = false;
+        finished_ = false;
+        stop_ = false;
+        error_ = nullptr;
+        thread_ = std::thread(&thread_reader::fill, this, offset);
+    }
+
+    std::span<char const>
+    next() override
+    {
+        std::unique_lock lock(mutex_);
+        if (holding_)
+        {
+            buffers_[reading_].ready = false;
+            reading_ = (reading_ + 1) % buffers_.size();
+            holding_ = false;
+            buffer_released_.notify_one();
+        }
+        buffer_filled_.wait(lock, [&] { return buffers_[reading_].ready || finished_; });
+        auto& buffer = buffers_[reading_];
+        if (!buffer.ready)
+        {
+            if (error_)
+            {
+                std::rethrow_exception(error_);
+            }
+            return {};
+        }
+        holding_ = true;
+        return std::span<char const>(buffer.data.get(), buffer.size);
+    }
+
+private:
+    struct buffer
+    {
+        std::unique_ptr<char[]> data;
+        std::size_t size = 0;
+        bool ready = false; // Filled and waiting for, or being read by, the reader
+    };
+
+    void
+    stop()
+    {
+        if (!thread_.joinable())
+        {
+            return;
+        }
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        buffer_released_.notify_one();
+        thread_.join();
+    }
+
+    void
+    fill(std::uint64_t offset)
+    {
+        std::size_t filling = 0;
+        try
+        {
+            while (true)
+            {
+                auto& buffer = buffers_[filling];
+                {
+                    std::unique_lock lock(mutex_);
+                    buffer_released_.wait(lock, [&] { return stop_ || !buffer.ready; });
+                    if (stop_)
+                    {
+                        return;
+                    }
+                }
+                // The reader doesn't touch a buffer until it is ready, so it is filled without the lock
+                buffer.size = 0;
+                while (buffer.size < block_size_)
+                {
+                    ssize_t const size = ::pread(fd_, buffer.data.get() + buffer.size, block_size_ - buffer.size,
+                                                 static_cast<off_t>(offset + buffer.size));
+                    if (size < 0)
+                    {
+                        if (errno == EINTR)
+                        {
+                            continue;
+                        }
+                        fail("Could not read file");
+                    }
+                    if (size == 0)
+                    {
+                        break;
+                    }
+                    buffer.size += static_cast<std::size_t>(size);
+                }
+                if (buffer.size == 0)
+                {
+                    break;
+                }
+                offset += buffer.size;
+                {
+                    std::lock_guard lock(mutex_);
+                    buffer.ready = true;
+                }
+                buffer_filled_.notify_one();
+                filling = (filling + 1) % buffers_.size();
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard lock(mutex_);
+            error_ = std::current_exception();
+        }
+        {
+            std::lock_guard lock(mutex_);
+            finished_ = true;
+        }
+        buffer_filled_.notify_one();
+    }
+
+    std::vector<buffer> buffers_;
+    std::size_t reading_ = 0; // Index of the buffer the reader consumes next
+    bool holding_ = false;    // The reader is still consuming buffers_[reading_]
+    bool finished_ = false;   // No more buffers will be filled
+    bool stop_ = false;
+    std::exception_ptr error_;
+    std::mutex mutex_;
+    std::condition_variable buffer_filled_;
+    std::condition_variable buffer_released_;
+    std::thread thread_;
+};
+
+#ifdef MLP_CHESS_WITH_IO_URING
+// The reads are submitted to an io_uring, set up with the raw system calls so there is no liburing
+// dependency. Each of the depth buffers has a read of its own block in flight until the reader gets
+// to it, and is submitted again for the next unread block once the reader is done with it
+class uring_reader final: public read_ahead_streambuf::reader
+{
+public:
+    uring_reader(std::filesystem::path const& file_path, read_ahead_options const& options):
+        reader(file_path, options),
+        slots_(depth_)
+    {
+        io_uring_params params{};
+        ring_fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, static_cast<unsigned>(depth_), &params));
+        if (ring_fd_ < 0)
+        {
+            fail("Could not set up an io_uring");
+        }
+        sq_ring_size_ = params.sq_off.array + (params.sq_entries * sizeof(unsigned));
+        cq_ring_size_ = params.cq_off.cqes + (params.cq_entries * sizeof(io_uring_cqe));
+        bool const single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap)
+        {
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        }
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        try
+        {
+            sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+            cq_ring_ = single_mmap ? sq_ring_ : map(cq_ring_size_, IORING_OFF_CQ_RING);
+            sqes_ = static_cast<io_uring_sqe*>(map(sqes_size_, IORING_OFF_SQES));
+        }
+        catch (...)
+        {
+            // The destructor won't run, whatever was mapped so far goes here
+            release();
+            throw;
+        }
+        sq_tail_ = ring_field(sq_ring_, params.sq_off.tail);
+        sq_mask_ = *ring_field(sq_ring_, params.sq_off.ring_mask);
+        sq_array_ = ring_field(sq_ring_, params.sq_off.array);
+        cq_head_ = ring_field(cq_ring_, params.cq_off.head);
+        cq_tail_ = ring_field(cq_ring_, params.cq_off.tail);
+        cq_mask_ = *ring_field(cq_ring_, params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(static_cast<char*>(cq_ring_) + params.cq_off.cqes);
+        for (auto& slot: slots_)
+        {
+            slot.data = std::make_unique_for_overwrite<char[]>(block_size_);
+        }
+    }
+
+    ~uring_reader() override
+    {
+        try
+        {
+            wait_all();
+        }
+        catch (...)
+        {
+            // The buffers must outlive the reads, there is nothing else to do about a failing wait
+        }
+        release();
+    }
+
+    char const*
+    name() const noexcept override
+    {
+        return "io_uring";
+    }
+
+    void
+    start(std::uint64_t const offset) override
+    {
+        wait_all();
+        for (auto& slot: slots_)
+        {
+            slot.done = false;
+        }
+        reading_ = 0;
+        holding_ = false;
+        finished_ = false;
+        restart_ = false;
+        next_offset_ = offset;
+        for (std::size_t i = 0; i < slots_.size(); ++i)
+        {
+            submit(i);
+        }
+    }
+
+    std::span<char const>
+    next() override
+    {
+        if (holding_)
+        {
+            holding_ = false;
+            slots_[reading_].done = false;
+            if (restart_)
+            {
+                // A short read ended the previous block early, the reads ahead of it started too far on
+                start(restart_offset_);
+            }
+            else
+            {
+                submit(reading_);
+                reading_ = (reading_ + 1) % slots_.size();
+            }
+        }
+        if (finished_)
+        {
+            return {};
+        }
+        auto& slot = slots_[reading_];
+        while (!slot.done)
+        {
+            reap();
+        }
+        if (slot.result < 0)
+        {
+            fail("Could not read file", -slot.result);
+        }
+        auto const size = static_cast<std::size_t>(slot.result);
+        if (size == 0)
+        {
+            finished_ = true;
+            wait_all();
+            return {};
+        }
+        if (size < block_size_)
+        {
+            // The end of the file, for now: read on from where this block really ended
+            restart_ = true;
+            restart_offset_ = slot.offset + size;
+        }
+        holding_ = true;
+        return std::span<char const>(slot.data.get(), size);
+    }
+
+private:
+    struct slot
+    {
+        std::unique_ptr<char[]> data;
+        iovec vector{};
+        std::uint64_t offset = 0;
+        int result = 0;
+        bool in_flight = false;
+        bool done = false; // Read and not yet handed back by the reader
+    };
+
+    void*
+    map(std::size_t const size, off_t const offset)
+    {
+        void* const addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, offset);
+        if (addr == MAP_FAILED)
+        {
+            fail("Could not map the io_uring");
+        }
+        return addr;
+    }
+
+    // Unmaps the rings and closes the io_uring, once no read is in flight
+    void
+    release() noexcept
+    {
+        auto const unmap = [](void* const addr, std::size_t const size)
+        {
+            if (addr)
+            {
+                ::munmap(addr, size);
+            }
+        };
+        unmap(sqes_, sqes_size_);
+        if (cq_ring_ != sq_ring_)
+        {
+            unmap(cq_ring_, cq_ring_size_);
+        }
+        unmap(sq_ring_, sq_ring_size_);
+        if (ring_fd_ >= 0)
+        {
+            ::close(ring_fd_);
+        }
+    }
+
+    static unsigned*
+    ring_field(void* const ring, unsigned const offset) noexcept
+    {
+        return reinterpret_cast<unsigned*>(static_cast<char*>(ring) + offset);
+    }
+
+    void
+    enter(unsigned const to_submit, unsigned const min_complete, unsigned const flags)
+    {
+        while (::syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, nullptr, 0) < 0)
+        {
+            if (errno != EINTR)
+            {
+                fail("io_uring_enter failed");
+            }
+        }
+    }
+
+    void
+    submit(std::size_t const index)
+    {
+        auto& slot = slots_[index];
+        slot.offset = next_offset_;
+        slot.vector = iovec{slot.data.get(), block_size_};
+        next_offset_ += block_size_;
+        unsigned const tail = *sq_tail_;
+        unsigned const entry = tail & sq_mask_;
+        io_uring_sqe& sqe = sqes_[entry];
+        sqe = io_uring_sqe{};
+        sqe.opcode = IORING_OP_READV;
+        sqe.fd = fd_;
+        sqe.addr = reinterpret_cast<std::uint64_t>(&slot.vector);
+        sqe.len = 1;
+        sqe.off = slot.offset;
+        sqe.user_data = index;
+        sq_array_[entry] = entry;
+        std::atomic_ref<unsigned>(*sq_tail_).store(tail + 1, std::memory_order_release);
+        slot.in_flight = true;
+        enter(1, 0, 0);
+    }
+
+    // Waits for at least one read to complete and takes all the completions there are
+    void
+    reap()
+    {
+        unsigned head = *cq_head_;
+        if (head == std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire))
+        {
+            enter(0, 1, IORING_ENTER_GETEVENTS);
+        }
+        unsigned const tail = std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire);
+        for (; head != tail; ++head)
+        {
+            io_uring_cqe const& cqe = cqes_[head & cq_mask_];
+            auto& slot = slots_[cqe.user_data];
+            slot.result = cqe.res;
+            slot.in_flight = false;
+            slot.done = true;
+        }
+        std::atomic_ref<unsigned>(*cq_head_).store(head, std::memory_order_release);
+    }
+
+    void
+    wait_all()
+    {
+        while (std::any_of(slots_.begin(), slots_.end(), [](slot const& s) { return s.in_flight; }))
+        {
+            reap();
+        }
+    }
+
+    std::vector<slot> slots_;
+    std::size_t reading_ = 0;      // Index of the slot the reader consumes next
+    bool holding_ = false;         // The reader is still consuming slots_[reading_]
+    bool finished_ = false;        // A read hit the end of the file
+    bool restart_ = false;         // A short read, the reads ahead are restarted at restart_offset_
+    std::uint64_t restart_offset_ = 0;
+    std::uint64_t next_offset_ = 0; // Where the next read submitted starts
+    int ring_fd_ = -1;
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    std::size_t sq_ring_size_ = 0;
+    std::size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    std::size_t sqes_size_ = 0;
+    unsigned* sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+};
+#endif
+
+std::unique_ptr<read_ahead_streambuf::reader>
+make_reader(std::filesystem::path const& file_path, read_ahead_options const& options)
+{
+#ifdef MLP_CHESS_WITH_IO_URING
+    try
+    {
+        return std::make_unique<uring_reader>(file_path, options);
+    }
+    catch (std::runtime_error const&)
+    {
+        // No io_uring here, the file is read on a thread instead. A file that can't be opened fails again below
+    }
+#endif
+    return std::make_unique<thread_reader>(file_path, options);
+}
+
+} // anonymous namespace
+
+read_ahead_streambuf::read_ahead_streambuf(std::filesystem::path const& file_path,
+                                           read_ahead_options const& options):
+    reader_(make_reader(file_path, options))
+{
+    reader_->start(0);
+}
+
+read_ahead_streambuf::~read_ahead_streambuf() = default;
+
+bool
+read_ahead_streambuf::worthwhile(std::filesystem::path const& file_path, read_ahead_options const& options)
+{
+    std::error_code error;
+    return (options.depth > 0) && std::filesystem::is_regular_file(file_path, error)
+        && (std::filesystem::file_size(file_path, error) > std::max<std::size_t>(options.block_size, 4096))
+        && !error;
+}
+
+char const*
+read_ahead_streambuf::backend() const noexcept
+{
+    return reader_->name();
+}
+
+read_ahead_streambuf::int_type
+read_ahead_streambuf::underflow()
+{
+    if (gptr() < egptr())
+    {
+        return traits_type::to_int_type(*gptr());
+    }
+    offset_ += static_cast<std::uint64_t>(egptr() - eback());
+    auto const block = reader_->next();
+    if (block.empty())
+    {
+        setg(nullptr, nullptr, nullptr);
+        return traits_type::eof();
+    }
+    // The get area is only read from, the cast is what std::streambuf's interface asks for
+    char* const data = const_cast<char*>(block.data());
+    setg(data, data, data + block.size());
+    return traits_type::to_int_type(*gptr());
+}
+
+read_ahead_streambuf::pos_type
+read_ahead_streambuf::seekoff(off_type const offset, std::ios::seekdir const direction,
+                              std::ios::openmode const which)
+{
+    if (direction == std::ios::beg)
+    {
+        return seekpos(pos_type(offset), which);
+    }
+    if ((direction == std::ios::cur) && (offset == 0))
+    {
+        return pos_type(static_cast<off_type>(offset_ + (gptr() - eback())));
+    }
+    return pos_type(off_type(-1));
+}
+
+read_ahead_streambuf::pos_type
+read_ahead_streambuf::seekpos(pos_type const position, std::ios::openmode const which)
+{
+    if (!(which & std::ios::in) || (off_type(position) < 0))
+    {
+        return pos_type(off_type(-1));
+    }
+    setg(nullptr, nullptr, nullptr);
+    offset_ = static_cast<std::uint64_t>(off_type(position));
+    reader_->start(offset_);
+    return position;
+}
+
+} // namespace mlp::chess
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <ios>
+#include <memory>
+#include <streambuf>
+
+namespace mlp::chess
+{
+
+struct read_ahead_options
+{
+    std::size_t depth = 4;                         // Reads kept in flight. 0 reads synchronously instead
+    std::size_t block_size = std::size_t{1} << 20; // Bytes per read
+};
+
+// Stream buffer over a file that keeps `depth` reads of `block_size` bytes in flight ahead of the
+// reader, so the next blocks are on their way from a cold or network attached disk while the current
+// one is parsed. On Linux the reads are submitted to an io_uring and need no thread of our own. Where
+// io_uring isn't available (old kernels, sandboxes that forbid it) a reader thread fills a ring of
+// buffers instead.
+class read_ahead_streambuf: public std::streambuf
+{
+public:
+    class reader;
+
+    explicit read_ahead_streambuf(std::filesystem::path const& file_path, read_ahead_options const& options = {});
+    read_ahead_streambuf(read_ahead_streambuf const&) = delete;
+    read_ahead_streambuf& operator=(read_ahead_streambuf const&) = delete;
+    ~read_ahead_streambuf() override;
+
+    // Whether reading the file ahead pays for the thread or io_uring and the buffers it takes: not with a
+    // depth of 0, for a file of one block or less, or for a pipe, which can't be read at an offset
+    static bool worthwhile(std::filesystem::path const& file_path, read_ahead_options const& options);
+
+    // "io_uring" or "thread"
+    char const* backend() const noexcept;
+
+protected:
+    int_type underflow() override;
+    // Seeking restarts the reads at the new position. Only absolute positions (and tellg) are supported
+    pos_type seekoff(off_type offset, std::ios::seekdir direction, std::ios::openmode which) override;
+    pos_type seekpos(pos_type position, std::ios::openmode which) override;
+
+private:
+    std::unique_ptr<reader> reader_;
+    std::uint64_t offset_ = 0; // File offset of the block in the get area
+};
+
+} // namespace mlp::chess
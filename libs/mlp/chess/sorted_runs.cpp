@@ -0,0 +1,34 @@
+#include <mlp/chess/sorted_runs.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <unistd.h>
+
+namespace mlp::chess
+{
+
+namespace
+{
+
+// Numbers the run files of the process
+std::atomic<std::uint64_t> run_number{0};
+
+} // anonymous namespace
+
+std::filesystem::path
+write_run(std::filesystem::path const& dir, std::string_view const prefix, std::span<char const> const records)
+{
+    auto run = dir / (std::string(prefix) + "-" + std::to_string(::getpid()) + "-" + std::to_string(run_number++)
+                      + ".run");
+    std::ofstream output(run, std::ios::binary | std::ios::trunc);
+    output.write(records.data(), static_cast<std::streamsize>(records.size()));
+    if (!output.flush())
+    {
+        throw std::runtime_error("Could not write run file: " + run.string());
+    }
+    return run;
+}
+
+} // namespace mlp::chess
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace mlp::chess
+{
+
+// External sorting of records that don't fit in memory: they are collected in a vector, which is sorted
+// and spilled to a run file whenever it grows too large, then the runs and what is left in memory are
+// merged back in order. Records are trivially copyable and written as they are in memory, so run files
+// are only meant for the process that wrote them.
+
+// Writes records to a new run file in dir, whose name starts with prefix and is unique in the process.
+// Throws std::runtime_error if it can't be written
+std::filesystem::path write_run(std::filesystem::path const& dir, std::string_view prefix,
+                                std::span<char const> records);
+
+// Sorts records, writes them to a new run file (see write_run()) and clears them
+template<typename T>
+std::filesystem::path
+spill_run(std::vector<T>& records, std::filesystem::path const& dir, std::string_view const prefix)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    std::ranges::sort(records);
+    auto run = write_run(dir, prefix, {reinterpret_cast<char const*>(records.data()), records.size() * sizeof(T)});
+    records.clear();
+    return run;
+}
+
+// Merges sorted run files and, last, a sorted vector in memory, in order
+template<typename T>
+class run_merger
+{
+public:
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    run_merger(std::vector<std::filesystem::path> const& runs, std::vector<T> const& in_memory)
+    {
+        for (auto const& run: runs)
+        {
+            auto& input = sources_.emplace_back();
+            input.file.open(run, std::ios::binary);
+            if (!input.file)
+            {
+                throw std::runtime_error("Could not open run file: " + run.string());
+            }
+            input.buffer.resize(buffer_records);
+        }
+        auto& memory = sources_.emplace_back();
+        memory.records = in_memory.data();
+        memory.size = in_memory.size();
+        for (std::size_t i = 0; i < sources_.size(); ++i)
+        {
+            push(i);
+        }
+    }
+
+    bool next(T& record)
+    {
+        if (heap_.empty())
+        {
+            return false;
+        }
+        std::size_t const source = heap_.top().second;
+        record = heap_.top().first;
+        heap_.pop();
+        push(source);
+        return true;
+    }
+
+private:
+    // Records read from a run file at a time
+    static constexpr std::size_t buffer_records = 4096;
+
+    struct source
+    {
+        std::ifstream file;     // Not open for the vector in memory
+        std::vector<T> buffer;
+        T const* records = nullptr;
+        std::size_t size = 0;
+        std::size_t position = 0;
+    };
+    using head = std::pair<T, std::size_t>;
+
+    // Moves the next record of a source to the heap
+    void push(std::size_t const i)
+    {
+        source& s = sources_[i];
+        if ((s.position == s.size) && s.file.is_open())
+        {
+            s.file.read(reinterpret_cast<char*>(s.buffer.data()),
+                        static_cast<std::streamsize>(s.buffer.size() * sizeof(T)));
+            if (s.file.bad() || (s.file.gcount() % sizeof(T)))
+            {
+                throw std::runtime_error("Could not read run file");
+            }
+            s.records = s.buffer.data();
+            s.size = static_cast<std::size_t>(s.file.gcount()) / sizeof(T);
+            s.position = 0;
+        }
+        if (s.position < s.size)
+        {
+            heap_.emplace(s.records[s.position++], i);
+        }
+    }
+
+    std::vector<source> sources_;
+    std::priority_queue<head, std::vector<head>, std::greater<>> heap_;
+};
+
+} // namespace mlp::chess
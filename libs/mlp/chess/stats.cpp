@@ -0,0 +1,147 @@
+#include <mlp/chess/stats.hpp>
+
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+
+namespace mlp::chess::stats
+{
+
+#ifdef MLP_CHESS_STATS
+namespace
+{
+
+std::mutex retired_mutex;
+totals retired;
+
+// Clock ticks are converted to nanoseconds by comparing both clocks over the whole run
+struct clock_origin
+{
+    std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+    std::uint64_t tick = ticks();
+};
+clock_origin const origin;
+
+} // anonymous namespace
+#endif
+
+char const*
+name(counter const c) noexcept
+{
+    switch (c)
+    {
+        case counter::bytes_read: return "bytes_read";
+        case counter::games: return "games";
+        case counter::plies: return "plies";
+        case counter::ambiguities: return "ambiguities";
+        case counter::failures: return "failures";
+        case counter::count: break;
+    }
+    return "";
+}
+
+char const*
+name(phase const p) noexcept
+{
+    switch (p)
+    {
+        case phase::read_lines: return "read_lines";
+        case phase::strip_annotations: return "strip_annotations";
+        case phase::parse_moves: return "parse_moves";
+        case phase::identify_piece: return "identify_piece";
+        case phase::board_move: return "board_move";
+        case phase::count: break;
+    }
+    return "";
+}
+
+totals&
+totals::operator+=(totals const& other) noexcept
+{
+    for (std::size_t i = 0; i < counter_count; ++i)
+    {
+        counters[i] += other.counters[i];
+    }
+    for (std::size_t i = 0; i < phase_count; ++i)
+    {
+        calls[i] += other.calls[i];
+        samples[i] += other.samples[i];
+        times[i] += other.times[i];
+    }
+    return *this;
+}
+
+#ifdef MLP_CHESS_STATS
+thread_totals::~thread_totals()
+{
+    std::lock_guard const lock(retired_mutex);
+    retired += values;
+}
+#endif
+
+totals
+collect()
+{
+    totals sum;
+#ifdef MLP_CHESS_STATS
+    {
+        std::lock_guard const lock(retired_mutex);
+        sum = retired;
+    }
+    sum += local();
+    auto const elapsed = std::chrono::steady_clock::now() - origin.time;
+    std::uint64_t const elapsed_ticks = ticks() - origin.tick;
+    sum.elapsed_ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    double const ns_per_tick = elapsed_ticks ? (static_cast<double>(sum.elapsed_ns) / elapsed_ticks) : 1.0;
+    for (std::size_t i = 0; i < phase_count; ++i)
+    {
+        double const scale = sum.samples[i] ? (static_cast<double>(sum.calls[i]) / sum.samples[i]) : 0.0;
+        sum.times[i] = static_cast<std::uint64_t>(sum.times[i] * ns_per_tick * scale);
+    }
+#endif
+    return sum;
+}
+
+void
+print_text(std::ostream& os, totals const& values)
+{
+    auto const flags = os.flags();
+    for (std::size_t i = 0; i < counter_count; ++i)
+    {
+        os << std::left << std::setw(20) << name(static_cast<counter>(i)) << std::right << std::setw(16)
+           << values.counters[i] << "\n";
+    }
+    os << std::left << std::setw(20) << "phase" << std::right << std::setw(16) << "calls" << std::setw(12) << "ms"
+       << std::setw(10) << "ns/call" << std::setw(8) << "%" << "\n";
+    for (std::size_t i = 0; i < phase_count; ++i)
+    {
+        double const ms = values.times[i] / 1e6;
+        os << std::left << std::setw(20) << name(static_cast<phase>(i)) << std::right << std::setw(16)
+           << values.calls[i] << std::fixed << std::setprecision(1) << std::setw(12) << ms << std::setw(10)
+           << (values.calls[i] ? (static_cast<double>(values.times[i]) / values.calls[i]) : 0.0) << std::setw(8)
+           << (values.elapsed_ns ? (100.0 * values.times[i] / values.elapsed_ns) : 0.0) << "\n";
+    }
+    os << std::left << std::setw(20) << "elapsed" << std::right << std::setw(28) << std::fixed << std::setprecision(1)
+       << (values.elapsed_ns / 1e6) << "\n";
+    os.flags(flags);
+}
+
+void
+print_json(std::ostream& os, totals const& values)
+{
+    os << "{\n  \"counters\": {";
+    for (std::size_t i = 0; i < counter_count; ++i)
+    {
+        os << (i ? ", " : "") << "\"" << name(static_cast<counter>(i)) << "\": " << values.counters[i];
+    }
+    os << "},\n  \"phases\": {";
+    for (std::size_t i = 0; i < phase_count; ++i)
+    {
+        os << (i ? "," : "") << "\n    \"" << name(static_cast<phase>(i)) << "\": {\"calls\": " << values.calls[i]
+           << ", \"ns\": " << values.times[i] << "}";
+    }
+    os << "\n  },\n  \"elapsed_ns\": " << values.elapsed_ns << "\n}\n";
+}
+
+} // namespace mlp::chess::stats
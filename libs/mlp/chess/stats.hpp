@@ -0,0 +1,145 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+#ifdef MLP_CHESS_STATS
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+#endif
+
+// Counters and phase timers for `chess --stats`. They are only compiled in when MLP_CHESS_STATS is
+// defined (cmake -DMLP_CHESS_STATS=ON); otherwise MLP_CHESS_COUNT and MLP_CHESS_TIME expand to nothing.
+//
+//   MLP_CHESS_COUNT(plies, moves.size());
+//   MLP_CHESS_TIME(board_move); // Times the rest of the enclosing scope
+#ifdef MLP_CHESS_STATS
+#define MLP_CHESS_COUNT(name, n) \
+    (::mlp::chess::stats::local().counters[static_cast<std::size_t>(::mlp::chess::stats::counter::name)] += (n))
+#define MLP_CHESS_TIME(name) \
+    ::mlp::chess::stats::scoped_timer const mlp_chess_timer_##name(::mlp::chess::stats::phase::name)
+#else
+#define MLP_CHESS_COUNT(name, n) static_cast<void>(0)
+#define MLP_CHESS_TIME(name) static_cast<void>(0)
+#endif
+
+namespace mlp::chess::stats
+{
+
+#ifdef MLP_CHESS_STATS
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+enum class counter: std::size_t
+{
+    bytes_read,
+    games,
+    plies,
+    ambiguities, // Moves more than one piece could make
+    failures,    // Games skipped by --keep-going
+    count
+};
+
+enum class phase: std::size_t
+{
+    read_lines,        // Reading lines, or finding a game's extent in a mapped file
+    strip_annotations,
+    parse_moves,       // Tokenizing the movetext and parsing its SAN moves
+    identify_piece,    // board::identify_moving_piece
+    board_move,        // board::move and castling
+    count
+};
+
+constexpr std::size_t counter_count = static_cast<std::size_t>(counter::count);
+constexpr std::size_t phase_count = static_cast<std::size_t>(phase::count);
+
+char const* name(counter c) noexcept;
+char const* name(phase p) noexcept;
+
+struct totals
+{
+    std::array<std::uint64_t, counter_count> counters{};
+    std::array<std::uint64_t, phase_count> calls{};
+    std::array<std::uint64_t, phase_count> samples{}; // Calls that were timed
+    std::array<std::uint64_t, phase_count> times{};   // Ticks of the timed calls, then ns of all calls
+    std::uint64_t elapsed_ns = 0;                     // Since the program started, set by collect()
+
+    std::uint64_t operator[](counter const c) const noexcept { return counters[static_cast<std::size_t>(c)]; }
+    totals& operator+=(totals const& other) noexcept;
+};
+
+#ifdef MLP_CHESS_STATS
+// The calling thread's totals. They are added up with the rest when the thread exits
+struct thread_totals
+{
+    totals values;
+    ~thread_totals();
+};
+inline thread_local thread_totals current_thread;
+
+inline totals&
+local() noexcept
+{
+    return current_thread.values;
+}
+
+// A cheap clock: the time stamp counter where there is one
+inline std::uint64_t
+ticks() noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+// Reading the clock costs about as much as a call to board::move, so only one call in
+// timer_sample_interval of each phase is timed; collect() scales the sampled time up to all calls
+constexpr std::uint64_t timer_sample_interval = 16;
+
+class scoped_timer
+{
+public:
+    explicit scoped_timer(phase const p) noexcept:
+        values_(local()),
+        phase_(static_cast<std::size_t>(p)),
+        sampled_((values_.calls[phase_]++ % timer_sample_interval) == 0),
+        start_(sampled_ ? ticks() : 0)
+    {
+    }
+    scoped_timer(scoped_timer const&) = delete;
+    scoped_timer& operator=(scoped_timer const&) = delete;
+    ~scoped_timer()
+    {
+        if (sampled_)
+        {
+            values_.times[phase_] += ticks() - start_;
+            ++values_.samples[phase_];
+        }
+    }
+
+private:
+    totals& values_;
+    std::size_t phase_;
+    bool sampled_;
+    std::uint64_t start_;
+};
+#endif
+
+// The totals of the threads that have exited and of the calling thread, with times in nanoseconds.
+// Worker threads are joined before their results are used, so after a run this covers all of them.
+// All zero unless stats are compiled in
+totals collect();
+
+void print_text(std::ostream& os, totals const& values);
+void print_json(std::ostream& os, totals const& values);
+
+} // namespace mlp::chess::stats
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <bit>
+
 namespace mlp::chess
 {
 
@@ -9,4 +11,16 @@ struct overloaded : Ts ... { using Ts::operator()...; };
 template<class... Ts>
 overloaded(Ts...) -> overloaded<Ts...>;
 
+// Converts between native and little endian byte order, the order of our binary file formats
+template<typename T>
+constexpr T
+to_little_endian(T const value) noexcept
+{
+    if constexpr (std::endian::native == std::endian::big)
+    {
+        return std::byteswap(value);
+    }
+    return value;
+}
+
 } // namespace mlp::chess
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace mlp::chess
+{
+
+// 64-bit position identity, equal for the same placement, side to move, castling rights and en passant file
+using zobrist_hash = std::uint64_t;
+
+struct zobrist_keys
+{
+    // Indexed by colour_index(), type_index() and square_index()
+    std::array<std::array<std::array<zobrist_hash, 64>, 6>, 2> pieces;
+    zobrist_hash black_to_move;
+    // Indexed by the board's castling rights bits
+    std::array<zobrist_hash, 16> castling;
+    std::array<zobrist_hash, 8> en_passant_file;
+};
+
+// Generated at compile time with splitmix64 from a fixed seed, so hashes are stable across builds and runs
+inline constexpr zobrist_keys zobrist = []
+{
+    std::uint64_t state = 0x6d6c705f63686573; // "mlp_ches"
+    auto const next = [&state]
+    {
+        std::uint64_t z = (state += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    };
+    zobrist_keys keys{};
+    for (auto& colour: keys.pieces)
+    {
+        for (auto& type: colour)
+        {
+            for (auto& key: type)
+            {
+                key = next();
+            }
+        }
+    }
+    keys.black_to_move = next();
+    // No rights hash to 0, so a position that never had any is unaffected
+    for (std::size_t rights = 1; rights < keys.castling.size(); ++rights)
+    {
+        keys.castling[rights] = next();
+    }
+    for (auto& key: keys.en_passant_file)
+    {
+        key = next();
+    }
+    return keys;
+}();
+
+} // namespace mlp::chess
@@ -1,9 +1,31 @@
+#include <mlp/chess/binary_games.hpp>
 #include <mlp/chess/board.hpp>
+#include <mlp/chess/checkpoint.hpp>
+#include <mlp/chess/compressed_file.hpp>
+#include <mlp/chess/game_dedup.hpp>
+#include <mlp/chess/mapped_file.hpp>
+#include <mlp/chess/opening_tree.hpp>
+#include <mlp/chess/pgn_follow.hpp>
+#include <mlp/chess/pgn_parallel.hpp>
 #include <mlp/chess/pgn_parser.hpp>
-#include <mlp/chess/utility.hpp>
+#include <mlp/chess/pgn_replay.hpp>
+#include <mlp/chess/position_export.hpp>
+#include <mlp/chess/position_index.hpp>
+#include <mlp/chess/stats.hpp>
 
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <chrono>
+#include <exception>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <string_view>
+#include <vector>
 
 using namespace mlp;
 
@@ -15,73 +37,1293 @@ print_usage(std::ostream& os, const char* const message = nullptr)
     {
         os << message << "\n";
     }
-    os << "Usage: " << exe << " <game.pgn>\n";
+    os << "Usage: " << exe << " [options] <game.pgn | games.bin>\n"
+       << "       " << exe << " [options] --dedup <out.pgn> <game.pgn>...\n"
+       << "  --mmap               Memory map the PGN file instead of reading it line by line\n"
+       << "  -j, --threads N      Parse and replay games on N threads (0 = all cores). Implies --mmap. Ignored with\n"
+       << "                       --write-binary, --variations, --follow, compressed and binary game files, which\n"
+       << "                       are read sequentially\n"
+       << "  --write-binary FILE  Also save the replayed games to a binary game file\n"
+       << "  --read-ahead N       Reads kept in flight while streaming an uncompressed file, through io_uring where\n"
+       << "                       available (default 4, 0 reads synchronously)\n"
+       << "  --read-block-size N  KiB per read-ahead read (default 1024)\n"
+       << "  --game N             Only print the final board of game N (from 1), found through the index FILE.idx\n"
+       << "                       next to the PGN file. The index is built on first use and whenever the file changes\n"
+       << "  --variations         Replay the variations of annotated games too, and export their positions.\n"
+       << "                       Games are parsed sequentially\n"
+       << "Game selection, applied to the tags before a game's moves are parsed:\n"
+       << "  --white NAME         White player\n"
+       << "  --black NAME         Black player\n"
+       << "  --result RESULT      Game result, e.g. 1-0\n"
+       << "  --eco PREFIX         ECO code prefix, e.g. B9\n"
+       << "  --min-elo N          Both players rated at least N\n"
+       << "  --date-from DATE     Played on or after DATE (YYYY.MM.DD)\n"
+       << "  --date-to DATE       Played on or before DATE (YYYY.MM.DD)\n"
+       << "  --tag NAME=VALUE     Any tag equal to VALUE\n"
+       << "Opening explorer:\n"
+       << "  --opening-tree FILE  Count the moves and results of every position in the opening and save them to\n"
+       << "                       FILE instead of printing the final boards\n"
+       << "  --opening-depth N    Number of plies counted by --opening-tree (default 20)\n"
+       << "  --explore FILE       Print the moves saved in opening tree FILE for the position after the movetext\n"
+       << "                       given in place of the PGN file, e.g. --explore tree.bin \"1. e4 c5\"\n"
+       << "Position search:\n"
+       << "  --position-index FILE  Index every position of every game by material and hash, and save it to FILE\n"
+       << "                         instead of printing the final boards\n"
+       << "  --find-position FILE   Print the game number and ply of every occurrence in position index FILE of the\n"
+       << "                         FEN, or position after the movetext, given in place of the PGN file\n"
+       << "  --find-material FILE   Print the games of position index FILE that had the material given in place of\n"
+       << "                         the PGN file, e.g. KRPkr, with the first ply they had it\n"
+       << "Position export:\n"
+       << "  --export-positions FILE  Write every position of every game to FILE (- for standard output, which\n"
+       << "                           sends diagnostics to standard error) instead of printing the final boards\n"
+       << "  --export-format FORMAT   fen (default), epd or binary (fixed size 40 byte records)\n"
+       << "Error handling:\n"
+       << "  --keep-going         Skip games that fail to parse or replay, logging their byte offset and the reason\n"
+       << "  --error-log FILE     Where --keep-going logs the skipped games (default standard error)\n"
+       << "  --checkpoint FILE    Save how far the run got to FILE every --checkpoint-every games, and resume from\n"
+       << "                       it if it exists. Printed boards and exported positions are written from there on\n"
+       << "                       (an exported position file is cut back to the checkpoint first)\n"
+       << "  --checkpoint-every N Games between checkpoints (default 10000)\n"
+       << "Deduplication:\n"
+       << "  --dedup FILE         Copy the games of one or more PGN files to FILE, leaving out every game whose moves\n"
+       << "                       repeat an earlier game's, e.g. --dedup all.pgn a.pgn b.pgn. Games are told apart by\n"
+       << "                       a 128-bit fingerprint of their moves, sorted on disk when they don't fit in memory\n"
+       << "  --dedup-tags         Only count games as repeats if their White, Black, Date and Round tags match too,\n"
+       << "                       ignoring case, spaces and punctuation\n"
+       << "  --dedup-memory N     MiB of fingerprints sorted in memory before they are spilled (default 256)\n"
+       << "  --dedup-temp DIR     Where the spilled fingerprints go (default the system's temporary directory)\n"
+       << "Live files:\n"
+       << "  --follow             Keep playing the games appended to the PGN file, as soon as each is complete,\n"
+       << "                       until interrupted. Only the appended bytes are read. With --checkpoint, a rerun\n"
+       << "                       carries on after the last game played\n"
+       << "  --follow-idle N      With --follow, stop after N seconds without changes to the file\n"
+       << "Instrumentation, in builds configured with -DMLP_CHESS_STATS=ON:\n"
+       << "  --stats              Print bytes, games and plies read and the time spent in each phase to standard\n"
+       << "                       error once done, added up over all threads\n"
+       << "  --stats-format FORMAT  text (default) or json\n"
+       << "PGN files compressed with gzip, bzip2 or zstd are decompressed on the fly, on a thread of their own\n"
+       << "Binary game files (see --write-binary) are detected automatically and replayed without parsing\n";
 }
 
-int main(int const argc, char** const argv)
-try
+static bool
+parse_number(char const* const str, unsigned& value)
 {
-    std::ios::sync_with_stdio(false);
-    if (argc < 2)
+    auto const end = str + std::char_traits<char>::length(str);
+    auto const result = std::from_chars(str, end, value);
+    return (result.ec == std::errc{}) && (result.ptr == end);
+}
+
+// Prints the final board of a game, as formatted by operator<<
+static void
+print_game(std::ostream& os, std::size_t const game_id, std::string_view const board_text)
+{
+    if (game_id > 1)
     {
-        print_usage(std::cout, "Missing pgn file path");
-        return EXIT_FAILURE;
+        os << "\n";
     }
+#ifdef MLP_CHESS_DEBUG
+    os << "\nEndgame " << game_id << ": \n";
+#endif
+    os << board_text;
+}
 
-    chess::pgn::parser pgn_parser;
+// Calls write for every position of a game, from the initial position to the final one
+template<typename Write>
+static void
+for_each_position(std::span<chess::packed_move const> const moves, Write&& write)
+{
+    thread_local chess::board chess_board;
+    chess_board.reset();
+    write(chess_board);
+    for (auto const move: moves)
+    {
+        chess_board.move(move);
+        write(chess_board);
+    }
+}
+
+// The material of every position of a game, from the initial position to the final one
+static void
+material_history(std::span<chess::packed_move const> const moves, std::vector<chess::material_signature>& materials)
+{
+    materials.clear();
+    for_each_position(moves, [&](chess::board const& position) { materials.push_back(chess::material_of(position)); });
+}
+
+// The games skipped by --keep-going, one "offset<TAB>reason" line each
+class error_log
+{
+public:
+    error_log(char const* const file_path, bool const append)
+    {
+        if (file_path)
+        {
+            file_.exceptions(std::ios::badbit | std::ios::failbit);
+            file_.open(file_path, append ? std::ios::app : std::ios::trunc);
+        }
+    }
+
+    std::uint64_t count() const noexcept { return count_; }
+    void set_count(std::uint64_t const count) noexcept { count_ = count; }
+
+    void record(std::uint64_t const offset, std::string_view const reason)
+    {
+        auto& os = file_.is_open() ? static_cast<std::ostream&>(file_) : std::cerr;
+        std::string line(reason.substr(0, reason.find('\n')));
+        os << offset << "\t" << line << "\n";
+        ++count_;
+        MLP_CHESS_COUNT(failures, 1);
+    }
+    void flush() { file_.is_open() ? file_.flush() : std::cerr.flush(); }
+
+private:
+    std::ofstream file_;
+    std::uint64_t count_ = 0;
+};
+
+// Prints the moves played from the position reached by the given movetext
+static void
+explore(char const* const tree_path, std::string_view const move_text)
+{
+    chess::opening_tree const tree(tree_path);
     chess::board chess_board;
+    chess::pgn::parser pgn_parser;
+    std::vector<chess::pgn::player_move> moves;
+    // Terminated like a game in progress, so the movetext may end after either side's move
+    std::string const game = std::string(move_text) + " *";
+    pgn_parser.open(game.data(), game.data() + game.size());
+    if (pgn_parser.next_game(moves))
+    {
+        chess::pgn::replay(chess_board, moves);
+    }
+    std::cout << "move games white draws black\n";
+    for (auto const& stats: tree.find(chess_board.hash()))
+    {
+        std::cout << stats.move << " " << stats.games << " " << stats.white_wins << " " << stats.draws << " "
+                  << stats.black_wins << "\n";
+    }
+}
+
+// Prints the games, and plies, of a position index that reached a position (a FEN or the position after a
+// movetext) or had some material
+static void
+find_positions(char const* const index_path, std::string_view const query, bool const material)
+{
+    chess::position_index const index(index_path);
+    std::vector<chess::position_hit> hits;
+    if (material)
+    {
+        hits = index.find(chess::parse_material(query));
+    }
+    else if (query.find('/') != std::string_view::npos)
+    {
+        hits = index.find(chess::board(query));
+    }
+    else
+    {
+        chess::board chess_board;
+        chess::pgn::parser pgn_parser;
+        std::vector<chess::pgn::player_move> moves;
+        std::string const game = std::string(query) + " *";
+        pgn_parser.open(game.data(), game.data() + game.size());
+        if (pgn_parser.next_game(moves))
+        {
+            chess::pgn::replay(chess_board, moves);
+        }
+        hits = index.find(chess_board);
+    }
+    std::cout << "game ply\n";
+    for (auto const& hit: hits)
+    {
+        std::cout << hit.game << " " << hit.ply << "\n";
+    }
+}
+
+struct dedup_options
+{
+    bool key_tags = false;
+    std::size_t memory_limit = std::size_t{256} << 20;
+    std::filesystem::path temp_dir;
+    unsigned thread_count = 1;
+};
 
+// Copies the games of pgn_paths to output_path but the repeats of earlier games. The first pass
+// fingerprints every game, the second one copies the text of the games that are kept. Game numbers run on
+// from one file to the next, and games that fail are left out too
+static void
+dedup(std::span<char const* const> const pgn_paths, char const* const output_path, dedup_options const& options,
+      chess::pgn::tag_filter const& filter, error_log* const errors)
+{
+    chess::duplicate_finder finder(options.memory_limit, options.temp_dir);
+    auto const game_fingerprint = [&](chess::pgn::parser& parser, std::vector<chess::pgn::player_move>& moves)
+    {
+        thread_local chess::board chess_board;
+        thread_local std::vector<chess::packed_move> packed_moves;
+        thread_local std::string key_tags;
+        chess_board.reset();
+        chess::pgn::replay(chess_board, moves);
+        chess::pgn::pack(moves, packed_moves);
+        key_tags.clear();
+        if (options.key_tags)
+        {
+            chess::append_key_tags(parser.tags(), key_tags);
+        }
+        return chess::fingerprint(packed_moves, key_tags);
+    };
     std::vector<chess::pgn::player_move> moves;
-    pgn_parser.parse_file(argv[1], moves);
+    for (char const* const pgn_path: pgn_paths)
+    {
+        auto const record_error = [&](std::uint64_t const offset, std::string_view const reason)
+        {
+            errors->record(offset, std::string(pgn_path) + ": " + std::string(reason));
+            finder.add_dropped();
+        };
+        if (options.thread_count != 1)
+        {
+            // The fingerprints are computed on the workers and added in game order
+            chess::pgn::parallel_parser pgn_parser(options.thread_count);
+            if (!filter.empty())
+            {
+                pgn_parser.set_filter(filter);
+            }
+            if (errors)
+            {
+                pgn_parser.set_error_handler(record_error);
+            }
+            pgn_parser.run(pgn_path,
+                           [&](chess::pgn::parser& parser, std::vector<chess::pgn::player_move>& game_moves,
+                               std::string& output)
+                           {
+                               auto const fingerprint = game_fingerprint(parser, game_moves);
+                               output.append(reinterpret_cast<char const*>(&fingerprint), sizeof(fingerprint));
+                           },
+                           [&](std::size_t, std::string_view const output)
+                           {
+                               chess::game_fingerprint fingerprint;
+                               std::memcpy(&fingerprint, output.data(), sizeof(fingerprint));
+                               finder.add(fingerprint);
+                           });
+            continue;
+        }
+        chess::pgn::parser pgn_parser;
+        if (!filter.empty())
+        {
+            pgn_parser.set_filter(filter);
+        }
+        pgn_parser.open(pgn_path, chess::pgn::input_mode::mapped);
+        while (true)
+        {
+            std::uint64_t const offset = pgn_parser.offset();
+            try
+            {
+                if (!pgn_parser.next_game(moves))
+                {
+                    break;
+                }
+                finder.add(game_fingerprint(pgn_parser, moves));
+            }
+            catch (std::exception const& e)
+            {
+                if (!errors || (pgn_parser.offset() == offset))
+                {
+                    throw;
+                }
+                record_error(pgn_parser.game_offset(), e.what());
+            }
+        }
+    }
+    finder.finish();
 
-#ifdef MLP_CHESS_DEBUG
-    std::cout << "\nMove 0:\n" << chess_board << "\n";
-#endif
+    std::ofstream output;
+    output.exceptions(std::ios::badbit | std::ios::failbit);
+    output.open(output_path, std::ios::binary | std::ios::trunc);
+    std::uint64_t game = 0;
+    std::uint64_t written = 0;
+    for (char const* const pgn_path: pgn_paths)
+    {
+        chess::mapped_file const text(pgn_path);
+        chess::pgn::parser pgn_parser;
+        if (!filter.empty())
+        {
+            pgn_parser.set_filter(filter);
+        }
+        pgn_parser.open(text.begin(), text.end());
+        while (true)
+        {
+            std::uint64_t const offset = pgn_parser.offset();
+            try
+            {
+                if (!pgn_parser.next_game(moves))
+                {
+                    break;
+                }
+            }
+            catch (std::exception const&)
+            {
+                // Already logged by the first pass, and dropped
+                if (pgn_parser.offset() == offset)
+                {
+                    throw;
+                }
+            }
+            if (finder.is_dropped(game++))
+            {
+                continue;
+            }
+            std::string_view game_text(text.data() + pgn_parser.game_offset(),
+                                       pgn_parser.offset() - pgn_parser.game_offset());
+            game_text = game_text.substr(0, game_text.find_last_not_of(" \t\r\n") + 1);
+            output << game_text << "\n\n";
+            ++written;
+        }
+    }
+    if (game != finder.game_count())
+    {
+        throw std::runtime_error("The PGN files changed while they were deduplicated");
+    }
+    output.close();
+    std::cout << written << " games written, " << finder.duplicate_count() << " repeats left out\n";
+}
 
-    int move_id = 2;
-    for (auto& move_var: moves)
+// The command line
+struct options
+{
+    chess::pgn::input_mode input_mode = chess::pgn::input_mode::stream;
+    unsigned thread_count = 1;
+    std::vector<char const*> pgn_paths;
+    char const* binary_output_path = nullptr;
+    char const* tree_path = nullptr;
+    char const* explore_path = nullptr;
+    char const* position_index_path = nullptr;
+    char const* find_path = nullptr;
+    bool find_material = false;
+    unsigned tree_depth = 20;
+    bool variations = false;
+    char const* positions_path = nullptr;
+    chess::position_format positions_format = chess::position_format::fen;
+    bool keep_going = false;
+    char const* error_log_path = nullptr;
+    char const* checkpoint_path = nullptr;
+    unsigned checkpoint_every = 10000;
+    chess::read_ahead_options read_ahead;
+    bool follow = false;
+    unsigned follow_idle = 0;
+    char const* dedup_path = nullptr;
+    unsigned game_number = 0;
+    dedup_options dedup;
+    bool stats = false;
+    bool stats_json = false;
+    chess::pgn::tag_filter filter;
+};
+
+// Prints the usage and returns false if the command line is malformed
+static bool
+parse_options(int const argc, char** const argv, options& opts)
+{
+    for (int arg = 1; arg < argc; ++arg)
     {
-#ifdef MLP_CHESS_DEBUG
-        std::cout << "\nMove " << (move_id/2) << ": " <<  move_var << "\n";
-#endif
+        std::string_view const option = argv[arg];
+        auto const has_value = [&]
+        {
+            if (++arg == argc)
+            {
+                print_usage(std::cout, ("Expected a value after " + std::string(option)).c_str());
+                return false;
+            }
+            return true;
+        };
+        if (option == "--mmap")
+        {
+            opts.input_mode = chess::pgn::input_mode::mapped;
+        }
+        else if ((option == "-j") || (option == "--threads"))
+        {
+            if (!has_value())
+            {
+                return false;
+            }
+            if (!parse_number(argv[arg], opts.thread_count))
+            {
+                print_usage(std::cout, "Expected a thread count after -j/--threads");
+                return false;
+            }
+        }
+        else if ((option == "--read-ahead") || (option == "--read-block-size"))
+        {
+            unsigned value = 0;
+            if (!has_value())
+            {
+                return false;
+            }
+            bool const depth = (option == "--read-ahead");
+            if (!parse_number(argv[arg], value) || (!depth && (value == 0)))
+            {
+                print_usage(std::cout, depth ? "Expected a number of reads after --read-ahead"
+                                             : "Expected a size in KiB after --read-block-size");
+                return false;
+            }
+            (depth ? opts.read_ahead.depth : opts.read_ahead.block_size) = depth ? value : (std::size_t{value} << 10);
+        }
+        else if (option == "--follow")
+        {
+            opts.follow = true;
+        }
+        else if (option == "--follow-idle")
+        {
+            if (!has_value())
+            {
+                return false;
+            }
+            if (!parse_number(argv[arg], opts.follow_idle) || (opts.follow_idle == 0))
+            {
+                print_usage(std::cout, "Expected a number of seconds after --follow-idle");
+                return false;
+            }
+        }
+        else if ((option == "--dedup") || (option == "--dedup-temp"))
+        {
+            if (!has_value())
+            {
+                return false;
+            }
+            if (option == "--dedup")
+            {
+                opts.dedup_path = argv[arg];
+            }
+            else
+            {
+                opts.dedup.temp_dir = argv[arg];
+            }
+        }
+        else if (option == "--dedup-tags")
+        {
+            opts.dedup.key_tags = true;
+        }
+        else if (option == "--dedup-memory")
+        {
+            unsigned memory = 0;
+            if (!has_value())
+            {
+                return false;
+            }
+            if (!parse_number(argv[arg], memory) || (memory == 0))
+            {
+                print_usage(std::cout, "Expected a size in MiB after --dedup-memory");
+                return false;
+            }
+            opts.dedup.memory_limit = std::size_t{memory} << 20;
+        }
+        else if (option == "--game")
+        {
+            if (!has_value())
+            {
+                return false;
+            }
+            if (!parse_number(argv[arg], opts.game_number) || (opts.game_number == 0))
+            {
+                print_usage(std::cout, "Expected a game number after --game");
+                return false;
+            }
+        }
+        else if (option == "--variations")
+        {
+            opts.variations = true;
+        }
+        else if (option == "--write-binary")
+        {
+            if (!has_value())
+            {
+                return false;
+            }
+            opts.binary_output_path = argv[arg];
+        }
+        else if ((option == "--opening-tree") || (option == "--explore"))
+        {
+            if (!has_value())
+            {
+                return false;
+            }
+            ((option == "--opening-tree") ? opts.tree_path : opts.explore_path) = argv[arg];
+        }
+        else if (option == "--position-index")
+        {
+            if (!has_value())
+            {
+                return false;
+            }
+            opts.position_index_path = argv[arg];
+        }
+        else if ((option == "--find-position") || (option == "--find-material"))
+        {
+            if (!has_value())
+            {
+                return false;
+            }
+            opts.find_path = argv[arg];
+            opts.find_material = (option == "--find-material");
+        }
+        else if (option == "--export-positions")
+        {
+            if (!has_value())
+            {
+                return false;
+            }
+            opts.positions_path = argv[arg];
+        }
+        else if (option == "--export-format")
+        {
+            if (!has_value())
+            {
+                return false;
+            }
+            std::string_view const name = argv[arg];
+            if ((name != "fen") && (name != "epd") && (name != "binary"))
+            {
+                print_usage(std::cout, "Expected fen, epd or binary after --export-format");
+                return false;
+            }
+            opts.positions_format = chess::to_position_format(name);
+        }
+        else if (option == "--keep-going")
+        {
+            opts.keep_going = true;
+        }
+        else if ((option == "--error-log") || (option == "--checkpoint"))
+        {
+            if (!has_value())
+            {
+                return false;
+            }
+            ((option == "--error-log") ? opts.error_log_path : opts.checkpoint_path) = argv[arg];
+        }
+        else if (option == "--checkpoint-every")
+        {
+            if (!has_value())
+            {
+                return false;
+            }
+            if (!parse_number(argv[arg], opts.checkpoint_every) || (opts.checkpoint_every == 0))
+            {
+                print_usage(std::cout, "Expected a number of games after --checkpoint-every");
+                return false;
+            }
+        }
+        else if (option == "--stats")
+        {
+            opts.stats = true;
+        }
+        else if (option == "--stats-format")
+        {
+            if (!has_value())
+            {
+                return false;
+            }
+            std::string_view const format = argv[arg];
+            if ((format != "text") && (format != "json"))
+            {
+                print_usage(std::cout, "Expected text or json after --stats-format");
+                return false;
+            }
+            opts.stats_json = (format == "json");
+        }
+        else if (option == "--opening-depth")
+        {
+            if (!has_value())
+            {
+                return false;
+            }
+            if (!parse_number(argv[arg], opts.tree_depth))
+            {
+                print_usage(std::cout, "Expected a number of plies after --opening-depth");
+                return false;
+            }
+        }
+        else if ((option == "--white") || (option == "--black") || (option == "--result"))
+        {
+            if (!has_value())
+            {
+                return false;
+            }
+            auto const key = (option == "--white") ? chess::pgn::tag_key::White
+                           : (option == "--black") ? chess::pgn::tag_key::Black
+                           : chess::pgn::tag_key::Result;
+            opts.filter.require_equal(key, argv[arg]);
+        }
+        else if (option == "--eco")
+        {
+            if (!has_value())
+            {
+                return false;
+            }
+            opts.filter.require_prefix(chess::pgn::tag_key::ECO, argv[arg]);
+        }
+        else if (option == "--min-elo")
+        {
+            unsigned min_elo = 0;
+            if (!has_value())
+            {
+                return false;
+            }
+            if (!parse_number(argv[arg], min_elo))
+            {
+                print_usage(std::cout, "Expected a rating after --min-elo");
+                return false;
+            }
+            opts.filter.require_at_least(chess::pgn::tag_key::WhiteElo, min_elo);
+            opts.filter.require_at_least(chess::pgn::tag_key::BlackElo, min_elo);
+        }
+        else if ((option == "--date-from") || (option == "--date-to"))
+        {
+            if (!has_value())
+            {
+                return false;
+            }
+            bool const from = (option == "--date-from");
+            opts.filter.require_range(chess::pgn::tag_key::Date, from ? argv[arg] : "", from ? "" : argv[arg]);
+        }
+        else if (option == "--tag")
+        {
+            if (!has_value())
+            {
+                return false;
+            }
+            std::string_view const tag = argv[arg];
+            auto const equals = tag.find('=');
+            if ((equals == std::string_view::npos) || (equals == 0))
+            {
+                print_usage(std::cout, "Expected NAME=VALUE after --tag");
+                return false;
+            }
+            opts.filter.require_equal(chess::pgn::intern_tag_key(tag.substr(0, equals)),
+                                 std::string(tag.substr(equals + 1)));
+        }
+        else if (option.starts_with("-"))
+        {
+            print_usage(std::cout, ("Unknown option: " + std::string(option)).c_str());
+            return false;
+        }
+        else
+        {
+            opts.pgn_paths.push_back(argv[arg]);
+        }
+    }
+    return true;
+}
+
+// Prints the counters of --stats, once all the games are done and the worker threads have exited
+static void
+print_stats(options const& opts)
+{
+    if (!opts.stats)
+    {
+        return;
+    }
+    std::cout.flush();
+    auto const totals = chess::stats::collect();
+    opts.stats_json ? chess::stats::print_json(std::cerr, totals) : chess::stats::print_text(std::cerr, totals);
+}
+
+static int
+run_dedup(options& opts)
+{
+    for (char const* const path: opts.pgn_paths)
+    {
+        if (chess::binary_format::is_binary_file(path) || (chess::detect_compression(path) != chess::compression::none))
+        {
+            print_usage(std::cout, "--dedup only reads uncompressed PGN files");
+            return EXIT_FAILURE;
+        }
+    }
+    std::optional<error_log> errors;
+    if (opts.keep_going)
+    {
+        errors.emplace(opts.error_log_path, false);
+    }
+    if (opts.dedup.temp_dir.empty())
+    {
+        opts.dedup.temp_dir = std::filesystem::temp_directory_path();
+    }
+    opts.dedup.thread_count = opts.thread_count;
+    dedup(opts.pgn_paths, opts.dedup_path, opts.dedup, opts.filter, errors ? &*errors : nullptr);
+    print_stats(opts);
+    return EXIT_SUCCESS;
+}
 
-        std::visit(chess::overloaded
-        (
-            [&](chess::pgn::standard_move& move)
+// Prints the final board of --game N, parsed straight from its offset in the file
+static int
+print_indexed_game(options const& opts)
+{
+    char const* const pgn_path = opts.pgn_paths.front();
+    chess::pgn::game_index const index(pgn_path);
+    if (opts.game_number > index.size())
+    {
+        print_usage(std::cout, ("--game " + std::to_string(opts.game_number) + ": " + pgn_path + " has "
+                                + std::to_string(index.size()) + " games").c_str());
+        return EXIT_FAILURE;
+    }
+    chess::pgn::parser pgn_parser;
+    std::vector<chess::pgn::player_move> moves;
+    pgn_parser.parse_game(index, opts.game_number - 1, moves);
+    chess::board chess_board;
+    chess::pgn::replay(chess_board, moves);
+    std::ostringstream text;
+    text << chess_board;
+    print_game(std::cout, 1, text.view());
+    return EXIT_SUCCESS;
+}
+
+// A replayed game, as a game_sink takes it
+struct played_game
+{
+    chess::board const& final_board;           // With the hash history of the main line
+    std::span<chess::packed_move const> moves; // The main line, when game_sink::needs_moves()
+    std::string_view result;                   // The Result tag, when game_sink::needs_result()
+    std::string_view tag_section = {};         // For --write-binary
+    std::string_view positions = {};           // With --variations, the formatted positions of every line
+};
+
+// Where the replayed games go, whatever they were read from: the opening tree, the position index, the
+// exported positions, the binary game file and the printed boards, plus the checkpoints and the error log.
+// A game is formatted first, possibly on a worker thread, then written in game order
+class game_sink
+{
+public:
+    explicit game_sink(options const& opts):
+        opts_(opts),
+        print_boards_(!opts.tree_path && !opts.positions_path && !opts.position_index_path),
+        tree_(opts.tree_depth)
+    {
+        char const* const pgn_path = opts.pgn_paths.front();
+        if (opts.checkpoint_path)
+        {
+            if (auto const resume = chess::ingest_checkpoint::load(opts.checkpoint_path))
+            {
+                // Offsets into another file, or into this one before it was rewritten, land in the middle of games
+                resume->check(pgn_path, opts.follow);
+                checkpoint_ = *resume;
+                resumed_ = true;
+            }
+        }
+        games_ = checkpoint_.games;
+        checkpoint_games_ = checkpoint_.games;
+        if (opts.positions_path)
+        {
+            if (std::string_view(opts.positions_path) == "-")
+            {
+                // The records go to standard output through write(2), so diagnostics must not go to std::cout
+                chess::board::set_diagnostics(std::cerr);
+            }
+            positions_.emplace(opts.positions_path, opts.positions_format, checkpoint_.output_size);
+        }
+        if (opts.keep_going)
+        {
+            errors_.emplace(opts.error_log_path, resumed_);
+            errors_->set_count(checkpoint_.errors);
+        }
+        if (opts.binary_output_path)
+        {
+            binary_output_.emplace(opts.binary_output_path);
+        }
+    }
+
+    // The checkpoint resumed from, if resumed()
+    chess::ingest_checkpoint const& checkpoint() const noexcept { return checkpoint_; }
+    bool resumed() const noexcept { return resumed_; }
+    error_log* errors() noexcept { return errors_ ? &*errors_ : nullptr; }
+    // Printing the boards only needs the final position, not played_game::moves
+    bool needs_moves() const noexcept { return binary_output_ || !print_boards_; }
+    // Only the opening tree counts results, and the tags are only parsed when asked for
+    bool needs_result() const noexcept { return opts_.tree_path != nullptr; }
+
+    // Gives each of `count` workers an opening tree of its own, in its share of the memory. They are merged
+    // by finish()
+    void use_workers(unsigned const count)
+    {
+        for (unsigned worker = 0; opts_.tree_path && (worker < count); ++worker)
+        {
+            worker_trees_.emplace_back(opts_.tree_depth, tree_.memory_limit() / count);
+        }
+    }
+
+    // Appends what write_game() needs of a game to `output`. Safe to call on the workers, each with its own
+    // index (see use_workers()). On the thread that writes the games, `direct` takes the positions instead
+    void format_game(played_game const& game, unsigned const worker, std::string& output,
+                     chess::position_writer* const direct = nullptr)
+    {
+        if (opts_.tree_path)
+        {
+            (worker_trees_.empty() ? tree_ : worker_trees_[worker])
+                .add_game(game.final_board.hash_history(), game.moves, chess::to_game_result(game.result));
+        }
+        if (opts_.position_index_path)
+        {
+            // The ply count, then the hash and the material of every position
+            thread_local std::vector<chess::material_signature> materials;
+            material_history(game.moves, materials);
+            auto const hashes = game.final_board.hash_history();
+            std::uint64_t const plies = std::min(hashes.size(), materials.size());
+            output.append(reinterpret_cast<char const*>(&plies), sizeof(plies));
+            output.append(reinterpret_cast<char const*>(hashes.data()), plies * sizeof(chess::zobrist_hash));
+            output.append(reinterpret_cast<char const*>(materials.data()), plies * sizeof(chess::material_signature));
+        }
+        if (positions_ && direct)
+        {
+            if (opts_.variations)
+            {
+                direct->write_formatted(game.positions);
+            }
+            else
             {
-                if (!chess_board.identify_moving_piece(move.colour, move.piece,
-                                                       move.src, move.dest, move.is_capture))
+                for_each_position(game.moves, [&](chess::board const& position) { direct->write(position); });
+            }
+        }
+        else if (positions_ && opts_.variations)
+        {
+            output += game.positions;
+        }
+        else if (positions_)
+        {
+            for_each_position(game.moves, [&](chess::board const& position)
+            {
+                char record[chess::max_position_size];
+                output.append(record, chess::format_position(position, opts_.positions_format, record));
+            });
+        }
+        if (print_boards_)
+        {
+            thread_local std::ostringstream text;
+            text.str({});
+            text << game.final_board;
+            output += text.view();
+        }
+    }
+
+    // Writes a game formatted by format_game(), in game order
+    void write_game(std::size_t const game_id, std::string_view output)
+    {
+        games_ = game_id;
+        if (opts_.position_index_path)
+        {
+            std::uint64_t plies = 0;
+            std::memcpy(&plies, output.data(), sizeof(plies));
+            output.remove_prefix(sizeof(plies));
+            hashes_.resize(plies);
+            materials_.resize(plies);
+            std::memcpy(hashes_.data(), output.data(), plies * sizeof(chess::zobrist_hash));
+            output.remove_prefix(plies * sizeof(chess::zobrist_hash));
+            std::memcpy(materials_.data(), output.data(), plies * sizeof(chess::material_signature));
+            output.remove_prefix(plies * sizeof(chess::material_signature));
+            position_index_.add_game(static_cast<std::uint32_t>(game_id), hashes_, materials_);
+        }
+        // What is left is either positions (unless written directly) or a board, the boards are only printed
+        // when nothing else is output
+        if (positions_)
+        {
+            positions_->write_formatted(output);
+        }
+        if (print_boards_)
+        {
+            print_game(std::cout, game_id, output);
+        }
+    }
+
+    // Formats and writes the next game, on the calling thread
+    void add_game(played_game const& game)
+    {
+        game_output_.clear();
+        format_game(game, 0, game_output_, positions_ ? &*positions_ : nullptr);
+        if (binary_output_)
+        {
+            binary_output_->write_game(game.tag_section, game.moves);
+        }
+        write_game(games_ + 1, game_output_);
+    }
+
+    // Flushes everything written so far and, with --checkpoint, saves that the games before `offset` are done
+    void save(std::uint64_t const offset)
+    {
+        std::cout.flush();
+        if (positions_)
+        {
+            positions_->flush();
+        }
+        if (errors_)
+        {
+            errors_->flush();
+        }
+        if (!opts_.checkpoint_path)
+        {
+            return;
+        }
+        checkpoint_.offset = offset;
+        checkpoint_.games = games_;
+        checkpoint_.errors = errors_ ? errors_->count() : 0;
+        checkpoint_.output_size = positions_ ? positions_->size() : 0;
+        checkpoint_.stamp(opts_.pgn_paths.front());
+        checkpoint_.save(opts_.checkpoint_path);
+        checkpoint_games_ = games_;
+    }
+
+    // save() with --checkpoint, once --checkpoint-every games have been written since the last one
+    void save_if_due(std::uint64_t const offset)
+    {
+        if (opts_.checkpoint_path && (games_ >= checkpoint_games_ + opts_.checkpoint_every))
+        {
+            save(offset);
+        }
+    }
+
+    // Writes the opening tree and the position index, and closes the output files
+    void finish()
+    {
+        if (opts_.tree_path)
+        {
+            for (auto& worker_tree: worker_trees_)
+            {
+                tree_.merge(std::move(worker_tree));
+            }
+            tree_.write(opts_.tree_path);
+        }
+        if (opts_.position_index_path)
+        {
+            position_index_.write(opts_.position_index_path);
+        }
+        if (positions_)
+        {
+            positions_->close();
+        }
+        if (binary_output_)
+        {
+            binary_output_->close();
+        }
+    }
+
+private:
+    options const& opts_;
+    bool const print_boards_;
+    chess::ingest_checkpoint checkpoint_;
+    bool resumed_ = false;
+    std::uint64_t games_ = 0;            // Games written, those before the checkpoint resumed from included
+    std::uint64_t checkpoint_games_ = 0; // Games written when the last checkpoint was saved
+    chess::opening_tree_builder tree_;
+    std::vector<chess::opening_tree_builder> worker_trees_;
+    chess::position_index_builder position_index_;
+    std::vector<chess::zobrist_hash> hashes_;
+    std::vector<chess::material_signature> materials_;
+    std::optional<chess::position_writer> positions_;
+    std::optional<chess::binary_writer> binary_output_;
+    std::optional<error_log> errors_;
+    std::string game_output_;
+};
+
+// Binary game files, replayed without parsing
+static void
+run_binary(options const& opts, game_sink& sink)
+{
+    if (opts.thread_count != 1)
+    {
+        std::cerr << "Note: -j ignored, binary game files are read sequentially\n";
+    }
+    chess::binary_reader reader(opts.pgn_paths.front());
+    std::string_view tag_section;
+    chess::pgn::tag_pairs tags;
+    std::vector<chess::packed_move> moves;
+    chess::board chess_board;
+    while (reader.next_game(tag_section, moves))
+    {
+        if (!opts.filter.empty() || sink.needs_result())
+        {
+            tags.parse(tag_section);
+            if (!opts.filter(tags))
+            {
+                continue;
+            }
+        }
+        chess_board.reset();
+        for (auto const move: moves)
+        {
+            chess_board.move(move);
+        }
+        sink.add_game({chess_board, moves, tags.get(chess::pgn::tag_key::Result), tag_section});
+    }
+}
+
+// Uncompressed PGN files, parsed and replayed on several threads and written in game order
+static void
+run_parallel(options const& opts, game_sink& sink)
+{
+    char const* const pgn_path = opts.pgn_paths.front();
+    chess::pgn::parallel_parser pgn_parser(opts.thread_count);
+    if (!opts.filter.empty())
+    {
+        pgn_parser.set_filter(opts.filter);
+    }
+    if (auto* const errors = sink.errors())
+    {
+        pgn_parser.set_error_handler([errors](std::uint64_t const offset, std::string_view const reason)
+        {
+            errors->record(offset, reason);
+        });
+    }
+    if (opts.checkpoint_path)
+    {
+        pgn_parser.set_progress_handler([&](std::uint64_t const offset, std::size_t) { sink.save_if_due(offset); });
+    }
+    sink.use_workers(pgn_parser.thread_count());
+    pgn_parser.run(pgn_path,
+                   [&](chess::pgn::parser& parser, std::vector<chess::pgn::player_move>& moves, std::string& output)
+                   {
+                       thread_local chess::board chess_board;
+                       thread_local std::vector<chess::packed_move> packed_moves;
+                       chess_board.reset();
+                       chess::pgn::replay(chess_board, moves);
+                       packed_moves.clear();
+                       if (sink.needs_moves())
+                       {
+                           chess::pgn::pack(moves, packed_moves);
+                       }
+                       auto const result = sink.needs_result() ? parser.tags().get(chess::pgn::tag_key::Result)
+                                                               : std::string_view();
+                       sink.format_game({chess_board, packed_moves, result},
+                                        chess::pgn::parallel_parser::worker_index(), output);
+                   },
+                   [&](std::size_t const game_id, std::string_view const output) { sink.write_game(game_id, output); },
+                   sink.checkpoint().offset, sink.checkpoint().games + 1);
+    sink.save(std::filesystem::file_size(pgn_path));
+}
+
+// Pulls games from a parser one at a time into a sink, so memory use is bounded by the largest game. The
+// buffers are kept from game to game
+class game_player
+{
+public:
+    game_player(options const& opts, game_sink& sink):
+        opts_(opts),
+        sink_(sink)
+    {
+    }
+
+    // Plays the games of pgn_parser, whose text starts at base_offset in the file
+    void play(chess::pgn::parser& pgn_parser, std::uint64_t const base_offset)
+    {
+        while (true)
+        {
+            std::uint64_t const offset = pgn_parser.offset();
+            try
+            {
+                if (!(opts_.variations ? pgn_parser.next_game(move_tree_) : pgn_parser.next_game(moves_)))
                 {
-                    std::ostringstream oss;
-                    oss << "Failed to find piece to make move " << (move_id / 2) << ": " << move;
-                    throw std::runtime_error(oss.str());
+                    break;
                 }
-#ifdef MLP_CHESS_DEBUG
-                std::cout << "Move " << (move_id/2) << ": " << move <<  "\n";
-#endif
-                chess_board.move(move.src, move.dest, move.is_capture);
-            },
-            [&](chess::pgn::kingside_castling& move)
+                chess_board_.reset();
+                tree_positions_.clear();
+                if (opts_.variations)
+                {
+                    replay_variations();
+                }
+                else
+                {
+                    chess::pgn::replay(chess_board_, moves_);
+                }
+                packed_moves_.clear();
+                if (sink_.needs_moves())
+                {
+                    chess::pgn::pack(moves_, packed_moves_);
+                }
+                auto const result = sink_.needs_result() ? pgn_parser.tags().get(chess::pgn::tag_key::Result)
+                                                         : std::string_view();
+                sink_.add_game({chess_board_, packed_moves_, result, pgn_parser.tag_section(), tree_positions_});
+            }
+            catch (std::exception const& e)
             {
-                chess_board.perform_kingside_castling(move.colour);
-            },
-            [&](chess::pgn::queenside_castling& move)
+                // Bad games are skipped as long as the parser got past them
+                if (!sink_.errors() || (pgn_parser.offset() == offset))
+                {
+                    throw;
+                }
+                sink_.errors()->record(base_offset + pgn_parser.game_offset(), e.what());
+            }
+            sink_.save_if_due(base_offset + pgn_parser.offset());
+        }
+    }
+
+private:
+    // Every line is played and exported, everything else only looks at the main line, whose final position
+    // the tree replay leaves in chess_board_. The positions are kept until the whole tree has been replayed,
+    // so a bad game writes none
+    void replay_variations()
+    {
+        tree_board_.reset();
+        chess::pgn::tree_visitor export_position;
+        if (opts_.positions_path)
+        {
+            export_position = [&](auto, chess::board const& position)
             {
-                chess_board.perform_queenside_castling(move.colour);
-            },
-            [](auto& other) {} // no op
-        ), move_var);
+                char record[chess::max_position_size];
+                tree_positions_.append(record, chess::format_position(position, opts_.positions_format, record));
+            };
+            export_position(chess::pgn::move_tree::no_node, tree_board_);
+        }
+        chess::pgn::replay(tree_board_, move_tree_, export_position, &chess_board_);
+        move_tree_.main_line(moves_);
+    }
 
-#ifdef MLP_CHESS_DEBUG
-        std::cout << chess_board;
-#endif
-        ++move_id;
+    options const& opts_;
+    game_sink& sink_;
+    std::vector<chess::pgn::player_move> moves_;
+    std::vector<chess::packed_move> packed_moves_;
+    chess::pgn::move_tree move_tree_;
+    std::string tree_positions_;
+    chess::board tree_board_; // Walks the variations, back to the initial position once done
+    chess::board chess_board_;
+};
+
+// PGN files read sequentially, compressed ones included
+static void
+run_sequential(options const& opts, game_sink& sink)
+{
+    chess::pgn::parser pgn_parser;
+    if (!opts.filter.empty())
+    {
+        pgn_parser.set_filter(opts.filter);
     }
+    pgn_parser.set_read_ahead(opts.read_ahead);
+    pgn_parser.open(opts.pgn_paths.front(), opts.input_mode);
+    if (sink.resumed())
+    {
+        pgn_parser.seek(sink.checkpoint().offset);
+    }
+    game_player player(opts, sink);
+    player.play(pgn_parser, 0);
+    sink.save(pgn_parser.offset());
+}
 
-#ifdef MLP_CHESS_DEBUG
-    std::cout << "\nEndgame: \n";
-#endif
-    std::cout << chess_board;
+// The games appended to the file are played as soon as they are complete. Their output is flushed (and
+// checkpointed) after every update, for whoever follows it in turn
+static void
+run_follow(options const& opts, game_sink& sink)
+{
+    chess::pgn::parser pgn_parser;
+    if (!opts.filter.empty())
+    {
+        pgn_parser.set_filter(opts.filter);
+    }
+    game_player player(opts, sink);
+    chess::pgn::follower follower(opts.pgn_paths.front(), sink.checkpoint().offset);
+    auto const play_update = [&](std::string_view const games)
+    {
+        if (games.empty())
+        {
+            return;
+        }
+        pgn_parser.open(games.data(), games.data() + games.size());
+        player.play(pgn_parser, follower.games_offset());
+        sink.save(follower.offset());
+    };
+    do
+    {
+        play_update(follower.update());
+    } while (follower.wait(opts.follow_idle ? std::chrono::milliseconds(std::chrono::seconds(opts.follow_idle))
+                                            : std::chrono::milliseconds(-1)));
+    // Gone idle: a last game ending the file without a newline won't be completed by one
+    play_update(follower.finish());
+}
+
+int main(int const argc, char** const argv)
+try
+{
+    std::ios::sync_with_stdio(false);
+    options opts;
+    if (!parse_options(argc, argv, opts))
+    {
+        return EXIT_FAILURE;
+    }
+    if (opts.explore_path)
+    {
+        explore(opts.explore_path, opts.pgn_paths.empty() ? "" : opts.pgn_paths.back());
+        return EXIT_SUCCESS;
+    }
+    if (opts.find_path)
+    {
+        if (opts.pgn_paths.empty())
+        {
+            print_usage(std::cout, opts.find_material ? "Missing material after --find-material"
+                                                      : "Missing position after --find-position");
+            return EXIT_FAILURE;
+        }
+        find_positions(opts.find_path, opts.pgn_paths.back(), opts.find_material);
+        return EXIT_SUCCESS;
+    }
+    if (opts.pgn_paths.empty())
+    {
+        print_usage(std::cout, "Missing pgn file path");
+        return EXIT_FAILURE;
+    }
+    if ((opts.pgn_paths.size() > 1) && !opts.dedup_path)
+    {
+        print_usage(std::cout, "Only --dedup takes more than one pgn file");
+        return EXIT_FAILURE;
+    }
+    char const* const pgn_path = opts.pgn_paths.front();
+    if (opts.stats && !chess::stats::enabled)
+    {
+        print_usage(std::cout, "--stats needs a build configured with -DMLP_CHESS_STATS=ON");
+        return EXIT_FAILURE;
+    }
+    if (opts.dedup_path)
+    {
+        return run_dedup(opts);
+    }
+    if (opts.game_number)
+    {
+        return print_indexed_game(opts);
+    }
+
+    bool const is_binary_input = chess::binary_format::is_binary_file(pgn_path);
+    bool const is_compressed = !is_binary_input && (chess::detect_compression(pgn_path) != chess::compression::none);
+    if (opts.position_index_path && (opts.positions_path || opts.variations))
+    {
+        print_usage(std::cout, "--position-index can't be combined with --export-positions or --variations");
+        return EXIT_FAILURE;
+    }
+    if (opts.checkpoint_path
+        && (opts.tree_path || opts.position_index_path || opts.binary_output_path || is_binary_input))
+    {
+        print_usage(std::cout, "--checkpoint only resumes printed boards and exported positions of PGN files");
+        return EXIT_FAILURE;
+    }
+    if (opts.checkpoint_path && !std::filesystem::is_regular_file(pgn_path))
+    {
+        print_usage(std::cout, "--checkpoint needs a PGN file it can seek in, not a pipe");
+        return EXIT_FAILURE;
+    }
+    if (opts.follow && (is_binary_input || is_compressed))
+    {
+        print_usage(std::cout, "--follow only follows uncompressed PGN files");
+        return EXIT_FAILURE;
+    }
+
+    game_sink sink(opts);
+    if (is_binary_input)
+    {
+        run_binary(opts, sink);
+    }
+    // Compressed files can't be split between threads, they are always parsed sequentially
+    else if ((opts.thread_count != 1) && !opts.binary_output_path && !opts.variations && !opts.follow && !is_compressed)
+    {
+        run_parallel(opts, sink);
+    }
+    else
+    {
+        if (opts.thread_count != 1)
+        {
+            std::cerr << "Note: -j ignored, games are read sequentially with --write-binary, --variations, --follow"
+                         " and compressed files\n";
+        }
+        opts.follow ? run_follow(opts, sink) : run_sequential(opts, sink);
+    }
+    sink.finish();
+    print_stats(opts);
     return EXIT_SUCCESS;
 }
 catch (...)